@@ -0,0 +1,219 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Packed animation file. See anim.h
+//
+///////////////////////////////////////////////////////////////////////
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "anim.h"
+#include "fileOps.h"
+
+// Index entry of a version 1 file
+struct EntryV1
+{
+ uint64_t Offset;
+ uint32_t Length;
+ uint32_t Ms;
+};
+
+int AnimOpen(char *Path, struct Anim *A)
+{
+ struct AnimHeader *H;
+ struct EntryV1 *Old;
+ struct stat st;
+ size_t Entry;
+ int Fd, i;
+
+ memset(A, 0, sizeof(*A));
+ if((Fd = open(Path, O_RDONLY | O_CLOEXEC)) < 0) return -1;
+ if(fstat(Fd, &st) < 0 || (size_t)st.st_size < sizeof(*H))
+ {
+  close(Fd);
+  return -1;
+ }
+ A->Len = st.st_size;
+ A->Data = mmap(NULL, A->Len, PROT_READ, MAP_SHARED, Fd, 0);
+ close(Fd); // The mapping keeps the file
+ if(A->Data == MAP_FAILED)
+ {
+  perror(Path);
+  A->Data = NULL;
+  return -1;
+ }
+ // Playback reads it front to back
+ madvise(A->Data, A->Len, MADV_SEQUENTIAL);
+
+ H = (struct AnimHeader *)A->Data;
+ A->Frames = H->Frames;
+ A->Index = (struct AnimEntry *)(A->Data + sizeof(*H));
+ Entry = H->Version == 1 ? sizeof(*Old) : sizeof(struct AnimEntry);
+ if(H->Magic != ANIM_MAGIC || H->Version < 1 || H->Version > ANIM_VERSION ||
+    H->Frames > (A->Len - sizeof(*H)) / Entry)
+ {
+  printf("%s is not a packed animation\n", Path);
+  AnimClose(A);
+  return -1;
+ }
+ // Give a version 1 index the current layout, with no hashes
+ if(H->Version == 1)
+ {
+  Old = (struct EntryV1 *)(A->Data + sizeof(*H));
+  if((A->Index = calloc(A->Frames ? A->Frames : 1, sizeof(*A->Index))) == NULL)
+  {
+   AnimClose(A);
+   return -1;
+  }
+  A->OwnIndex = 1;
+  for(i=0; i<A->Frames; i++)
+  {
+   A->Index[i].Offset = Old[i].Offset;
+   A->Index[i].Length = Old[i].Length;
+   A->Index[i].Ms = Old[i].Ms;
+  }
+ }
+ for(i=0; i<A->Frames; i++)
+  if(A->Index[i].Offset > A->Len || A->Index[i].Length > A->Len - A->Index[i].Offset)
+  {
+   printf("%s is damaged at frame %d\n", Path, i);
+   AnimClose(A);
+   return -1;
+  }
+ return 0;
+}
+
+unsigned char *AnimFrame(struct Anim *A, int i, size_t *Len)
+{
+ if(i < 0 || i >= A->Frames) return NULL;
+ *Len = A->Index[i].Length;
+ return A->Data + A->Index[i].Offset;
+}
+
+int AnimDuration(struct Anim *A, int i)
+{
+ return i >= 0 && i < A->Frames ? (int)A->Index[i].Ms : 0;
+}
+
+void AnimClose(struct Anim *A)
+{
+ if(A->OwnIndex) free(A->Index);
+ if(A->Data) munmap(A->Data, A->Len);
+ memset(A, 0, sizeof(*A));
+}
+
+// Append Len bytes of In to Out, in the kernel where it can be
+static int Append(int In, int Out, size_t Len)
+{
+ char Buf[65536];
+ ssize_t n;
+
+ while(Len > 0 && (n = copy_file_range(In, NULL, Out, NULL, Len, 0)) > 0) Len -= n;
+ while(Len > 0)
+ {
+  if((n = read(In, Buf, Len < sizeof(Buf) ? Len : sizeof(Buf))) <= 0 ||
+     write(Out, Buf, n) != n) return -1;
+  Len -= n;
+ }
+ return 0;
+}
+
+int AnimWrite(char *Path, char **Frames, uint64_t *Hashes, int N, int Ms)
+{
+ struct AnimHeader H = { ANIM_MAGIC, ANIM_VERSION, N, 0 };
+ struct AnimEntry *Index;
+ struct stat st;
+ char Tmp[280];
+ uint64_t At = sizeof(H) + (uint64_t)N * sizeof(*Index);
+ int Out, In, i, r;
+
+ if((Index = calloc(N ? N : 1, sizeof(*Index))) == NULL) return -1;
+ snprintf(Tmp, sizeof(Tmp), "%s.tmp", Path);
+ if((Out = open(Tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0)
+ {
+  perror(Tmp);
+  free(Index);
+  return -1;
+ }
+ // The payloads go after the index, which is filled in as they are
+ // copied and written last
+ lseek(Out, At, SEEK_SET);
+ for(i=0; i<N; i++)
+ {
+  if((In = open(Frames[i], O_RDONLY | O_CLOEXEC)) < 0 || fstat(In, &st) < 0 ||
+     Append(In, Out, st.st_size) < 0)
+  {
+   perror(Frames[i]);
+   if(In >= 0) close(In);
+   break;
+  }
+  close(In);
+  Index[i].Offset = At;
+  Index[i].Length = st.st_size;
+  Index[i].Ms = Ms;
+  Index[i].Hash = Hashes ? Hashes[i] : 0;
+  At += st.st_size;
+ }
+ r = i == N && pwrite(Out, &H, sizeof(H), 0) == sizeof(H) &&
+     pwrite(Out, Index, N * sizeof(*Index), sizeof(H)) == (ssize_t)(N * sizeof(*Index)) ? N : -1;
+ if(close(Out) != 0 || (r >= 0 && FileRename(Tmp, Path, 0) < 0)) r = -1;
+ if(r < 0) unlink(Tmp);
+ free(Index);
+ return r;
+}
+
+static int IsFrame(const struct dirent *e)
+{
+ size_t n = strlen(e->d_name);
+
+ return strncmp(e->d_name, "Frame", 5) == 0 && n > 9 && strcmp(e->d_name + n - 4, ".jpg") == 0;
+}
+
+int AnimPack(char *Dir, int Ms)
+{
+ struct dirent **List;
+ struct Anim A;
+ char **Paths, s[280];
+ int N, i, r = -1;
+
+ if((N = scandir(Dir, &List, IsFrame, alphasort)) < 0)
+ {
+  perror(Dir);
+  return -1;
+ }
+ snprintf(s, sizeof(s), "%s/%s", Dir, ANIM_FILE);
+ if(N == 0) r = 0;
+ // A packed file already there means an earlier pack was cut short
+ // after writing it. Only the frames are left to remove.
+ else if(AnimOpen(s, &A) == 0)
+ {
+  r = A.Frames;
+  AnimClose(&A);
+ }
+ else if((Paths = calloc(N, sizeof(char *))) != NULL)
+ {
+  for(i=0; i<N; i++)
+   if((Paths[i] = malloc(strlen(Dir) + strlen(List[i]->d_name) + 2)) != NULL)
+    sprintf(Paths[i], "%s/%s", Dir, List[i]->d_name);
+  for(i=0; i<N && Paths[i]; i++);
+  if(i == N) r = AnimWrite(s, Paths, NULL, N, Ms);
+  for(i=0; i<N; i++) free(Paths[i]);
+  free(Paths);
+ }
+ for(i=0; i<N; i++)
+ {
+  snprintf(s, sizeof(s), "%s/%s", Dir, List[i]->d_name);
+  if(r > 0) FileRemove(s);
+  free(List[i]);
+ }
+ free(List);
+ return r;
+}
@@ -0,0 +1,68 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Packed animation file
+//
+// A saved video as one file instead of a folder of Frame%05d.jpg
+// files: a header, an index giving each frame's offset, length and
+// display time, then the JPEG data of the frames one after another.
+// Playing it takes one open() and one mmap(); the player hands each
+// frame's bytes to the decoder straight from the mapping, with no
+// per frame file lookup, open or copy. All numbers are little endian,
+// as on the Pi.
+//
+// The file is written under a temporary name and renamed into place,
+// so a reader only ever sees a complete one.
+//
+///////////////////////////////////////////////////////////////////////
+
+#ifndef ANIM_H
+#define ANIM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define ANIM_FILE    "Video.anim"  // Name of the packed file in a video folder
+#define ANIM_MAGIC   0x4D494E41    // "ANIM"
+#define ANIM_VERSION 2             // 1 had no frame hashes
+
+struct AnimHeader
+{
+ uint32_t Magic;
+ uint32_t Version;
+ uint32_t Frames;
+ uint32_t Reserved;
+};
+
+struct AnimEntry
+{
+ uint64_t Offset;  // From the start of the file
+ uint32_t Length;  // Bytes of JPEG data
+ uint32_t Ms;      // How long the frame is shown
+ uint64_t Hash;    // Perceptual hash of the frame (frameHash.h), 0 if not known
+};
+
+// An open packed file
+struct Anim
+{
+ unsigned char *Data;     // The whole file, mapped read only
+ size_t Len;
+ int Frames;
+ struct AnimEntry *Index;
+ int OwnIndex;            // Index was converted from an older version
+};
+
+int  AnimOpen(char *Path, struct Anim *A);
+// The JPEG data of frame i, NULL if there is no such frame
+unsigned char *AnimFrame(struct Anim *A, int i, size_t *Len);
+int  AnimDuration(struct Anim *A, int i);
+void AnimClose(struct Anim *A);
+
+// Pack N JPEG files into Path, each shown for Ms milliseconds. Hashes
+// may be NULL. Returns N, or -1 if the file could not be written.
+int  AnimWrite(char *Path, char **Frames, uint64_t *Hashes, int N, int Ms);
+// Pack the Frame*.jpg files in a video folder into its ANIM_FILE and
+// remove them. Returns the number of frames packed, 0 if there were
+// none.
+int  AnimPack(char *Dir, int Ms);
+
+#endif
@@ -0,0 +1,213 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Content addressed frame store. See blobStore.h
+//
+///////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "blobStore.h"
+
+#define P1 0x9E3779B185EBCA87ull
+#define P2 0xC2B2AE3D27D4EB4Full
+#define P3 0x165667B19E3779F9ull
+#define P4 0x85EBCA77C2B2AE63ull
+#define P5 0x27D4EB2F165667C5ull
+
+static char Folder[200];
+static struct BlobStats Stats;
+static pthread_mutex_t Lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline uint64_t Rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+static inline uint64_t Read64(const unsigned char *p) { uint64_t v; memcpy(&v, p, 8); return v; }
+static inline uint32_t Read32(const unsigned char *p) { uint32_t v; memcpy(&v, p, 4); return v; }
+
+static inline uint64_t Round(uint64_t Acc, uint64_t In)
+{
+ Acc += In * P2;
+ return Rotl(Acc, 31) * P1;
+}
+
+static inline uint64_t Merge(uint64_t Acc, uint64_t v)
+{
+ Acc ^= Round(0, v);
+ return Acc * P1 + P4;
+}
+
+// XXH64, little endian as on the Pi
+uint64_t BlobHash(const void *Data, size_t Len, uint64_t Seed)
+{
+ const unsigned char *p = Data, *End = p + Len;
+ uint64_t h, v1, v2, v3, v4;
+
+ if(Len >= 32)
+ {
+  v1 = Seed + P1 + P2;
+  v2 = Seed + P2;
+  v3 = Seed;
+  v4 = Seed - P1;
+  for(; p + 32 <= End; p += 32)
+  {
+   v1 = Round(v1, Read64(p));
+   v2 = Round(v2, Read64(p + 8));
+   v3 = Round(v3, Read64(p + 16));
+   v4 = Round(v4, Read64(p + 24));
+  }
+  h = Rotl(v1, 1) + Rotl(v2, 7) + Rotl(v3, 12) + Rotl(v4, 18);
+  h = Merge(h, v1);
+  h = Merge(h, v2);
+  h = Merge(h, v3);
+  h = Merge(h, v4);
+ }
+ else h = Seed + P5;
+ h += Len;
+ for(; p + 8 <= End; p += 8) h = Rotl(h ^ Round(0, Read64(p)), 27) * P1 + P4;
+ if(p + 4 <= End)
+ {
+  h = Rotl(h ^ (uint64_t)Read32(p) * P1, 23) * P2 + P3;
+  p += 4;
+ }
+ for(; p < End; p++) h = Rotl(h ^ *p * P5, 11) * P1;
+ h ^= h >> 33;
+ h *= P2;
+ h ^= h >> 29;
+ h *= P3;
+ h ^= h >> 32;
+ return h;
+}
+
+int BlobOpen(char *Dir)
+{
+ snprintf(Folder, sizeof(Folder), "%s", Dir);
+ memset(&Stats, 0, sizeof(Stats));
+ if(mkdir(Folder, 0755) < 0 && errno != EEXIST)
+ {
+  perror(Folder);
+  return -1;
+ }
+ return BlobCollect();
+}
+
+// 1 if the file at Path holds exactly Len bytes equal to Data
+static int Same(char *Path, unsigned char *Data, size_t Len)
+{
+ struct stat st;
+ void *m;
+ int Fd, r = 0;
+
+ if((Fd = open(Path, O_RDONLY | O_CLOEXEC)) < 0) return 0;
+ if(fstat(Fd, &st) == 0 && (size_t)st.st_size == Len)
+ {
+  if(Len == 0) r = 1;
+  else if((m = mmap(NULL, Len, PROT_READ, MAP_SHARED, Fd, 0)) != MAP_FAILED)
+  {
+   r = memcmp(m, Data, Len) == 0;
+   munmap(m, Len);
+  }
+ }
+ close(Fd);
+ return r;
+}
+
+int BlobPut(char *Path)
+{
+ char Blob[256], Tmp[280];
+ struct stat st;
+ unsigned char *m;
+ uint64_t h;
+ int Fd, r = -1;
+
+ if(Folder[0] == 0) return -1;
+ if((Fd = open(Path, O_RDONLY | O_CLOEXEC)) < 0)
+ {
+  perror(Path);
+  return -1;
+ }
+ if(fstat(Fd, &st) < 0 || st.st_size == 0 ||
+    (m = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, Fd, 0)) == MAP_FAILED)
+ {
+  close(Fd);
+  return -1;
+ }
+ h = BlobHash(m, st.st_size, 0);
+ snprintf(Blob, sizeof(Blob), "%s/%016llx.jpg", Folder, (unsigned long long)h);
+
+ // The store is shared by the encoder threads, so checking for the
+ // blob and adding it must not interleave.
+ pthread_mutex_lock(&Lock);
+ if(link(Path, Blob) == 0) r = 0; // New content
+ else if(errno == EEXIST && Same(Blob, m, st.st_size))
+ {
+  // Already stored: point this name at the blob instead
+  snprintf(Tmp, sizeof(Tmp), "%s.blob", Path);
+  unlink(Tmp);
+  if(link(Blob, Tmp) == 0 && rename(Tmp, Path) == 0) r = 1;
+  else unlink(Tmp);
+ }
+ // A hash collision (or a file system without links) just leaves the
+ // frame as it is
+ Stats.Frames++;
+ if(r == 1)
+ {
+  Stats.Dupes++;
+  Stats.Saved += st.st_size;
+ }
+ pthread_mutex_unlock(&Lock);
+ munmap(m, st.st_size);
+ close(Fd);
+ return r;
+}
+
+int BlobCollect()
+{
+ struct dirent *e;
+ struct stat st;
+ DIR *d;
+ int Fd;
+ long Blobs = 0;
+ long long Stored = 0, Logical = 0;
+
+ if(Folder[0] == 0) return -1;
+ if((d = opendir(Folder)) == NULL)
+ {
+  perror(Folder);
+  return -1;
+ }
+ Fd = dirfd(d);
+ pthread_mutex_lock(&Lock);
+ while((e = readdir(d)) != NULL)
+ {
+  if(e->d_name[0] == '.' || fstatat(Fd, e->d_name, &st, 0) < 0 || !S_ISREG(st.st_mode)) continue;
+  if(st.st_nlink <= 1)
+  {
+   unlinkat(Fd, e->d_name, 0);
+   continue;
+  }
+  Blobs++;
+  Stored += st.st_size;
+  Logical += (long long)st.st_size * (st.st_nlink - 1);
+ }
+ Stats.Blobs = Blobs;
+ Stats.Stored = Stored;
+ Stats.Logical = Logical;
+ Stats.Ratio = Stored ? (double)Logical / Stored : 1.0;
+ pthread_mutex_unlock(&Lock);
+ closedir(d);
+ return 0;
+}
+
+void BlobGetStats(struct BlobStats *S)
+{
+ pthread_mutex_lock(&Lock);
+ *S = Stats;
+ pthread_mutex_unlock(&Lock);
+}
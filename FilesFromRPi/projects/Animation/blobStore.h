@@ -0,0 +1,50 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Content addressed frame store
+//
+// Visitors often record the same unchanged scene several times, and
+// every saved video holds its own names for the session's frames. The
+// store keeps each distinct frame once, as Blobs/<hash>.jpg, where the
+// hash is a 64 bit XXH64 of the JPEG bytes. Once a frame file is
+// written, BlobPut() hashes it and either adds it to the store or, if
+// the store already has the same bytes, replaces it with a hard link
+// to that blob so the duplicate's space is freed.
+//
+// Frame names in the session, in saved videos and in the store are
+// all hard links to the same inode, so the link count is the reference
+// count. A blob whose link count is down to 1 is referenced only by
+// the store and BlobCollect() removes it.
+//
+///////////////////////////////////////////////////////////////////////
+
+#ifndef BLOBSTORE_H
+#define BLOBSTORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define BLOB_DIR "Blobs"
+
+struct BlobStats
+{
+ long Frames;         // Frames put since the store was opened
+ long Dupes;          // Of those, frames that were already stored
+ long long Saved;     // Bytes freed by those duplicates
+ long Blobs;          // Blobs in the store at the last collection
+ long long Stored;    // Their total size
+ long long Logical;   // Size of all the frame names referring to them
+ double Ratio;        // Logical / Stored, how much deduplication saves
+};
+
+uint64_t BlobHash(const void *Data, size_t Len, uint64_t Seed);
+
+int  BlobOpen(char *Dir);
+// Store a finished frame file, or make it a link to an identical one.
+// Returns 1 if it was a duplicate, 0 if it was new, -1 on error. Safe
+// to call from several threads.
+int  BlobPut(char *Path);
+// Remove blobs nothing else refers to and update the totals
+int  BlobCollect();
+void BlobGetStats(struct BlobStats *S);
+
+#endif
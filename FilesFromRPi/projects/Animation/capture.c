@@ -0,0 +1,240 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Native frame capture. See capture.h
+//
+// The device is streamed continuously into NUM_BUFS mmap'd buffers.
+// A grab drains every buffer the driver has filled so the copy comes
+// from the newest frame, not one that has been sitting in the queue.
+//
+///////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/videodev2.h>
+
+#include "capture.h"
+
+#define NUM_BUFS 4
+
+static int Fd = -1;
+static int IsFile = 0;     // Reading raw frames from a file
+static int Wide, High, Stride;
+static void *Bufs[NUM_BUFS];
+static size_t Lens[NUM_BUFS];
+static int NumBufs = 0;
+
+// Raw frame file state
+static unsigned char *FileData = NULL;
+static size_t FileLen = 0;
+static int FileFrames = 0, FileNext = 0;
+
+int CaptureWide() { return Wide; }
+int CaptureHigh() { return High; }
+
+// ioctl() that retries when interrupted by a signal
+static int Ioctl(int Request, void *Arg)
+{
+ int r;
+
+ while((r = ioctl(Fd, Request, Arg)) < 0 && errno == EINTR);
+ return r;
+}
+
+static int OpenFile(char *Path, int W, int H)
+{
+ struct stat st;
+
+ fstat(Fd, &st);
+ Wide = W;
+ High = H;
+ Stride = W * 2;
+ FileLen = st.st_size;
+ FileFrames = FileLen / ((size_t)Stride * H);
+ if(FileFrames == 0)
+ {
+  printf("%s holds no %dx%d YUYV frames\n", Path, W, H);
+  return -1;
+ }
+ FileData = mmap(NULL, FileLen, PROT_READ, MAP_SHARED, Fd, 0);
+ if(FileData == MAP_FAILED)
+ {
+  perror(Path);
+  FileData = NULL;
+  return -1;
+ }
+ IsFile = 1;
+ FileNext = 0;
+ return 0;
+}
+
+int CaptureOpen(char *Device, int W, int H)
+{
+ struct v4l2_format Fmt;
+ struct v4l2_requestbuffers Req;
+ struct v4l2_buffer Buf;
+ struct stat st;
+ enum v4l2_buf_type Type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+ int i;
+
+ if((Fd = open(Device, O_RDWR | O_NONBLOCK | O_CLOEXEC)) < 0)
+ {
+  perror(Device);
+  return -1;
+ }
+ if(fstat(Fd, &st) == 0 && S_ISREG(st.st_mode))
+ {
+  if(OpenFile(Device, W, H) == 0) return 0;
+  CaptureClose();
+  return -1;
+ }
+
+ // Ask for YUYV at the screen size. The driver may adjust the size.
+ memset(&Fmt, 0, sizeof(Fmt));
+ Fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+ Fmt.fmt.pix.width = W;
+ Fmt.fmt.pix.height = H;
+ Fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
+ Fmt.fmt.pix.field = V4L2_FIELD_NONE;
+ if(Ioctl(VIDIOC_S_FMT, &Fmt) < 0 || Fmt.fmt.pix.pixelformat != V4L2_PIX_FMT_YUYV)
+ {
+  printf("%s cannot capture YUYV\n", Device);
+  CaptureClose();
+  return -1;
+ }
+ Wide = Fmt.fmt.pix.width;
+ High = Fmt.fmt.pix.height;
+ Stride = Fmt.fmt.pix.bytesperline ? (int)Fmt.fmt.pix.bytesperline : Wide * 2;
+
+ memset(&Req, 0, sizeof(Req));
+ Req.count = NUM_BUFS;
+ Req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+ Req.memory = V4L2_MEMORY_MMAP;
+ if(Ioctl(VIDIOC_REQBUFS, &Req) < 0 || Req.count < 2)
+ {
+  perror("VIDIOC_REQBUFS");
+  CaptureClose();
+  return -1;
+ }
+ for(NumBufs=0; NumBufs<(int)Req.count && NumBufs<NUM_BUFS; NumBufs++)
+ {
+  memset(&Buf, 0, sizeof(Buf));
+  Buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  Buf.memory = V4L2_MEMORY_MMAP;
+  Buf.index = NumBufs;
+  if(Ioctl(VIDIOC_QUERYBUF, &Buf) < 0) break;
+  Bufs[NumBufs] = mmap(NULL, Buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, Fd, Buf.m.offset);
+  if(Bufs[NumBufs] == MAP_FAILED) break;
+  Lens[NumBufs] = Buf.length;
+ }
+ // Hand all the buffers to the driver and start streaming
+ for(i=0; i<NumBufs; i++)
+ {
+  memset(&Buf, 0, sizeof(Buf));
+  Buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  Buf.memory = V4L2_MEMORY_MMAP;
+  Buf.index = i;
+  Ioctl(VIDIOC_QBUF, &Buf);
+ }
+ if(NumBufs < 2 || Ioctl(VIDIOC_STREAMON, &Type) < 0)
+ {
+  perror("VIDIOC_STREAMON");
+  CaptureClose();
+  return -1;
+ }
+ return 0;
+}
+
+// Copy a rectangle out of a whole frame
+static void Crop(struct Frame *Out, unsigned char *Src, int X, int Y, int W, int H)
+{
+ int r;
+
+ X &= ~1; // Keep whole YUYV pixel pairs
+ if(X > Wide) X = Wide;
+ if(Y > High) Y = High;
+ if(X + W > Wide) W = (Wide - X) & ~1;
+ if(Y + H > High) H = High - Y;
+ Out->Wide = W;
+ Out->High = H;
+ Out->Stride = W * 2;
+ Out->Format = FRAME_YUYV;
+ for(r=0; r<H; r++) memcpy(Out->Pixels + (size_t)r * Out->Stride, Src + (size_t)(Y + r) * Stride + X * 2, W * 2);
+}
+
+int CaptureGrab(struct Frame *Out, int X, int Y, int W, int H)
+{
+ struct v4l2_buffer Buf, Last;
+ struct pollfd p;
+ int Have = 0;
+
+ if(Fd < 0) return -1;
+ if(IsFile)
+ {
+  Crop(Out, FileData + (size_t)FileNext * Stride * High, X, Y, W, H);
+  FileNext = (FileNext + 1) % FileFrames;
+  return 0;
+ }
+
+ // Drain the queue, handing back all but the newest filled buffer.
+ // If nothing is ready yet wait for the next frame.
+ for(;;)
+ {
+  memset(&Buf, 0, sizeof(Buf));
+  Buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  Buf.memory = V4L2_MEMORY_MMAP;
+  if(Ioctl(VIDIOC_DQBUF, &Buf) == 0)
+  {
+   if(Have) Ioctl(VIDIOC_QBUF, &Last);
+   Last = Buf;
+   Have = 1;
+   continue;
+  }
+  if(errno != EAGAIN)
+  {
+   perror("VIDIOC_DQBUF");
+   break;
+  }
+  if(Have) break;
+  p.fd = Fd;
+  p.events = POLLIN;
+  if(poll(&p, 1, 2000) <= 0)
+  {
+   printf("No frame from camera\n");
+   break;
+  }
+ }
+ if(!Have) return -1;
+
+ Crop(Out, Bufs[Last.index], X, Y, W, H);
+ Ioctl(VIDIOC_QBUF, &Last);
+ return 0;
+}
+
+void CaptureClose()
+{
+ enum v4l2_buf_type Type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+ int i;
+
+ if(Fd < 0) return;
+ if(IsFile)
+ {
+  if(FileData) munmap(FileData, FileLen);
+  FileData = NULL;
+  IsFile = 0;
+ }
+ else
+ {
+  if(NumBufs) Ioctl(VIDIOC_STREAMOFF, &Type);
+  for(i=0; i<NumBufs; i++) munmap(Bufs[i], Lens[i]);
+  NumBufs = 0;
+ }
+ close(Fd);
+ Fd = -1;
+}
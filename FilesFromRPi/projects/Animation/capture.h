@@ -0,0 +1,36 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Native frame capture
+//
+// Frames are dequeued straight from a V4L2 capture device using
+// mmap'd buffers and the wanted rectangle is copied out in memory.
+// This replaces grabbing the screen with scrot, cropping it with
+// convert and deleting the screen shot, which cost three processes
+// and two JPEG round trips per frame.
+//
+// If the device name is a regular file instead of a device, it is
+// taken to be a file of raw YUYV frames of the given size which are
+// handed out in turn, starting over at the end. Together with the
+// vivid virtual driver this allows capture to run on a box with no
+// camera.
+//
+///////////////////////////////////////////////////////////////////////
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include "frame.h"
+
+// Open a capture device (or raw frame file) at the given size. The
+// driver may pick a different size, CaptureWide() and CaptureHigh()
+// give the one in use.
+int  CaptureOpen(char *Device, int Wide, int High);
+// Copy the X, Y, Wide, High rectangle of the newest frame into
+// Out->Pixels, which must hold Wide*High*2 bytes. The rectangle is
+// clipped to the frame and X is rounded down to an even pixel.
+int  CaptureGrab(struct Frame *Out, int X, int Y, int Wide, int High);
+int  CaptureWide();
+int  CaptureHigh();
+void CaptureClose();
+
+#endif
@@ -0,0 +1,323 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Saved video catalog. See catalog.h
+//
+// The saved video folder is watched for folders being made, removed
+// and renamed, and each video folder is watched for frames being
+// written, linked, renamed or removed. A video whose frames changed is
+// marked and counted again once the events read so far have been
+// applied, so saving a video costs one recount rather than one for
+// every frame. A rename of a video folder is paired up by its inotify
+// cookie and only changes the name in the catalog.
+//
+///////////////////////////////////////////////////////////////////////
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#include "catalog.h"
+#include "decode.h"
+#include "anim.h"
+
+#define DIR_EVENTS   (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR)
+#define FRAME_EVENTS (IN_CREATE | IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+#define GEN_FILE     "Gen"  // Generation number of a gallery slot
+
+struct Entry
+{
+ struct SavedVideo V;
+ int Wd;          // inotify watch on the folder
+ int Dirty;       // Frames changed, count again
+ int ThumbDirty;  // First frame changed, decode again
+ unsigned Cookie; // Set while the folder is being renamed
+};
+
+static char Folder[200];
+static struct Entry *Entries[CATALOG_MAX]; // In name order
+static int Count = 0;
+static int Notify = -1, TopWd = -1;
+
+// Read a folder with getdents64(), calling Found() for each name
+static void ScanDir(int Fd, void (*Found)(int Fd, char *Name, unsigned char Type, void *Arg), void *Arg)
+{
+ char Buf[8192];
+ struct dirent64 *d;
+ ssize_t n, i;
+
+ while((n = getdents64(Fd, Buf, sizeof(Buf))) > 0)
+  for(i=0; i<n; i+=d->d_reclen)
+  {
+   d = (struct dirent64 *)(Buf + i);
+   if(d->d_name[0] != '.') Found(Fd, d->d_name, d->d_type, Arg);
+  }
+}
+
+// Read the generation number a saved video folder may hold
+static long ReadGen(char *Dir)
+{
+ char s[300];
+ FILE *F;
+ long Gen = 0;
+
+ snprintf(s, sizeof(s), "%s/%s", Dir, GEN_FILE);
+ if((F = fopen(s, "r")) != NULL)
+ {
+  if(fscanf(F, "%ld", &Gen) != 1) Gen = 0;
+  fclose(F);
+ }
+ return Gen;
+}
+
+static int IsFrame(char *Name)
+{
+ size_t n = strlen(Name);
+
+ return strncmp(Name, "Frame", 5) == 0 && n > 9 && strcmp(Name + n - 4, ".jpg") == 0;
+}
+
+static void CountFrame(int Fd, char *Name, unsigned char Type, void *Arg)
+{
+ struct SavedVideo *V = Arg;
+ struct stat st;
+
+ (void)Type;
+ if(!IsFrame(Name) || fstatat(Fd, Name, &st, 0) < 0) return;
+ V->Frames++;
+ V->Bytes += st.st_size;
+ if(st.st_mtime > V->Time) V->Time = st.st_mtime;
+}
+
+// Count the frames of a video again, and decode its thumbnail if the
+// first frame changed. A packed video is counted from its index alone.
+static void Rescan(struct Entry *E)
+{
+ struct Anim A;
+ struct stat st;
+ unsigned char *Data;
+ size_t Len;
+ char s[280];
+ int Fd;
+
+ E->V.Frames = 0;
+ E->V.Bytes = 0;
+ E->V.Time = 0;
+ snprintf(s, sizeof(s), "%s/%s", Folder, E->V.Name);
+ E->V.Gen = ReadGen(s);
+ snprintf(s, sizeof(s), "%s/%s/%s", Folder, E->V.Name, ANIM_FILE);
+ if(AnimOpen(s, &A) == 0)
+ {
+  E->V.Frames = A.Frames;
+  E->V.Bytes = A.Len;
+  if(stat(s, &st) == 0) E->V.Time = st.st_mtime;
+  if(E->ThumbDirty && ((Data = AnimFrame(&A, 0, &Len)) == NULL ||
+     DecodeJpegMem(Data, Len, &E->V.Thumb, THUMB_WIDE, THUMB_HIGH) < 0)) E->V.Thumb.Wide = 0;
+  AnimClose(&A);
+  E->Dirty = E->ThumbDirty = 0;
+  return;
+ }
+ snprintf(s, sizeof(s), "%s/%s", Folder, E->V.Name);
+ if((Fd = open(s, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) >= 0)
+ {
+  ScanDir(Fd, CountFrame, &E->V);
+  close(Fd);
+ }
+ if(E->ThumbDirty)
+ {
+  snprintf(s, sizeof(s), "%s/%s/Frame00000.jpg", Folder, E->V.Name);
+  if(E->V.Frames == 0 || DecodeJpegFile(s, &E->V.Thumb, THUMB_WIDE, THUMB_HIGH) < 0) E->V.Thumb.Wide = 0;
+ }
+ E->Dirty = E->ThumbDirty = 0;
+}
+
+static int Find(char *Name)
+{
+ int i;
+
+ for(i=0; i<Count; i++) if(strcmp(Entries[i]->V.Name, Name) == 0) return i;
+ return -1;
+}
+
+static int FindWd(int Wd)
+{
+ int i;
+
+ for(i=0; i<Count; i++) if(Entries[i]->Wd == Wd) return i;
+ return -1;
+}
+
+// Put entry i back in name order after its name changed
+static void Sort(int i)
+{
+ struct Entry *E = Entries[i];
+
+ while(i > 0 && strcmp(Entries[i-1]->V.Name, E->V.Name) > 0)
+ {
+  Entries[i] = Entries[i-1];
+  i--;
+ }
+ while(i < Count-1 && strcmp(Entries[i+1]->V.Name, E->V.Name) < 0)
+ {
+  Entries[i] = Entries[i+1];
+  i++;
+ }
+ Entries[i] = E;
+}
+
+static void Add(char *Name)
+{
+ struct Entry *E;
+ char s[280];
+
+ // Hidden folders are work in progress, not saved videos
+ if(Name[0] == '.' || Find(Name) >= 0) return;
+ if(Count == CATALOG_MAX || (E = calloc(1, sizeof(*E))) == NULL)
+ {
+  printf("Saved video catalog is full, %s not listed\n", Name);
+  return;
+ }
+ if((E->V.Thumb.Pixels = malloc(THUMB_WIDE * THUMB_HIGH * 4)) == NULL)
+ {
+  free(E);
+  return;
+ }
+ snprintf(E->V.Name, sizeof(E->V.Name), "%s", Name);
+ snprintf(s, sizeof(s), "%s/%s", Folder, Name);
+ E->Wd = Notify >= 0 ? inotify_add_watch(Notify, s, FRAME_EVENTS | IN_ONLYDIR) : -1;
+ E->ThumbDirty = 1;
+ Rescan(E);
+ Entries[Count++] = E;
+ Sort(Count - 1);
+}
+
+static void Drop(int i)
+{
+ if(Entries[i]->Wd >= 0) inotify_rm_watch(Notify, Entries[i]->Wd);
+ free(Entries[i]->V.Thumb.Pixels);
+ free(Entries[i]);
+ memmove(Entries + i, Entries + i + 1, (Count - i - 1) * sizeof(*Entries));
+ Count--;
+}
+
+static void FoundVideo(int Fd, char *Name, unsigned char Type, void *Arg)
+{
+ struct stat st;
+
+ (void)Arg;
+ if(Type == DT_DIR || (Type == DT_UNKNOWN && fstatat(Fd, Name, &st, 0) == 0 && S_ISDIR(st.st_mode))) Add(Name);
+}
+
+// Build the whole catalog from the disk
+static void Build()
+{
+ int Fd;
+
+ while(Count) Drop(Count - 1);
+ if((Fd = open(Folder, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+ {
+  perror(Folder);
+  return;
+ }
+ ScanDir(Fd, FoundVideo, NULL);
+ close(Fd);
+}
+
+int CatalogOpen(char *Dir)
+{
+ snprintf(Folder, sizeof(Folder), "%s", Dir);
+ mkdir(Folder, 0755);
+ if((Notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) perror("inotify_init1");
+ else if((TopWd = inotify_add_watch(Notify, Folder, DIR_EVENTS)) < 0) perror(Folder);
+ Build();
+ return Notify < 0 ? -1 : 0;
+}
+
+int CatalogFd() { return Notify; }
+
+// A video folder was renamed or removed, or one appeared
+static void TopEvent(struct inotify_event *ev)
+{
+ int i;
+
+ if(ev->mask & IN_MOVED_FROM)
+ {
+  // Keep it until the matching IN_MOVED_TO turns up
+  if((i = Find(ev->name)) >= 0) Entries[i]->Cookie = ev->cookie;
+ }
+ else if(ev->mask & IN_MOVED_TO)
+ {
+  for(i=0; i<Count; i++) if(Entries[i]->Cookie == ev->cookie && ev->cookie) break;
+  if(i < Count)
+  {
+   if(Find(ev->name) >= 0) Drop(Find(ev->name)); // Renamed over another
+   for(i=0; i<Count; i++) if(Entries[i]->Cookie == ev->cookie) break;
+   snprintf(Entries[i]->V.Name, sizeof(Entries[i]->V.Name), "%s", ev->name);
+   Entries[i]->Cookie = 0;
+   Sort(i);
+  }
+  else Add(ev->name);
+ }
+ else if(ev->mask & IN_CREATE) Add(ev->name);
+ else if((ev->mask & IN_DELETE) && (i = Find(ev->name)) >= 0) Drop(i);
+}
+
+void CatalogUpdate()
+{
+ char Buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+ struct inotify_event *ev;
+ ssize_t n, i;
+ int k, Again = 0;
+
+ if(Notify < 0) return;
+ while((n = read(Notify, Buf, sizeof(Buf))) > 0)
+  for(i=0; i<n; i+=sizeof(*ev) + ev->len)
+  {
+   ev = (struct inotify_event *)(Buf + i);
+   if(ev->mask & IN_Q_OVERFLOW) Again = 1;
+   else if(ev->wd == TopWd && (ev->mask & IN_ISDIR)) TopEvent(ev);
+   else if(ev->len && (IsFrame(ev->name) || strcmp(ev->name, GEN_FILE) == 0 ||
+           strcmp(ev->name, ANIM_FILE) == 0) && (k = FindWd(ev->wd)) >= 0)
+   {
+    Entries[k]->Dirty = 1;
+    if(strcmp(ev->name, "Frame00000.jpg") == 0 || strcmp(ev->name, ANIM_FILE) == 0) Entries[k]->ThumbDirty = 1;
+   }
+  }
+ // Folders moved out and not back in are gone
+ for(k=Count-1; k>=0; k--) if(Entries[k]->Cookie) Drop(k);
+ if(Again) Build();
+ for(k=0; k<Count; k++) if(Entries[k]->Dirty || Entries[k]->ThumbDirty) Rescan(Entries[k]);
+}
+
+int CatalogCount()
+{
+ CatalogUpdate();
+ return Count;
+}
+
+struct SavedVideo *CatalogGet(int Index)
+{
+ CatalogUpdate();
+ return Index >= 0 && Index < Count ? &Entries[Index]->V : NULL;
+}
+
+struct SavedVideo *CatalogFind(char *Name)
+{
+ int i;
+
+ CatalogUpdate();
+ return (i = Find(Name)) >= 0 ? &Entries[i]->V : NULL;
+}
+
+void CatalogClose()
+{
+ while(Count) Drop(Count - 1);
+ if(Notify >= 0) close(Notify);
+ Notify = TopWd = -1;
+}
@@ -0,0 +1,50 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Saved video catalog
+//
+// Keeps what is known about the saved videos (the folders in Saved)
+// in memory: the number of frames, their total size, when the video
+// was last changed and a small thumbnail of its first frame. The
+// catalog is built once when it is opened, reading each folder with
+// getdents64(), and after that is kept up to date from inotify events
+// instead of reading the disk again, so asking how many videos there
+// are or which one is newest costs nothing.
+//
+// The inotify descriptor can be added to the program's poll loop so
+// changes are picked up as they happen. CatalogCount() and friends
+// also pick up anything still pending, which is a single read() that
+// normally finds nothing.
+//
+///////////////////////////////////////////////////////////////////////
+
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <time.h>
+#include "frame.h"
+
+#define CATALOG_MAX 128  // Saved videos tracked
+#define THUMB_WIDE  240  // Thumbnail size, 1/8 of the screen
+#define THUMB_HIGH  135
+
+struct SavedVideo
+{
+ char Name[64];      // Folder name within the saved video folder
+ int Frames;         // Number of Frame*.jpg files, or frames in its ANIM_FILE
+ long long Bytes;    // Their total size
+ time_t Time;        // Newest frame time
+ long Gen;           // Number in the folder's Gen file, 0 if none
+ struct Frame Thumb; // First frame, Thumb.Wide is 0 if there is none
+};
+
+int  CatalogOpen(char *Dir);
+// inotify descriptor to wait on, call CatalogUpdate() when readable
+int  CatalogFd();
+void CatalogUpdate();
+int  CatalogCount();
+// Videos in name order, NULL if out of range
+struct SavedVideo *CatalogGet(int Index);
+struct SavedVideo *CatalogFind(char *Name);
+void CatalogClose();
+
+#endif
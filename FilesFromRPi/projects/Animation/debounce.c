@@ -0,0 +1,153 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Button debouncing. See debounce.h
+//
+///////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+
+#include "debounce.h"
+
+#define MAX_BUTTONS 32
+#define QUEUE_SIZE  64
+
+#define NEVER 0xffffffffffffffffull
+
+struct Button
+{
+ struct ButtonConfig C;
+ int Stable;         // Level last reported
+ int Raw;            // Level of the last edge seen
+ uint64_t LockUntil; // End of the bounce window
+ uint64_t HoldAt;    // When the next HOLD or REPEAT is due
+ int Held;           // HOLD has been sent for this press
+};
+
+static struct Button Btn[MAX_BUTTONS];
+static int NumBtn = 0;
+
+static struct ButtonEvent Queue[QUEUE_SIZE];
+static int QHead = 0, QTail = 0;
+
+static void Emit(struct Button *B, int Type, uint64_t TimeUs)
+{
+ struct ButtonEvent *E = &Queue[QTail];
+
+ E->Pin = B->C.Pin;
+ E->Type = Type;
+ E->TimeUs = TimeUs;
+ QTail = (QTail + 1) % QUEUE_SIZE;
+ if(QTail == QHead) QHead = (QHead + 1) % QUEUE_SIZE;
+}
+
+int DebounceGet(struct ButtonEvent *E)
+{
+ if(QHead == QTail) return 0;
+ *E = Queue[QHead];
+ QHead = (QHead + 1) % QUEUE_SIZE;
+ return 1;
+}
+
+char *DebounceName(int Type)
+{
+ static char *Names[] = { "Press", "Release", "Hold", "Repeat" };
+
+ return Type >= 0 && Type <= BTN_REPEAT ? Names[Type] : "?";
+}
+
+int DebounceInit(struct ButtonConfig *Config, int N)
+{
+ int i;
+
+ if(N > MAX_BUTTONS) N = MAX_BUTTONS;
+ memset(Btn, 0, sizeof(Btn));
+ for(i=0; i<N; i++)
+ {
+  Btn[i].C = Config[i];
+  Btn[i].HoldAt = NEVER;
+ }
+ NumBtn = N;
+ QHead = QTail = 0;
+ return 0;
+}
+
+// Report a new stable level and open a bounce window
+static void Change(struct Button *B, int Level, uint64_t TimeUs)
+{
+ B->Stable = Level;
+ B->LockUntil = TimeUs + B->C.DebounceUs;
+ B->Held = 0;
+ B->HoldAt = (Level && B->C.HoldUs) ? TimeUs + B->C.HoldUs : NEVER;
+ Emit(B, Level ? BTN_PRESS : BTN_RELEASE, TimeUs);
+}
+
+// Time of the next thing due on a button, NEVER if nothing is pending
+static uint64_t Due(struct Button *B)
+{
+ // The line settled at the other level during the bounce window
+ uint64_t Settle = (B->Raw != B->Stable) ? B->LockUntil : NEVER;
+
+ return Settle < B->HoldAt ? Settle : B->HoldAt;
+}
+
+// Run the one thing due on a button
+static void Step(struct Button *B)
+{
+ if(B->Raw != B->Stable && B->LockUntil <= B->HoldAt) Change(B, B->Raw, B->LockUntil);
+ else
+ {
+  Emit(B, B->Held ? BTN_REPEAT : BTN_HOLD, B->HoldAt);
+  B->Held = 1;
+  B->HoldAt = B->C.RepeatUs ? B->HoldAt + B->C.RepeatUs : NEVER;
+ }
+}
+
+static struct Button *Find(int Pin)
+{
+ int i;
+
+ for(i=0; i<NumBtn; i++) if(Btn[i].C.Pin == Pin) return &Btn[i];
+ return NULL;
+}
+
+void DebounceFeed(int Pin, int Level, uint64_t TimeUs)
+{
+ struct Button *B = Find(Pin);
+
+ if(B == NULL) return;
+ DebounceTick(TimeUs);
+ B->Raw = Level;
+ // Inside the bounce window the edge only updates Raw
+ if(TimeUs >= B->LockUntil && Level != B->Stable) Change(B, Level, TimeUs);
+}
+
+// Run everything due up to NowUs, earliest first across all buttons,
+// so the queue stays in time order.
+void DebounceTick(uint64_t NowUs)
+{
+ struct Button *First;
+ uint64_t t;
+ int i;
+
+ for(;;)
+ {
+  First = NULL;
+  for(i=0; i<NumBtn; i++)
+   if((t = Due(&Btn[i])) <= NowUs && (First == NULL || t < Due(First))) First = &Btn[i];
+  if(First == NULL) return;
+  Step(First);
+ }
+}
+
+int DebounceWaitMs(uint64_t NowUs, int IdleMs)
+{
+ uint64_t Next = NEVER, t;
+ int i;
+
+ for(i=0; i<NumBtn; i++) if((t = Due(&Btn[i])) < Next) Next = t;
+ if(Next == NEVER) return IdleMs;
+ if(Next <= NowUs) return 0;
+ t = (Next - NowUs + 999) / 1000;
+ return (IdleMs >= 0 && t > (uint64_t)IdleMs) ? IdleMs : (int)t;
+}
@@ -0,0 +1,58 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Button debouncing
+//
+// Raw edges (with their kernel time stamps in microseconds) are fed in
+// and clean button events come out of a queue: PRESS, RELEASE, HOLD
+// once the button has been down for HoldUs, then REPEAT every RepeatUs
+// while it stays down.
+//
+// A change is reported on the first edge, so a press costs no added
+// latency. Edges for the next DebounceUs are treated as bounce. If the
+// line has settled at the other level when that window closes, that
+// change is reported then. Everything is driven by the time stamps
+// passed in, so replaying a recorded trace always gives the same
+// events.
+//
+///////////////////////////////////////////////////////////////////////
+
+#ifndef DEBOUNCE_H
+#define DEBOUNCE_H
+
+#include <stdint.h>
+
+#define BTN_PRESS   0
+#define BTN_RELEASE 1
+#define BTN_HOLD    2
+#define BTN_REPEAT  3
+
+// Timing for one button. A HoldUs of 0 disables hold and repeat, a
+// RepeatUs of 0 disables just the repeat.
+struct ButtonConfig
+{
+ int Pin;
+ uint32_t DebounceUs;
+ uint32_t HoldUs;
+ uint32_t RepeatUs;
+};
+
+struct ButtonEvent
+{
+ int Pin;
+ int Type;        // BTN_PRESS, BTN_RELEASE, BTN_HOLD or BTN_REPEAT
+ uint64_t TimeUs; // When the event happened, on the edge time scale
+};
+
+int  DebounceInit(struct ButtonConfig *Config, int N);
+// Feed one raw edge. Edges must be fed in time order.
+void DebounceFeed(int Pin, int Level, uint64_t TimeUs);
+// Bring the state machine up to NowUs with no new edges
+void DebounceTick(uint64_t NowUs);
+// Milliseconds until DebounceTick() has something to do, or IdleMs
+// if nothing is pending
+int  DebounceWaitMs(uint64_t NowUs, int IdleMs);
+// Take the next event from the queue. Returns 0 if it is empty.
+int  DebounceGet(struct ButtonEvent *E);
+char *DebounceName(int Type);
+
+#endif
@@ -0,0 +1,140 @@
+///////////////////////////////////////////////////////////////////////
+//
+// JPEG decoding for display. See decode.h
+//
+///////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <setjmp.h>
+#include <jpeglib.h>
+
+#include "decode.h"
+
+// libjpeg calls error_exit on a bad file, which normally exits the
+// program. Jump back out instead so one bad frame is just skipped.
+struct Error
+{
+ struct jpeg_error_mgr Mgr;
+ jmp_buf Back;
+};
+
+static void ErrorExit(j_common_ptr c)
+{
+ struct Error *e = (struct Error *)c->err;
+
+ (*c->err->output_message)(c);
+ longjmp(e->Back, 1);
+}
+
+// Decode from a source already set up on d
+static int Decode(struct jpeg_decompress_struct *d, struct Frame *Out, int MaxWide, int MaxHigh)
+{
+ JSAMPROW Row;
+ int m;
+
+ jpeg_read_header(d, TRUE);
+ // Pick the largest scale of m/8 that fits
+ for(m=8; m>1; m--)
+  if((int)(d->image_width * m + 7) / 8 <= MaxWide && (int)(d->image_height * m + 7) / 8 <= MaxHigh) break;
+ d->scale_num = m;
+ d->scale_denom = 8;
+ d->out_color_space = JCS_EXT_BGRX;
+ d->dct_method = JDCT_IFAST;
+ jpeg_start_decompress(d);
+ if((int)d->output_width > MaxWide || (int)d->output_height > MaxHigh)
+ {
+  jpeg_abort_decompress(d);
+  return -1;
+ }
+ Out->Wide = d->output_width;
+ Out->High = d->output_height;
+ Out->Stride = Out->Wide * 4;
+ Out->Format = FRAME_BGRX;
+ while(d->output_scanline < d->output_height)
+ {
+  Row = Out->Pixels + (size_t)d->output_scanline * Out->Stride;
+  jpeg_read_scanlines(d, &Row, 1);
+ }
+ jpeg_finish_decompress(d);
+ return 0;
+}
+
+int DecodeJpegFile(char *Path, struct Frame *Out, int MaxWide, int MaxHigh)
+{
+ struct jpeg_decompress_struct d;
+ struct Error e;
+ FILE *In;
+ volatile int r = -1; // Kept across the longjmp()
+
+ if((In = fopen(Path, "rb")) == NULL)
+ {
+  perror(Path);
+  return -1;
+ }
+ d.err = jpeg_std_error(&e.Mgr);
+ e.Mgr.error_exit = ErrorExit;
+ jpeg_create_decompress(&d);
+ if(setjmp(e.Back) == 0)
+ {
+  jpeg_stdio_src(&d, In);
+  r = Decode(&d, Out, MaxWide, MaxHigh);
+ }
+ jpeg_destroy_decompress(&d);
+ fclose(In);
+ return r;
+}
+
+int DecodeJpegMem(unsigned char *Data, size_t Len, struct Frame *Out, int MaxWide, int MaxHigh)
+{
+ struct jpeg_decompress_struct d;
+ struct Error e;
+ volatile int r = -1; // Kept across the longjmp()
+
+ d.err = jpeg_std_error(&e.Mgr);
+ e.Mgr.error_exit = ErrorExit;
+ jpeg_create_decompress(&d);
+ if(setjmp(e.Back) == 0)
+ {
+  jpeg_mem_src(&d, Data, Len);
+  r = Decode(&d, Out, MaxWide, MaxHigh);
+ }
+ jpeg_destroy_decompress(&d);
+ return r;
+}
+
+static inline unsigned char Clamp(int v)
+{
+ return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+// YUYV to BGRX, skipping pixels to shrink by a whole factor. The
+// colours use the JPEG (full range) YCbCr the encoder writes, so a
+// frame looks the same before and after it is encoded.
+int DecodeYuyv(struct Frame *In, struct Frame *Out, int MaxWide, int MaxHigh)
+{
+ unsigned char *s, *d;
+ int Step = 1, x, y, Y, Cb, Cr;
+
+ if(In->Format != FRAME_YUYV) return -1;
+ while(In->Wide / Step > MaxWide || In->High / Step > MaxHigh) Step++;
+ Out->Wide = In->Wide / Step;
+ Out->High = In->High / Step;
+ Out->Stride = Out->Wide * 4;
+ Out->Format = FRAME_BGRX;
+ for(y=0; y<Out->High; y++)
+ {
+  s = In->Pixels + (size_t)y * Step * In->Stride;
+  d = Out->Pixels + (size_t)y * Out->Stride;
+  for(x=0; x<Out->Wide; x++, d+=4)
+  {
+   Y = s[x * Step * 2];
+   Cb = s[((x * Step) & ~1) * 2 + 1] - 128;
+   Cr = s[((x * Step) & ~1) * 2 + 3] - 128;
+   d[0] = Clamp(Y + ((116130 * Cb) >> 16));
+   d[1] = Clamp(Y - ((22554 * Cb + 46802 * Cr) >> 16));
+   d[2] = Clamp(Y + ((91881 * Cr) >> 16));
+   d[3] = 255;
+  }
+ }
+ return 0;
+}
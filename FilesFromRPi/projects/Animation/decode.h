@@ -0,0 +1,28 @@
+///////////////////////////////////////////////////////////////////////
+//
+// JPEG decoding for display
+//
+// Frames are decoded with libjpeg(-turbo) straight to BGRX. A frame
+// larger than the wanted size is shrunk during decoding using the
+// decoder's own DCT scaling (in steps of 1/8), which is much cheaper
+// than decoding at full size and scaling afterwards. Raw YUYV frames
+// straight from the camera are converted the same way, for frames not
+// yet encoded and for the live preview.
+//
+///////////////////////////////////////////////////////////////////////
+
+#ifndef DECODE_H
+#define DECODE_H
+
+#include <stddef.h>
+#include "frame.h"
+
+// Decode into Out->Pixels, which must hold MaxWide*MaxHigh*4 bytes.
+// Out->Wide and Out->High are set to the decoded size.
+int DecodeJpegFile(char *Path, struct Frame *Out, int MaxWide, int MaxHigh);
+int DecodeJpegMem(unsigned char *Data, size_t Len, struct Frame *Out, int MaxWide, int MaxHigh);
+// Convert a YUYV frame from the camera, shrinking it by a whole factor
+// to fit
+int DecodeYuyv(struct Frame *In, struct Frame *Out, int MaxWide, int MaxHigh);
+
+#endif
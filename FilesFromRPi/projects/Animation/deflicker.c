@@ -0,0 +1,333 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Deflicker. See deflicker.h
+//
+///////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <setjmp.h>
+#include <pthread.h>
+#include <jpeglib.h>
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "deflicker.h"
+#include "encode.h"
+
+#define HIST_SCALE 4    // Histograms are taken from a 1/HIST_SCALE decode
+#define MAX_WORKERS 8
+
+struct Job
+{
+ char Path[280];
+ unsigned Hist[256];
+ unsigned char Lut[256];
+ int Ok;
+};
+
+static struct Job *Jobs;
+static int NumJobs, Next;
+static pthread_mutex_t Lock = PTHREAD_MUTEX_INITIALIZER;
+static struct DeflickerStats Stats;
+
+// libjpeg calls error_exit on a bad file, which normally exits the
+// program. Jump back out instead so one bad frame is just skipped.
+struct Error
+{
+ struct jpeg_error_mgr Mgr;
+ jmp_buf Back;
+};
+
+static void ErrorExit(j_common_ptr c)
+{
+ struct Error *e = (struct Error *)c->err;
+
+ (*c->err->output_message)(c);
+ longjmp(e->Back, 1);
+}
+
+static double Ms()
+{
+ struct timespec t;
+
+ clock_gettime(CLOCK_MONOTONIC, &t);
+ return t.tv_sec * 1000.0 + t.tv_nsec / 1e6;
+}
+
+// Convert a row of 3 byte Y Cb Cr from the decoder to YUYV for the
+// encoder, putting the luma through Lut on the way
+static void MapRowScalar(unsigned char *Out, const unsigned char *In, int Wide, const unsigned char *Lut)
+{
+ int x;
+
+ for(x=0; x+1<Wide; x+=2, In+=6, Out+=4)
+ {
+  Out[0] = Lut[In[0]]; Out[1] = In[1];
+  Out[2] = Lut[In[3]]; Out[3] = In[2];
+ }
+}
+
+#if defined(__aarch64__)
+// The same 16 pixels at a time. TBL looks up 64 table entries at once,
+// and gives 0 for an index past them, so the four quarters of the
+// table are looked up in turn and ORed together.
+static void MapRowNeon(unsigned char *Out, const unsigned char *In, int Wide, const unsigned char *Lut)
+{
+ uint8x16x4_t T0 = vld1q_u8_x4(Lut), T1 = vld1q_u8_x4(Lut + 64);
+ uint8x16x4_t T2 = vld1q_u8_x4(Lut + 128), T3 = vld1q_u8_x4(Lut + 192);
+ uint8x16_t q = vdupq_n_u8(64), y;
+ uint8x16x3_t p;
+ uint8x16x2_t o;
+ int x;
+
+ for(x=0; x+16<=Wide; x+=16)
+ {
+  p = vld3q_u8(In + x * 3);
+  y = p.val[0];
+  o.val[0] = vqtbl4q_u8(T0, y);
+  o.val[0] = vorrq_u8(o.val[0], vqtbl4q_u8(T1, y = vsubq_u8(y, q)));
+  o.val[0] = vorrq_u8(o.val[0], vqtbl4q_u8(T2, y = vsubq_u8(y, q)));
+  o.val[0] = vorrq_u8(o.val[0], vqtbl4q_u8(T3, vsubq_u8(y, q)));
+  // Cb and Cr of the even pixels, in turn
+  o.val[1] = vtrn1q_u8(p.val[1], p.val[2]);
+  vst2q_u8(Out + x * 2, o);
+ }
+ MapRowScalar(Out + x * 2, In + x * 3, Wide - x, Lut);
+}
+#define MapRow MapRowNeon
+#else
+#define MapRow MapRowScalar
+#endif
+
+// Open Path for decoding and read its header. d->err must be set up.
+static FILE *Start(struct jpeg_decompress_struct *d, char *Path)
+{
+ FILE *In;
+
+ if((In = fopen(Path, "rb")) == NULL)
+ {
+  perror(Path);
+  return NULL;
+ }
+ jpeg_stdio_src(d, In);
+ jpeg_read_header(d, TRUE);
+ d->dct_method = JDCT_IFAST;
+ return In;
+}
+
+// First pass: the luma histogram of a frame, from a small decode.
+// What is set after setjmp() and used after a jump back is volatile.
+static void Histogram(struct Job *J)
+{
+ struct jpeg_decompress_struct d;
+ struct Error e;
+ unsigned char *volatile Line = NULL;
+ FILE *volatile In = NULL;
+ JSAMPROW Row;
+ unsigned x;
+
+ d.err = jpeg_std_error(&e.Mgr);
+ e.Mgr.error_exit = ErrorExit;
+ jpeg_create_decompress(&d);
+ if(setjmp(e.Back) == 0 && (In = Start(&d, J->Path)) != NULL)
+ {
+  d.out_color_space = JCS_GRAYSCALE;
+  d.scale_num = 1;
+  d.scale_denom = HIST_SCALE;
+  jpeg_start_decompress(&d);
+  if((Line = malloc(d.output_width)) != NULL)
+  {
+   while(d.output_scanline < d.output_height)
+   {
+    Row = Line;
+    jpeg_read_scanlines(&d, &Row, 1);
+    for(x=0; x<d.output_width; x++) J->Hist[Line[x]]++;
+   }
+   jpeg_finish_decompress(&d);
+   J->Ok = 1;
+  }
+ }
+ jpeg_destroy_decompress(&d);
+ if(In) fclose(In);
+ free(Line);
+}
+
+// Second pass: decode the frame in full, map its luma and encode it
+static void Apply(struct Job *J)
+{
+ struct jpeg_decompress_struct d;
+ struct Error e;
+ struct Frame F;
+ unsigned char *volatile Line = NULL, *volatile Pixels = NULL;
+ FILE *volatile In = NULL;
+ JSAMPROW Row;
+ volatile int r = -1;
+
+ d.err = jpeg_std_error(&e.Mgr);
+ e.Mgr.error_exit = ErrorExit;
+ jpeg_create_decompress(&d);
+ if(setjmp(e.Back) == 0 && (In = Start(&d, J->Path)) != NULL)
+ {
+  d.out_color_space = JCS_YCbCr;
+  jpeg_start_decompress(&d);
+  F.Wide = d.output_width & ~1;
+  F.High = d.output_height;
+  F.Stride = F.Wide * 2;
+  F.Format = FRAME_YUYV;
+  if((Line = malloc((size_t)d.output_width * 3)) != NULL &&
+     (F.Pixels = Pixels = malloc((size_t)F.Stride * F.High)) != NULL)
+  {
+   while(d.output_scanline < d.output_height)
+   {
+    Row = Line;
+    jpeg_read_scanlines(&d, &Row, 1);
+    MapRow(F.Pixels + (size_t)(d.output_scanline - 1) * F.Stride, Line, F.Wide, J->Lut);
+   }
+   jpeg_finish_decompress(&d);
+   r = 0;
+  }
+ }
+ jpeg_destroy_decompress(&d);
+ if(In) fclose(In);
+ // EncodeJpeg() fails the frame on a libjpeg error rather than exit,
+ // and leaves the old file in place
+ if(r == 0 && EncodeJpeg(&F, J->Path, JPEG_QUALITY) < 0) r = -1;
+ J->Ok = r == 0;
+ free(Line);
+ free(Pixels);
+}
+
+static void *Worker(void *Arg)
+{
+ void (*Pass)(struct Job *) = (void (*)(struct Job *))Arg;
+ int i;
+
+ for(;;)
+ {
+  pthread_mutex_lock(&Lock);
+  i = Next++;
+  pthread_mutex_unlock(&Lock);
+  if(i >= NumJobs) break;
+  if(Jobs[i].Ok) Pass(&Jobs[i]);
+ }
+ return NULL;
+}
+
+// Run a pass over every frame still Ok
+static double Run(void (*Pass)(struct Job *), int Workers)
+{
+ pthread_t Threads[MAX_WORKERS];
+ double t = Ms();
+ int i, n = 0;
+
+ Next = 0;
+ for(i=0; i<Workers; i++)
+  if(pthread_create(&Threads[n], NULL, Worker, (void *)Pass) == 0) n++;
+ if(n == 0) Worker((void *)Pass);
+ for(i=0; i<n; i++) pthread_join(Threads[i], NULL);
+ return Ms() - t;
+}
+
+// Fraction of the pixels at or below each level
+static void Cdf(unsigned *Hist, double *Out)
+{
+ double Sum = 0, Total = 0;
+ int v;
+
+ for(v=0; v<256; v++) Total += Hist[v];
+ for(v=0; v<256; v++)
+ {
+  Sum += Hist[v];
+  Out[v] = Total > 0 ? Sum / Total : 1;
+ }
+}
+
+// Match frame i's histogram to the average of its neighbours'. The
+// table takes each level to the level with the same share of pixels
+// below it in the average, which keeps it in order.
+static void MakeLut(int i, int Radius, double (*Cdfs)[256])
+{
+ double Target[256];
+ int j, k, n = 0, u, v;
+
+ memset(Target, 0, sizeof(Target));
+ for(j=i-Radius; j<=i+Radius; j++)
+  if(j >= 0 && j < NumJobs && Jobs[j].Ok)
+  {
+   for(v=0; v<256; v++) Target[v] += Cdfs[j][v];
+   n++;
+  }
+ for(v=0; v<256; v++) Target[v] /= n;
+ for(v=0, u=0; v<256; v++)
+ {
+  while(u < 255 && Target[u] < Cdfs[i][v] - 1e-9) u++;
+  Jobs[i].Lut[v] = u;
+  k = u > v ? u - v : v - u;
+  if(Jobs[i].Hist[v] && k > Stats.MaxShift) Stats.MaxShift = k;
+ }
+}
+
+static int IsFrame(const struct dirent *e)
+{
+ size_t n = strlen(e->d_name);
+
+ return strncmp(e->d_name, "Frame", 5) == 0 && n > 9 && strcmp(e->d_name + n - 4, ".jpg") == 0;
+}
+
+int DeflickerDir(char *Dir, int Radius, int Workers)
+{
+ struct dirent **List;
+ double (*Cdfs)[256];
+ int i, N;
+
+ memset(&Stats, 0, sizeof(Stats));
+ if(Workers <= 0) Workers = sysconf(_SC_NPROCESSORS_ONLN);
+ if(Workers < 1) Workers = 1;
+ if(Workers > MAX_WORKERS) Workers = MAX_WORKERS;
+ if((N = scandir(Dir, &List, IsFrame, alphasort)) < 0)
+ {
+  perror(Dir);
+  return -1;
+ }
+ Jobs = calloc(N ? N : 1, sizeof(*Jobs));
+ Cdfs = calloc(N ? N : 1, sizeof(*Cdfs));
+ for(i=0; i<N; i++)
+ {
+  if(Jobs) snprintf(Jobs[i].Path, sizeof(Jobs[i].Path), "%s/%s", Dir, List[i]->d_name);
+  if(Jobs) Jobs[i].Ok = 1;
+  free(List[i]);
+ }
+ free(List);
+ if(Jobs == NULL || Cdfs == NULL)
+ {
+  free(Jobs);
+  free(Cdfs);
+  return -1;
+ }
+ NumJobs = N;
+
+ Stats.HistMs = Run(Histogram, Workers);
+ for(i=0; i<N; i++) if(Jobs[i].Ok) Cdf(Jobs[i].Hist, Cdfs[i]);
+ for(i=0; i<N; i++) if(Jobs[i].Ok) MakeLut(i, Radius, Cdfs);
+ Stats.ApplyMs = Run(Apply, Workers);
+ for(i=0; i<N; i++)
+  if(Jobs[i].Ok) Stats.Frames++;
+  else Stats.Failed++;
+
+ free(Jobs);
+ free(Cdfs);
+ Jobs = NULL;
+ return Stats.Frames;
+}
+
+void DeflickerGetStats(struct DeflickerStats *S)
+{
+ *S = Stats;
+}
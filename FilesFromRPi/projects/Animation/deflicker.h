@@ -0,0 +1,48 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Deflicker
+//
+// The room lights and the camera's automatic exposure drift a little
+// from one frame to the next. Nobody notices in a single frame, but a
+// finished animation played at PLAY_FPS flickers with it.
+//
+// Deflickering works on a folder of FrameNNNNN.jpg files in order. The
+// brightness histogram of every frame is taken first, from a small
+// decode of its luma alone. Each frame's histogram is then matched to
+// the average of its neighbours' within Radius frames either side,
+// which gives a tone curve (a 256 entry table) that takes out the
+// frame to frame wobble but follows slow changes in the scene. Last,
+// each frame is decoded again, its luma put through its table and the
+// frame encoded again. Colour is left alone.
+//
+// Both passes run on all the cores, one frame per core at a time. The
+// table lookup is done 16 pixels at a time with NEON on a 64 bit Pi.
+//
+// Frames are written under a new name and renamed into place, so a
+// frame that was a link to another file (from the frame store or a
+// snapshot) gets a file of its own and the original is left as it was.
+//
+///////////////////////////////////////////////////////////////////////
+
+#ifndef DEFLICKER_H
+#define DEFLICKER_H
+
+#define DEFLICKER_RADIUS 4 // Neighbours either side a frame is matched to
+
+struct DeflickerStats
+{
+ int Frames;      // Frames written
+ int Failed;      // Frames that could not be read or written
+ int MaxShift;    // Largest change any table made to a level
+ double HistMs;   // Time taken by the histogram pass
+ double ApplyMs;  // and the pass applying the tables
+};
+
+// Deflicker the frames in Dir with Workers threads, 0 for one per
+// core. Returns the number of frames written or -1. A frame that
+// cannot be read or written (a corrupt file, a full card) is left as
+// it was and counted in Failed; the rest are still done.
+int  DeflickerDir(char *Dir, int Radius, int Workers);
+void DeflickerGetStats(struct DeflickerStats *S);
+
+#endif
@@ -0,0 +1,692 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Display outputs. See display.h
+//
+///////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <linux/fb.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+// The DRM backend needs libdrm's headers, which pkg-config adds
+#if defined(__has_include)
+#if __has_include(<xf86drmMode.h>)
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+#define HAVE_DRM 1
+#endif
+#endif
+
+#include "display.h"
+
+#define FLIP_WAIT_MS 100 // Give up on a page flip event after this
+
+void DisplayHide(struct Display *D)
+{
+ if(D != NULL && D->Hide) D->Hide(D);
+}
+
+void DisplayClose(struct Display *D)
+{
+ if(D == NULL) return;
+ if(D->Close) D->Close(D);
+ free(D);
+}
+
+static struct Display *New(int Wide, int High)
+{
+ struct Display *D = calloc(1, sizeof(*D));
+
+ if(D == NULL) return NULL;
+ D->Wide = Wide;
+ D->High = High;
+ return D;
+}
+
+// Copy a frame centred into a 32 bit buffer of Wide x High. The rest
+// is cleared when the frame size differs from the last one drawn
+// there, as the last frame could show around it.
+static void Blit(unsigned char *Buf, int Pitch, int Wide, int High, struct Frame *F, int *Last)
+{
+ int w = F->Wide < Wide ? F->Wide : Wide, h = F->High < High ? F->High : High;
+ int r;
+
+ if(Last[0] != w || Last[1] != h)
+ {
+  memset(Buf, 0, (size_t)Pitch * High);
+  Last[0] = w;
+  Last[1] = h;
+ }
+ Buf += (size_t)((High - h) / 2) * Pitch + (Wide - w) / 2 * 4;
+ for(r=0; r<h; r++) memcpy(Buf + (size_t)r * Pitch, F->Pixels + (size_t)r * F->Stride, w * 4);
+}
+
+////////////////////////////////////////////////////////////////////////
+//
+// X11 window
+//
+////////////////////////////////////////////////////////////////////////
+
+struct X11
+{
+ Display *Dpy;
+ Window Win;
+ GC Gc;
+ Visual *Vis;
+ int Mapped;
+};
+
+static int X11Show(struct Display *D, struct Frame *F)
+{
+ struct X11 *x = D->Ctx;
+ XImage *Img;
+
+ Img = XCreateImage(x->Dpy, x->Vis, 24, ZPixmap, 0, (char *)F->Pixels, F->Wide, F->High, 32, F->Stride);
+ if(Img == NULL) return -1;
+ if(!x->Mapped)
+ {
+  XMapRaised(x->Dpy, x->Win);
+  x->Mapped = 1;
+ }
+ XPutImage(x->Dpy, x->Win, x->Gc, Img, 0, 0, (D->Wide - F->Wide) / 2, (D->High - F->High) / 2, F->Wide, F->High);
+ // Wait for the server so the frame is really up when Show() returns
+ XSync(x->Dpy, False);
+ Img->data = NULL; // The pixels belong to the frame
+ XDestroyImage(Img);
+ D->Shown++;
+ return 0;
+}
+
+static void X11Hide(struct Display *D)
+{
+ struct X11 *x = D->Ctx;
+
+ if(!x->Mapped) return;
+ XUnmapWindow(x->Dpy, x->Win);
+ XSync(x->Dpy, False);
+ x->Mapped = 0;
+}
+
+static void X11Close(struct Display *D)
+{
+ struct X11 *x = D->Ctx;
+
+ XFreeGC(x->Dpy, x->Gc);
+ XDestroyWindow(x->Dpy, x->Win);
+ XCloseDisplay(x->Dpy);
+ free(x);
+}
+
+struct Display *DisplayOpenX11(int Wide, int High)
+{
+ struct Display *D;
+ struct X11 *x;
+ XSetWindowAttributes a;
+ XColor Black;
+ Pixmap Blank;
+ Cursor Hidden;
+ char Bits[8] = { 0 };
+ int Scr;
+
+ if((x = calloc(1, sizeof(*x))) == NULL) return NULL;
+ if((x->Dpy = XOpenDisplay(NULL)) == NULL)
+ {
+  printf("No X display\n");
+  free(x);
+  return NULL;
+ }
+ Scr = DefaultScreen(x->Dpy);
+ x->Vis = DefaultVisual(x->Dpy, Scr);
+ if(DefaultDepth(x->Dpy, Scr) != 24)
+ {
+  printf("X display is not 24 bit\n");
+  XCloseDisplay(x->Dpy);
+  free(x);
+  return NULL;
+ }
+ if(Wide == 0) Wide = DisplayWidth(x->Dpy, Scr);
+ if(High == 0) High = DisplayHeight(x->Dpy, Scr);
+
+ // A borderless black window over everything, like feh -F
+ memset(&a, 0, sizeof(a));
+ a.override_redirect = True;
+ a.background_pixel = BlackPixel(x->Dpy, Scr);
+ x->Win = XCreateWindow(x->Dpy, RootWindow(x->Dpy, Scr), 0, 0, Wide, High, 0, CopyFromParent,
+                        InputOutput, CopyFromParent, CWOverrideRedirect | CWBackPixel, &a);
+ // Hide the pointer with an empty cursor, like feh --hide-pointer
+ memset(&Black, 0, sizeof(Black));
+ Blank = XCreateBitmapFromData(x->Dpy, x->Win, Bits, 8, 8);
+ Hidden = XCreatePixmapCursor(x->Dpy, Blank, Blank, &Black, &Black, 0, 0);
+ XDefineCursor(x->Dpy, x->Win, Hidden);
+ XFreePixmap(x->Dpy, Blank);
+ x->Gc = XCreateGC(x->Dpy, x->Win, 0, NULL);
+ XMapRaised(x->Dpy, x->Win);
+ XSync(x->Dpy, False);
+ x->Mapped = 1;
+
+ if((D = New(Wide, High)) == NULL)
+ {
+  XCloseDisplay(x->Dpy);
+  free(x);
+  return NULL;
+ }
+ D->Ctx = x;
+ D->Show = X11Show;
+ D->Hide = X11Hide;
+ D->Close = X11Close;
+ return D;
+}
+
+////////////////////////////////////////////////////////////////////////
+//
+// DRM/KMS
+//
+////////////////////////////////////////////////////////////////////////
+
+#ifdef HAVE_DRM
+
+// The card, shared by every output open on it
+static struct
+{
+ int Fd;
+ int Users;
+ uint32_t Crtc, Connector;
+ drmModeModeInfo Mode;
+ drmModeCrtc *Saved;       // What was on the screen, put back on hide
+ struct Display *OnScreen; // Output whose buffer is scanned out
+ char Path[64];
+} Card = { .Fd = -1 };
+
+struct Buffer
+{
+ uint32_t Handle, Fb, Pitch;
+ size_t Size;
+ unsigned char *Map;
+ int Last[2];  // Frame size last drawn into it
+};
+
+struct Drm
+{
+ struct Buffer Buf[2];
+ int Front;      // Buffer on the screen
+ int Flipping;   // A page flip event is still to come
+};
+
+static void FlipDone(int Fd, unsigned Seq, unsigned Sec, unsigned Usec, void *Arg)
+{
+ struct Drm *d = Arg;
+
+ (void)Fd; (void)Seq; (void)Sec; (void)Usec;
+ d->Flipping = 0;
+}
+
+// Wait for the page flip asked for to happen
+static int WaitFlip(struct Drm *d)
+{
+ drmEventContext Ev = { 0 };
+ struct pollfd p = { Card.Fd, POLLIN, 0 };
+
+ Ev.version = 2;
+ Ev.page_flip_handler = FlipDone;
+ while(d->Flipping)
+ {
+  if(poll(&p, 1, FLIP_WAIT_MS) <= 0)
+  {
+   printf("No page flip event\n");
+   d->Flipping = 0;
+   return -1;
+  }
+  drmHandleEvent(Card.Fd, &Ev);
+ }
+ return 0;
+}
+
+static int DrmShow(struct Display *D, struct Frame *F)
+{
+ struct Drm *d = D->Ctx;
+ struct Buffer *b = &d->Buf[!d->Front];
+
+ Blit(b->Map, b->Pitch, D->Wide, D->High, F, b->Last);
+ // Another output had the screen, or none yet: set the mode with this
+ // buffer. Otherwise flip to it at the next vertical blank.
+ if(Card.OnScreen != D)
+ {
+  if(drmModeSetCrtc(Card.Fd, Card.Crtc, b->Fb, 0, 0, &Card.Connector, 1, &Card.Mode) < 0)
+  {
+   perror("drmModeSetCrtc");
+   return -1;
+  }
+  Card.OnScreen = D;
+ }
+ else
+ {
+  if(drmModePageFlip(Card.Fd, Card.Crtc, b->Fb, DRM_MODE_PAGE_FLIP_EVENT, d) < 0)
+  {
+   perror("drmModePageFlip");
+   return -1;
+  }
+  d->Flipping = 1;
+  WaitFlip(d);
+ }
+ d->Front = !d->Front;
+ D->Shown++;
+ return 0;
+}
+
+static void FreeBuffer(struct Buffer *b)
+{
+ struct drm_mode_destroy_dumb Destroy = { 0 };
+
+ if(b->Map) munmap(b->Map, b->Size);
+ if(b->Fb) drmModeRmFB(Card.Fd, b->Fb);
+ if(b->Handle)
+ {
+  Destroy.handle = b->Handle;
+  drmIoctl(Card.Fd, DRM_IOCTL_MODE_DESTROY_DUMB, &Destroy);
+ }
+ memset(b, 0, sizeof(*b));
+}
+
+static int NewBuffer(struct Buffer *b, int Wide, int High)
+{
+ struct drm_mode_create_dumb Create = { 0 };
+ struct drm_mode_map_dumb Map = { 0 };
+
+ Create.width = Wide;
+ Create.height = High;
+ Create.bpp = 32;
+ if(drmIoctl(Card.Fd, DRM_IOCTL_MODE_CREATE_DUMB, &Create) < 0)
+ {
+  perror("DRM_IOCTL_MODE_CREATE_DUMB");
+  return -1;
+ }
+ b->Handle = Create.handle;
+ b->Pitch = Create.pitch;
+ b->Size = Create.size;
+ // XRGB8888 is BGRX in memory, the layout frames are decoded to
+ Map.handle = b->Handle;
+ if(drmModeAddFB(Card.Fd, Wide, High, 24, 32, b->Pitch, b->Handle, &b->Fb) < 0 ||
+    drmIoctl(Card.Fd, DRM_IOCTL_MODE_MAP_DUMB, &Map) < 0 ||
+    (b->Map = mmap(NULL, b->Size, PROT_READ | PROT_WRITE, MAP_SHARED, Card.Fd, Map.offset)) == MAP_FAILED)
+ {
+  perror("DRM dumb buffer");
+  b->Map = NULL;
+  FreeBuffer(b);
+  return -1;
+ }
+ memset(b->Map, 0, b->Size);
+ return 0;
+}
+
+// Give the screen back to what was on it before any output took it
+// over (the console, or nothing), so no buffer of ours is scanned out
+static void Restore()
+{
+ if(Card.Saved && Card.Saved->mode_valid && Card.Saved->buffer_id)
+  drmModeSetCrtc(Card.Fd, Card.Saved->crtc_id, Card.Saved->buffer_id, Card.Saved->x, Card.Saved->y,
+                 &Card.Connector, 1, &Card.Saved->mode);
+ else drmModeSetCrtc(Card.Fd, Card.Crtc, 0, 0, 0, NULL, 0, NULL);
+ Card.OnScreen = NULL;
+}
+
+// The screen was given back when the output on it was hidden or
+// closed, so there is nothing to put back here
+static void CardClose()
+{
+ if(--Card.Users > 0) return;
+ if(Card.Saved) drmModeFreeCrtc(Card.Saved);
+ close(Card.Fd);
+ Card.Fd = -1;
+ Card.Saved = NULL;
+ Card.OnScreen = NULL;
+}
+
+// Find a connected screen, a CRTC that can drive it and the mode to
+// use, and remember what was on it
+static int CardOpen(char *Path, int Wide, int High)
+{
+ drmModeRes *Res;
+ drmModeConnector *Con = NULL;
+ drmModeEncoder *Enc;
+ int i, j, m;
+
+ if(Card.Users > 0)
+ {
+  if(strcmp(Path, Card.Path) != 0) return -1;
+  Card.Users++;
+  return 0;
+ }
+ if((Card.Fd = open(Path, O_RDWR | O_CLOEXEC)) < 0) return -1;
+ snprintf(Card.Path, sizeof(Card.Path), "%s", Path);
+ if((Res = drmModeGetResources(Card.Fd)) == NULL)
+ {
+  close(Card.Fd);
+  Card.Fd = -1;
+  return -1;
+ }
+ for(i=0; i<Res->count_connectors; i++)
+ {
+  if((Con = drmModeGetConnector(Card.Fd, Res->connectors[i])) != NULL &&
+     Con->connection == DRM_MODE_CONNECTED && Con->count_modes > 0) break;
+  drmModeFreeConnector(Con);
+  Con = NULL;
+ }
+ Card.Crtc = 0;
+ if(Con)
+ {
+  // The size asked for if the screen has it, else its preferred mode
+  for(m=-1, i=0; i<Con->count_modes && m<0; i++)
+   if(Con->modes[i].hdisplay == Wide && Con->modes[i].vdisplay == High) m = i;
+  for(i=0; i<Con->count_modes && m<0; i++)
+   if(Con->modes[i].type & DRM_MODE_TYPE_PREFERRED) m = i;
+  if(m < 0) m = 0;
+  Card.Mode = Con->modes[m];
+  Card.Connector = Con->connector_id;
+  // A CRTC one of its encoders can use
+  for(i=0; i<Con->count_encoders && !Card.Crtc; i++)
+  {
+   if((Enc = drmModeGetEncoder(Card.Fd, Con->encoders[i])) == NULL) continue;
+   if(Enc->crtc_id) Card.Crtc = Enc->crtc_id;
+   for(j=0; j<Res->count_crtcs && !Card.Crtc; j++)
+    if(Enc->possible_crtcs & (1 << j)) Card.Crtc = Res->crtcs[j];
+   drmModeFreeEncoder(Enc);
+  }
+  drmModeFreeConnector(Con);
+ }
+ drmModeFreeResources(Res);
+ if(Card.Crtc == 0)
+ {
+  printf("%s has no screen connected\n", Path);
+  close(Card.Fd);
+  Card.Fd = -1;
+  return -1;
+ }
+ Card.Saved = drmModeGetCrtc(Card.Fd, Card.Crtc);
+ Card.Users = 1;
+ return 0;
+}
+
+// The next Show() sets the mode again with its own buffer
+static void DrmHide(struct Display *D)
+{
+ WaitFlip(D->Ctx);
+ if(Card.OnScreen == D) Restore();
+}
+
+static void DrmClose(struct Display *D)
+{
+ struct Drm *d = D->Ctx;
+
+ // Removing the framebuffer being scanned out would turn the screen
+ // off while other outputs still hold the card, so take it off first
+ DrmHide(D);
+ FreeBuffer(&d->Buf[0]);
+ FreeBuffer(&d->Buf[1]);
+ free(d);
+ CardClose();
+}
+
+struct Display *DisplayOpenDrm(char *Path, int Wide, int High)
+{
+ struct Display *D;
+ struct Drm *d;
+
+ if(CardOpen(Path, Wide, High) < 0) return NULL;
+ Wide = Card.Mode.hdisplay;
+ High = Card.Mode.vdisplay;
+ if((d = calloc(1, sizeof(*d))) == NULL || NewBuffer(&d->Buf[0], Wide, High) < 0 ||
+    NewBuffer(&d->Buf[1], Wide, High) < 0 || (D = New(Wide, High)) == NULL)
+ {
+  if(d)
+  {
+   FreeBuffer(&d->Buf[0]);
+   FreeBuffer(&d->Buf[1]);
+  }
+  free(d);
+  CardClose();
+  return NULL;
+ }
+ D->Ctx = d;
+ D->Show = DrmShow;
+ D->Hide = DrmHide;
+ D->Close = DrmClose;
+ return D;
+}
+
+#else
+
+struct Display *DisplayOpenDrm(char *Path, int Wide, int High)
+{
+ (void)Path; (void)Wide; (void)High;
+ return NULL;
+}
+
+#endif
+
+////////////////////////////////////////////////////////////////////////
+//
+// Frame buffer device
+//
+////////////////////////////////////////////////////////////////////////
+
+struct Fb
+{
+ int Fd;
+ unsigned char *Map;
+ size_t Size;
+ int Pitch, Bpp;
+ int Pages, Page;    // Pages in the virtual screen and the one showing
+ int Home;           // Page showing when opened, the console's
+ int Last[2][2];     // Frame size last drawn into each page
+ struct fb_var_screeninfo Var;
+ unsigned char *Shadow; // 32 bit copy of the frame, for 16 bit screens
+};
+
+// Copy a frame into a 16 bit (RGB565) page, by way of a 32 bit copy
+static void Blit16(struct Fb *f, unsigned char *Page, int Wide, int High, struct Frame *F)
+{
+ uint16_t *Out;
+ unsigned char *p;
+ int x, y;
+
+ Blit(f->Shadow, Wide * 4, Wide, High, F, f->Last[0]);
+ for(y=0, p=f->Shadow; y<High; y++)
+ {
+  Out = (uint16_t *)(Page + (size_t)y * f->Pitch);
+  for(x=0; x<Wide; x++, p+=4) Out[x] = (p[2] >> 3) << 11 | (p[1] >> 2) << 5 | p[0] >> 3;
+ }
+}
+
+static int FbShow(struct Display *D, struct Frame *F)
+{
+ struct Fb *f = D->Ctx;
+ unsigned char *Page;
+ int n = f->Pages > 1 ? !f->Page : 0;
+
+ Page = f->Map + (size_t)n * D->High * f->Pitch;
+ if(f->Bpp == 16) Blit16(f, Page, D->Wide, D->High, F);
+ else Blit(Page, f->Pitch, D->Wide, D->High, F, f->Last[n]);
+ if(f->Pages > 1)
+ {
+  // Pan to the page just drawn at the next vertical blank
+  f->Var.yoffset = n * D->High;
+  if(ioctl(f->Fd, FBIOPAN_DISPLAY, &f->Var) == 0) f->Page = n;
+ }
+ else
+ {
+  // Only one page, so the best that can be done is wait for the blank
+  n = 0;
+  ioctl(f->Fd, FBIO_WAITFORVSYNC, &n);
+ }
+ D->Shown++;
+ return 0;
+}
+
+// There is nothing else to show on a frame buffer, so clear the
+// console's page and pan back to it
+static void FbHide(struct Display *D)
+{
+ struct Fb *f = D->Ctx;
+ int n = f->Pages > 1 ? f->Home : 0;
+
+ memset(f->Map + (size_t)n * D->High * f->Pitch, 0, (size_t)D->High * f->Pitch);
+ f->Last[n][0] = f->Last[n][1] = 0;
+ if(f->Pages > 1 && f->Page != n)
+ {
+  f->Var.yoffset = n * D->High;
+  if(ioctl(f->Fd, FBIOPAN_DISPLAY, &f->Var) == 0) f->Page = n;
+ }
+}
+
+static void FbClose(struct Display *D)
+{
+ struct Fb *f = D->Ctx;
+
+ if(f->Pages > 1 && f->Page != f->Home)
+ {
+  f->Var.yoffset = f->Home * D->High;
+  ioctl(f->Fd, FBIOPAN_DISPLAY, &f->Var);
+ }
+ munmap(f->Map, f->Size);
+ close(f->Fd);
+ free(f->Shadow);
+ free(f);
+}
+
+struct Display *DisplayOpenFb(char *Dev, int Wide, int High)
+{
+ struct fb_fix_screeninfo Fix;
+ struct Display *D = NULL;
+ struct stat st;
+ struct Fb *f;
+
+ if((f = calloc(1, sizeof(*f))) == NULL) return NULL;
+ if((f->Fd = open(Dev, O_RDWR | O_CLOEXEC)) < 0)
+ {
+  free(f);
+  return NULL;
+ }
+ if(ioctl(f->Fd, FBIOGET_VSCREENINFO, &f->Var) == 0 && ioctl(f->Fd, FBIOGET_FSCREENINFO, &Fix) == 0)
+ {
+  Wide = f->Var.xres;
+  High = f->Var.yres;
+  f->Bpp = f->Var.bits_per_pixel;
+  f->Pitch = Fix.line_length;
+  f->Size = Fix.smem_len;
+  // Ask for a second page below the first to flip to
+  if(f->Var.yres_virtual < 2 * f->Var.yres)
+  {
+   f->Var.yres_virtual = 2 * f->Var.yres;
+   if(ioctl(f->Fd, FBIOPUT_VSCREENINFO, &f->Var) < 0 || ioctl(f->Fd, FBIOGET_FSCREENINFO, &Fix) < 0)
+    ioctl(f->Fd, FBIOGET_VSCREENINFO, &f->Var);
+   f->Size = Fix.smem_len;
+  }
+  f->Pages = f->Var.yres_virtual >= 2 * f->Var.yres && f->Size >= 2 * (size_t)f->Pitch * High ? 2 : 1;
+  f->Home = f->Page = f->Var.yoffset >= f->Var.yres;
+ }
+ else if(fstat(f->Fd, &st) == 0 && S_ISREG(st.st_mode) && Wide > 0 && High > 0)
+ {
+  // A file standing in for the device, one 32 bit page
+  f->Bpp = 32;
+  f->Pitch = Wide * 4;
+  f->Size = (size_t)f->Pitch * High;
+  f->Pages = 1;
+  if(ftruncate(f->Fd, f->Size) < 0) f->Bpp = 0;
+ }
+ if(f->Bpp != 32 && f->Bpp != 16)
+ {
+  printf("%s is not a 16 or 32 bit frame buffer\n", Dev);
+  close(f->Fd);
+  free(f);
+  return NULL;
+ }
+ if((f->Map = mmap(NULL, f->Size, PROT_READ | PROT_WRITE, MAP_SHARED, f->Fd, 0)) == MAP_FAILED ||
+    (f->Bpp == 16 && (f->Shadow = malloc((size_t)Wide * High * 4)) == NULL) || (D = New(Wide, High)) == NULL)
+ {
+  perror(Dev);
+  if(f->Map != MAP_FAILED) munmap(f->Map, f->Size);
+  free(f->Shadow);
+  close(f->Fd);
+  free(f);
+  return NULL;
+ }
+ D->Ctx = f;
+ D->Show = FbShow;
+ D->Hide = FbHide;
+ D->Close = FbClose;
+ return D;
+}
+
+////////////////////////////////////////////////////////////////////////
+//
+// Memory, for running without a screen
+//
+////////////////////////////////////////////////////////////////////////
+
+static int MemoryShow(struct Display *D, struct Frame *F)
+{
+ struct Frame *Last = D->Ctx;
+ int r;
+
+ Last->Wide = F->Wide < D->Wide ? F->Wide : D->Wide;
+ Last->High = F->High < D->High ? F->High : D->High;
+ Last->Format = F->Format;
+ for(r=0; r<Last->High; r++)
+  memcpy(Last->Pixels + (size_t)r * Last->Stride, F->Pixels + (size_t)r * F->Stride, Last->Wide * 4);
+ D->Shown++;
+ return 0;
+}
+
+static void MemoryClose(struct Display *D)
+{
+ struct Frame *Last = D->Ctx;
+
+ free(Last->Pixels);
+ free(Last);
+}
+
+struct Display *DisplayOpenMemory(int Wide, int High)
+{
+ struct Display *D;
+ struct Frame *Last;
+
+ if((Last = calloc(1, sizeof(*Last))) == NULL) return NULL;
+ Last->Stride = Wide * 4;
+ if((Last->Pixels = malloc((size_t)Last->Stride * High)) == NULL || (D = New(Wide, High)) == NULL)
+ {
+  free(Last->Pixels);
+  free(Last);
+  return NULL;
+ }
+ D->Ctx = Last;
+ D->Show = MemoryShow;
+ D->Close = MemoryClose;
+ return D;
+}
+
+struct Display *DisplayOpen(int Wide, int High)
+{
+ struct Display *D;
+ char s[32];
+ int i;
+
+ if(getenv("DISPLAY")) return DisplayOpenX11(Wide, High);
+ for(i=0; i<4; i++)
+ {
+  sprintf(s, "/dev/dri/card%d", i);
+  if((D = DisplayOpenDrm(s, Wide, High)) != NULL) return D;
+ }
+ if((D = DisplayOpenFb("/dev/fb0", Wide, High)) == NULL) printf("No display to draw on\n");
+ return D;
+}
@@ -0,0 +1,62 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Display outputs
+//
+// Anything that puts frames on the screen does it through a struct
+// Display, so the same player code can draw into a full screen X
+// window (a real screen or Xvfb) or into memory when run headless.
+// Frames handed to Show() are BGRX. A frame smaller than the display
+// is centred.
+//
+// Without X the HDMI output can be driven straight through DRM/KMS.
+// Each output gets two dumb buffers: a frame is drawn into the one
+// not on the screen, which is then flipped in at the next vertical
+// blank, so frames never tear and Show() returns once the frame is
+// really up. Outputs opened at the same time share the card and take
+// the screen over as they show frames. Hiding or closing the output
+// on the screen puts back whatever was there before the first one
+// took it, so a buffer is never removed while it is shown. The vkms
+// virtual driver is enough to run this with no screen at all. Where
+// there is no DRM device (or the program was built without libdrm)
+// the frame buffer device is used, panning between two pages if it
+// has room for them.
+// An existing regular file can stand in for the frame buffer device.
+//
+///////////////////////////////////////////////////////////////////////
+
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include "frame.h"
+
+struct Display
+{
+ int Wide, High;  // Size of the output
+ long Shown;      // Frames shown so far
+ int  (*Show)(struct Display *D, struct Frame *F);
+ void (*Hide)(struct Display *D);  // Take the output off the screen
+ void (*Close)(struct Display *D);
+ void *Ctx;       // Backend state
+};
+
+// Full screen window on $DISPLAY. Wide and High of 0 take the screen
+// size.
+struct Display *DisplayOpenX11(int Wide, int High);
+// DRM/KMS on a card such as /dev/dri/card0. The mode used is the one
+// Wide x High if the screen has it, otherwise its preferred mode.
+struct Display *DisplayOpenDrm(char *Card, int Wide, int High);
+// Frame buffer device such as /dev/fb0, at its current mode. Wide and
+// High are only used for a regular file.
+struct Display *DisplayOpenFb(char *Dev, int Wide, int High);
+// Keeps a copy of the last frame shown in Ctx (a struct Frame)
+struct Display *DisplayOpenMemory(int Wide, int High);
+// X11 if there is an X session, otherwise the first DRM card with a
+// screen connected, otherwise /dev/fb0
+struct Display *DisplayOpen(int Wide, int High);
+// Hide until the next Show(). An X window is unmapped, a DRM output
+// gives the screen back and a frame buffer is cleared. Memory outputs
+// have nothing to hide.
+void DisplayHide(struct Display *D);
+void DisplayClose(struct Display *D);
+
+#endif
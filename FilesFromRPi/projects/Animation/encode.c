@@ -0,0 +1,298 @@
+///////////////////////////////////////////////////////////////////////
+//
+// JPEG encoding of captured frames. See encode.h
+//
+///////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <setjmp.h>
+#include <pthread.h>
+#include <jpeglib.h>
+
+#include "encode.h"
+#include "framePool.h"
+
+#define MAX_SLOTS   32
+#define MAX_WORKERS 8
+
+// The frames of the slots are in the pool, which also keeps the free
+// ones. Slot i holds the path pool frame i is to be written to.
+static struct FramePool Pool;
+static char Paths[MAX_SLOTS][256];
+static int NumSlots = 0;
+static int Queue[MAX_SLOTS], QHead = 0, QLen = 0; // Slots to encode
+static int Busy = 0;                             // Slots being encoded
+
+static pthread_t Workers[MAX_WORKERS];
+static int NumWorkers = 0;
+static int Stopping = 0;
+static pthread_mutex_t Lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t SlotFree = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t Work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t Idle = PTHREAD_COND_INITIALIZER;
+static struct EncodeStats Stats;
+static double TotalMs = 0;
+static int (*Done)(char *Path) = NULL;
+static void (*OnStart)() = NULL;
+
+// Expand one row of YUYV to the 3 byte Y Cb Cr libjpeg takes
+static void YuyvRow(unsigned char *Out, unsigned char *In, int Wide)
+{
+ int x;
+
+ for(x=0; x<Wide; x+=2, In+=4, Out+=6)
+ {
+  Out[0] = In[0]; Out[1] = In[1]; Out[2] = In[3];
+  Out[3] = In[2]; Out[4] = In[1]; Out[5] = In[3];
+ }
+}
+
+// libjpeg calls error_exit when it cannot go on, a full disk for one,
+// which normally exits the program from whichever thread is encoding.
+// Jump back out instead so only this frame fails.
+struct Error
+{
+ struct jpeg_error_mgr Mgr;
+ jmp_buf Back;
+};
+
+static void ErrorExit(j_common_ptr c)
+{
+ struct Error *e = (struct Error *)c->err;
+
+ (*c->err->output_message)(c);
+ longjmp(e->Back, 1);
+}
+
+// Compress F to Out. Line holds one row of a YUYV frame expanded.
+static void Compress(struct jpeg_compress_struct *c, struct Frame *F, FILE *Out, int Quality, unsigned char *Line)
+{
+ JSAMPROW Row;
+
+ jpeg_stdio_dest(c, Out);
+ c->image_width = F->Wide;
+ c->image_height = F->High;
+ c->input_components = F->Format == FRAME_YUYV ? 3 : 4;
+ c->in_color_space = F->Format == FRAME_YUYV ? JCS_YCbCr : JCS_EXT_BGRX;
+ jpeg_set_defaults(c);
+ jpeg_set_quality(c, Quality, TRUE);
+ c->dct_method = JDCT_IFAST;
+ jpeg_start_compress(c, TRUE);
+ while(c->next_scanline < c->image_height)
+ {
+  Row = F->Pixels + (size_t)c->next_scanline * F->Stride;
+  if(F->Format == FRAME_YUYV)
+  {
+   YuyvRow(Line, Row, F->Wide);
+   Row = Line;
+  }
+  jpeg_write_scanlines(c, &Row, 1);
+ }
+ jpeg_finish_compress(c);
+}
+
+int EncodeJpeg(struct Frame *F, char *Path, int Quality)
+{
+ struct jpeg_compress_struct c;
+ struct Error e;
+ unsigned char *Line = NULL;
+ char Tmp[256];
+ FILE *Out;
+ volatile int r = -1; // Kept across the longjmp()
+
+ if(F->Format == FRAME_YUYV && (Line = malloc((size_t)F->Wide * 3)) == NULL) return -1;
+ snprintf(Tmp, sizeof(Tmp), "%s.tmp", Path);
+ if((Out = fopen(Tmp, "wb")) == NULL)
+ {
+  perror(Tmp);
+  free(Line);
+  return -1;
+ }
+
+ c.err = jpeg_std_error(&e.Mgr);
+ e.Mgr.error_exit = ErrorExit;
+ jpeg_create_compress(&c);
+ if(setjmp(e.Back) == 0)
+ {
+  Compress(&c, F, Out, Quality, Line);
+  r = 0;
+ }
+ jpeg_destroy_compress(&c);
+ free(Line);
+
+ if(fclose(Out) != 0 || r < 0 || rename(Tmp, Path) != 0)
+ {
+  if(r == 0) perror(Path);
+  remove(Tmp);
+  return -1;
+ }
+ return 0;
+}
+
+int EncodeNow(struct Frame *F, char *Path)
+{
+ int r = EncodeJpeg(F, Path, JPEG_QUALITY);
+
+ if(r == 0 && Done) Done(Path);
+ return r;
+}
+
+static double Ms()
+{
+ struct timespec t;
+
+ clock_gettime(CLOCK_MONOTONIC, &t);
+ return t.tv_sec * 1000.0 + t.tv_nsec / 1e6;
+}
+
+// Worker thread: take the oldest queued slot, encode it, free it
+static void *Worker(void *Arg)
+{
+ struct Frame *F;
+ char *Path;
+ double t;
+ int r;
+
+ if(OnStart) OnStart();
+ pthread_mutex_lock(&Lock);
+ for(;;)
+ {
+  while(QLen == 0 && !Stopping) pthread_cond_wait(&Work, &Lock);
+  if(QLen == 0) break;
+  F = &Pool.Frames[Queue[QHead]];
+  Path = Paths[Queue[QHead]];
+  QHead = (QHead + 1) % NumSlots;
+  QLen--;
+  Busy++;
+  pthread_mutex_unlock(&Lock);
+
+  t = Ms();
+  r = EncodeNow(F, Path);
+  t = Ms() - t;
+
+  pthread_mutex_lock(&Lock);
+  Busy--;
+  if(r == 0) Stats.Encoded++;
+  else Stats.Failed++;
+  Stats.LastMs = t;
+  TotalMs += t;
+  Stats.AvgMs = TotalMs / (Stats.Encoded + Stats.Failed);
+  if(t > Stats.MaxMs) Stats.MaxMs = t;
+  FramePoolPut(&Pool, F);
+  pthread_cond_signal(&SlotFree);
+  if(QLen == 0 && Busy == 0) pthread_cond_broadcast(&Idle);
+ }
+ pthread_mutex_unlock(&Lock);
+ return NULL;
+}
+
+int EncodeStart(int N, int W, int Wide, int High, int Format)
+{
+ int i;
+
+ if(N > MAX_SLOTS) N = MAX_SLOTS;
+ if(W > MAX_WORKERS) W = MAX_WORKERS;
+ // All the frame memory is allocated and locked in RAM here, never
+ // while recording
+ NumSlots = FramePoolOpen(&Pool, N, Wide, High, Format) == 0 ? N : 0;
+ memset(&Stats, 0, sizeof(Stats));
+ Stats.Slots = NumSlots;
+ Stopping = 0;
+ for(i=0; i<W; i++) if(pthread_create(&Workers[NumWorkers], NULL, Worker, NULL) == 0) NumWorkers++;
+ if(NumSlots == 0 || NumWorkers == 0)
+ {
+  printf("Could not start the encoder\n");
+  EncodeStop();
+  return -1;
+ }
+ return 0;
+}
+
+// Take a free slot to capture into. This takes no lock unless every
+// slot is still queued for encoding, the only time RECORD waits.
+// Returns NULL if the encoder was never started.
+struct Frame *EncodeSlot()
+{
+ struct Frame *F;
+
+ if(NumSlots == 0) return NULL;
+ if((F = FramePoolGet(&Pool)) != NULL) return F;
+ // A worker gives its slot back before taking the lock to signal, so
+ // one freed after the miss above is seen here
+ pthread_mutex_lock(&Lock);
+ Stats.Stalls++;
+ while((F = FramePoolGet(&Pool)) == NULL) pthread_cond_wait(&SlotFree, &Lock);
+ pthread_mutex_unlock(&Lock);
+ return F;
+}
+
+void EncodeRelease(struct Frame *F)
+{
+ FramePoolPut(&Pool, F);
+ pthread_mutex_lock(&Lock);
+ pthread_cond_signal(&SlotFree);
+ pthread_mutex_unlock(&Lock);
+}
+
+void EncodeQueue(struct Frame *F, char *Path)
+{
+ int i = FramePoolIndex(&Pool, F);
+
+ snprintf(Paths[i], sizeof(Paths[i]), "%s", Path);
+ pthread_mutex_lock(&Lock);
+ Queue[(QHead + QLen) % NumSlots] = i;
+ QLen++;
+ if(QLen + Busy > Stats.MaxDepth) Stats.MaxDepth = QLen + Busy;
+ pthread_cond_signal(&Work);
+ pthread_mutex_unlock(&Lock);
+}
+
+// Wait until every queued frame is on disk
+void EncodeDrain()
+{
+ pthread_mutex_lock(&Lock);
+ while(QLen > 0 || Busy > 0) pthread_cond_wait(&Idle, &Lock);
+ pthread_mutex_unlock(&Lock);
+}
+
+void EncodeGetStats(struct EncodeStats *S)
+{
+ struct FramePoolStats P;
+
+ FramePoolGetStats(&Pool, &P);
+ pthread_mutex_lock(&Lock);
+ *S = Stats;
+ S->Depth = QLen + Busy;
+ pthread_mutex_unlock(&Lock);
+ S->InUse = P.InUse;
+ S->MaxInUse = P.MaxInUse;
+ S->Locked = P.Locked;
+}
+
+void EncodeOnDone(int (*Fn)(char *Path))
+{
+ Done = Fn;
+}
+
+void EncodeOnStart(void (*Fn)())
+{
+ OnStart = Fn;
+}
+
+// Finish whatever is queued, then stop the workers and free the slots
+void EncodeStop()
+{
+ int i;
+
+ pthread_mutex_lock(&Lock);
+ Stopping = 1;
+ pthread_cond_broadcast(&Work);
+ pthread_mutex_unlock(&Lock);
+ for(i=0; i<NumWorkers; i++) pthread_join(Workers[i], NULL);
+ NumWorkers = 0;
+ FramePoolClose(&Pool);
+ NumSlots = QLen = QHead = 0;
+}
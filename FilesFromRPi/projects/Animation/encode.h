@@ -0,0 +1,68 @@
+///////////////////////////////////////////////////////////////////////
+//
+// JPEG encoding of captured frames
+//
+// Frames are compressed with libjpeg(-turbo) in process. A YUYV frame
+// is fed to the compressor as YCbCr so no colour conversion is done,
+// only the chroma is expanded a row at a time. The file is written
+// under a temporary name and renamed into place, so a player never
+// sees a half written frame.
+//
+// Encoding normally happens in the background. EncodeStart()
+// allocates a fixed number of frame slots up front, in a frame pool
+// locked in RAM (framePool.c), and starts the worker threads. RECORD
+// takes a free slot with EncodeSlot(), captures straight into it
+// and hands it over with EncodeQueue(), so the main loop goes back to
+// the buttons at once. It only has to wait when every slot is still
+// waiting to be encoded. Anything that reads the frame files must
+// call EncodeDrain() first.
+//
+// EncodeOnDone() sets a function the workers call with the path of
+// each frame once it is on disk, such as BlobPut() to add it to the
+// frame store. EncodeOnStart() sets one each worker calls as it
+// starts, to give itself the cores and priority encoding should have.
+//
+///////////////////////////////////////////////////////////////////////
+
+#ifndef ENCODE_H
+#define ENCODE_H
+
+#include "frame.h"
+
+#define JPEG_QUALITY   90
+#define ENCODE_SLOTS   8  // Frames that can wait to be encoded
+#define ENCODE_WORKERS 3  // Leaves a core for the buttons and preview
+
+struct EncodeStats
+{
+ int Slots;       // Slots allocated
+ int Depth;       // Frames queued or being encoded now
+ int MaxDepth;    // Highest Depth seen
+ long Encoded;    // Frames written
+ long Failed;     // Frames that could not be written
+ long Stalls;     // Times EncodeSlot() had to wait for a free slot
+ int InUse;       // Slots taken now, by the caller or the queue
+ int MaxInUse;    // Most slots taken at once
+ int Locked;      // The slots are locked in RAM
+ double LastMs;   // Encode time of the last frame
+ double AvgMs;    // Average encode time
+ double MaxMs;    // Longest encode time
+};
+
+// Encode a frame now, in the calling thread
+int  EncodeJpeg(struct Frame *F, char *Path, int Quality);
+// The same at JPEG_QUALITY, then passed on as the workers do
+int  EncodeNow(struct Frame *F, char *Path);
+
+// Background encoding
+int  EncodeStart(int Slots, int Workers, int Wide, int High, int Format);
+struct Frame *EncodeSlot();
+void EncodeQueue(struct Frame *Slot, char *Path);
+void EncodeRelease(struct Frame *Slot); // Give back a slot not queued
+void EncodeDrain();
+void EncodeGetStats(struct EncodeStats *S);
+void EncodeStop();
+void EncodeOnDone(int (*Done)(char *Path));
+void EncodeOnStart(void (*Init)()); // Before EncodeStart()
+
+#endif
@@ -0,0 +1,172 @@
+///////////////////////////////////////////////////////////////////////
+//
+// File operations without a shell. See fileOps.h
+//
+///////////////////////////////////////////////////////////////////////
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+#include "fileOps.h"
+
+int FileRemove(char *Path)
+{
+ if(unlink(Path) < 0 && errno != ENOENT)
+ {
+  perror(Path);
+  return -1;
+ }
+ return 0;
+}
+
+int FileRename(char *From, char *To, int NoReplace)
+{
+ if(renameat2(AT_FDCWD, From, AT_FDCWD, To, NoReplace ? RENAME_NOREPLACE : 0) == 0) return 0;
+ // Some file systems (and old kernels) have no renameat2 flags
+ if(errno == EINVAL && NoReplace && access(To, F_OK) < 0 && rename(From, To) == 0) return 0;
+ if(errno == ENOENT && access(From, F_OK) < 0) return 0;
+ perror(To);
+ return -1;
+}
+
+int FileCopy(char *From, char *To)
+{
+ char Tmp[280], Buf[65536];
+ struct stat st;
+ ssize_t n = 0;
+ int In, Out, r = FILE_COPIED;
+
+ if((In = open(From, O_RDONLY | O_CLOEXEC)) < 0)
+ {
+  perror(From);
+  return -1;
+ }
+ snprintf(Tmp, sizeof(Tmp), "%s.tmp", To);
+ if(fstat(In, &st) < 0 || (Out = open(Tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0)
+ {
+  perror(Tmp);
+  close(In);
+  return -1;
+ }
+ // Share the data if the file system can (btrfs, XFS), otherwise let
+ // the kernel move it. That falls back to a plain read and write
+ // where copy_file_range() is not supported between the two, or
+ // stops short of the end (some file systems return 0 early).
+ if(ioctl(Out, FICLONE, In) == 0)
+ {
+  r = FILE_CLONED;
+  st.st_size = 0;
+ }
+ while(st.st_size > 0 && (n = copy_file_range(In, NULL, Out, NULL, st.st_size, 0)) > 0) st.st_size -= n;
+ if(n < 0 && errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP) r = -1;
+ // Both offsets have moved past what was copied, carry on from there.
+ // Running out before st_size means the file was cut short.
+ while(r >= 0 && st.st_size > 0)
+ {
+  if((n = read(In, Buf, st.st_size < (off_t)sizeof(Buf) ? st.st_size : (off_t)sizeof(Buf))) <= 0 ||
+     write(Out, Buf, n) != n) r = -1;
+  else st.st_size -= n;
+ }
+ close(In);
+ if(close(Out) != 0) r = -1;
+ if(r >= 0 && rename(Tmp, To) == 0) return r;
+ perror(To);
+ unlink(Tmp);
+ return -1;
+}
+
+int FileSnapshot(char *From, char *To)
+{
+ if(link(From, To) == 0) return FILE_LINKED;
+ if(errno == EEXIST && unlink(To) == 0 && link(From, To) == 0) return FILE_LINKED;
+ return FileCopy(From, To);
+}
+
+int FileCount(char *Dir)
+{
+ struct dirent *e;
+ DIR *d;
+ int Count = 0;
+
+ if((d = opendir(Dir)) == NULL)
+ {
+  perror(Dir);
+  return -1;
+ }
+ while((e = readdir(d)) != NULL)
+  if(strcmp(e->d_name, ".") != 0 && strcmp(e->d_name, "..") != 0) Count++;
+ closedir(d);
+ return Count;
+}
+
+// Remove everything in the open folder Fd, then close it
+static int EmptyAt(int Fd)
+{
+ struct dirent *e;
+ DIR *d;
+ int Sub, r = 0;
+
+ if((d = fdopendir(Fd)) == NULL)
+ {
+  close(Fd);
+  return -1;
+ }
+ while((e = readdir(d)) != NULL)
+ {
+  if(strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+  if(unlinkat(Fd, e->d_name, 0) == 0 || errno == ENOENT) continue;
+  if(errno != EISDIR && errno != EPERM)
+  {
+   perror(e->d_name);
+   r = -1;
+   continue;
+  }
+  // A folder: empty it, then remove it
+  if((Sub = openat(Fd, e->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)) < 0 ||
+     EmptyAt(Sub) < 0 || unlinkat(Fd, e->d_name, AT_REMOVEDIR) < 0)
+  {
+   perror(e->d_name);
+   r = -1;
+  }
+ }
+ closedir(d);
+ return r;
+}
+
+int FileEmpty(char *Dir)
+{
+ int Fd;
+
+ if((Fd = open(Dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+ {
+  if(errno == ENOENT) return 0;
+  perror(Dir);
+  return -1;
+ }
+ return EmptyAt(Fd);
+}
+
+int FileRemoveTree(char *Path)
+{
+ if(unlink(Path) == 0 || errno == ENOENT) return 0;
+ if(errno != EISDIR && errno != EPERM)
+ {
+  perror(Path);
+  return -1;
+ }
+ if(FileEmpty(Path) < 0) return -1;
+ if(rmdir(Path) < 0)
+ {
+  perror(Path);
+  return -1;
+ }
+ return 0;
+}
@@ -0,0 +1,49 @@
+///////////////////////////////////////////////////////////////////////
+//
+// File operations without a shell
+//
+// Removing, renaming, copying and counting files used to be done by
+// building an rm, mv, rsync or ls command and handing it to system(),
+// which costs a fork and exec of /bin/sh and the program every time,
+// plus a temporary file to read a count back. These do the same work
+// with direct system calls: unlinkat() and openat() on an open
+// directory, renameat2() and copy_file_range(), so the data never
+// passes through user space when the file system can avoid it.
+//
+// Frame files are never changed once written, so a saved copy of one
+// can share its data: FileSnapshot() makes a hard link, or a reflink
+// (FICLONE) where the file system has them and a link is not possible,
+// and only copies the bytes as a last resort.
+//
+// All return 0 (or a count) on success and -1 on failure, having
+// printed the reason. A file that is already gone is not an error.
+//
+///////////////////////////////////////////////////////////////////////
+
+#ifndef FILEOPS_H
+#define FILEOPS_H
+
+#define FILE_COPIED 0
+#define FILE_CLONED 1
+#define FILE_LINKED 2
+
+int FileRemove(char *Path);
+// Rename From to To. With NoReplace set an existing To is an error
+// instead of being replaced.
+int FileRename(char *From, char *To, int NoReplace);
+// Copy a file. The copy is made under a temporary name and renamed
+// into place, so To is never seen half written. Returns FILE_CLONED
+// if the copy is a reflink sharing the data, FILE_COPIED if the bytes
+// were copied.
+int FileCopy(char *From, char *To);
+// Make To the same as From as cheaply as possible, replacing any To.
+// Returns FILE_LINKED, FILE_CLONED or FILE_COPIED, or -1.
+int FileSnapshot(char *From, char *To);
+// Number of entries in a folder, not counting . and ..
+int FileCount(char *Dir);
+// Remove everything in a folder, leaving the folder itself
+int FileEmpty(char *Dir);
+// Remove a file, or a folder and everything in it
+int FileRemoveTree(char *Path);
+
+#endif
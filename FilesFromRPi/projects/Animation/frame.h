@@ -0,0 +1,30 @@
+///////////////////////////////////////////////////////////////////////
+//
+// In memory image shared by the capture, encode and display code
+//
+// Frames from the camera are YUYV (4:2:2, two bytes per pixel, the
+// order V4L2 calls YUYV). Frames decoded for display are BGRX (four
+// bytes per pixel, the layout X11 and the frame buffer want).
+//
+///////////////////////////////////////////////////////////////////////
+
+#ifndef FRAME_H
+#define FRAME_H
+
+#define FRAME_YUYV 0
+#define FRAME_BGRX 1
+
+struct Frame
+{
+ int Wide, High;         // Size in pixels
+ int Stride;             // Bytes from one row to the next
+ int Format;             // FRAME_YUYV or FRAME_BGRX
+ unsigned char *Pixels;
+};
+
+static inline int FrameBytesPerPixel(int Format)
+{
+ return Format == FRAME_YUYV ? 2 : 4;
+}
+
+#endif
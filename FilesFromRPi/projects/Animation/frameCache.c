@@ -0,0 +1,206 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Decoded frame cache. See frameCache.h
+//
+// Each slot is EMPTY, LOADING (being decoded by someone) or READY.
+// A slot is reused least recently used first, never while it is
+// LOADING or while it holds the frame last handed out by Get().
+//
+///////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "frameCache.h"
+
+#define MAX_SLOTS 64
+
+#define EMPTY   0
+#define LOADING 1
+#define READY   2
+
+struct Slot
+{
+ struct Frame F;
+ int Key;
+ int State;
+ long Used;     // LRU clock value when last used
+};
+
+static struct Slot Slots[MAX_SLOTS];
+static int NumSlots = 0;
+static int Wide, High;
+static CacheLoader Load;
+static long Clock = 0;
+static int Pinned = -1;       // Slot handed out by the last Get()
+static struct CacheStats Stats;
+
+// Keys waiting to be prefetched
+static int Want[MAX_SLOTS], NumWant = 0;
+
+static pthread_t Thread;
+static pthread_mutex_t Lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t Changed = PTHREAD_COND_INITIALIZER;
+
+static double Ms()
+{
+ struct timespec t;
+
+ clock_gettime(CLOCK_MONOTONIC, &t);
+ return t.tv_sec * 1000.0 + t.tv_nsec / 1e6;
+}
+
+static int Find(int Key)
+{
+ int i;
+
+ for(i=0; i<NumSlots; i++) if(Slots[i].State != EMPTY && Slots[i].Key == Key) return i;
+ return -1;
+}
+
+// Least recently used slot that can be reused, -1 if none
+static int Victim()
+{
+ int i, v = -1;
+
+ for(i=0; i<NumSlots; i++)
+ {
+  if(i == Pinned || Slots[i].State == LOADING) continue;
+  if(Slots[i].State == EMPTY) return i;
+  if(v < 0 || Slots[i].Used < Slots[v].Used) v = i;
+ }
+ return v;
+}
+
+// Decode Key into slot i. Called with the lock held, drops it while
+// decoding.
+static void Fill(int i, int Key)
+{
+ int r;
+
+ Slots[i].Key = Key;
+ Slots[i].State = LOADING;
+ pthread_mutex_unlock(&Lock);
+ r = Load(Key, &Slots[i].F, Wide, High);
+ pthread_mutex_lock(&Lock);
+ Slots[i].State = r == 0 ? READY : EMPTY;
+ pthread_cond_broadcast(&Changed);
+}
+
+// Background thread: decode whatever is wanted and not cached yet
+static void *Prefetcher(void *Arg)
+{
+ int Key, i;
+
+ pthread_mutex_lock(&Lock);
+ for(;;)
+ {
+  while(NumWant == 0) pthread_cond_wait(&Changed, &Lock);
+  Key = Want[0];
+  memmove(Want, Want + 1, --NumWant * sizeof(int));
+  if(Find(Key) >= 0 || (i = Victim()) < 0) continue;
+  Slots[i].Used = Clock; // Not yet looked at, so oldest of the recent ones
+  Fill(i, Key);
+  Stats.Prefetched++;
+ }
+ pthread_mutex_unlock(&Lock);
+ return NULL;
+}
+
+int FrameCacheInit(int N, int W, int H, CacheLoader L)
+{
+ if(N > MAX_SLOTS) N = MAX_SLOTS;
+ Wide = W;
+ High = H;
+ Load = L;
+ for(NumSlots=0; NumSlots<N; NumSlots++)
+ {
+  if((Slots[NumSlots].F.Pixels = malloc((size_t)W * H * 4)) == NULL) break;
+  Slots[NumSlots].State = EMPTY;
+ }
+ if(NumSlots < 2 || pthread_create(&Thread, NULL, Prefetcher, NULL) != 0)
+ {
+  printf("Could not start the frame cache\n");
+  NumSlots = 0;
+  return -1;
+ }
+ return 0;
+}
+
+struct Frame *FrameCacheGet(int Key)
+{
+ struct Frame *F = NULL;
+ double t = Ms();
+ int i;
+
+ if(NumSlots == 0) return NULL;
+ pthread_mutex_lock(&Lock);
+ if((i = Find(Key)) >= 0)
+ {
+  Stats.Hits++;
+  // Being prefetched right now, wait for it rather than decode twice
+  while(Slots[i].State == LOADING) pthread_cond_wait(&Changed, &Lock);
+  if(Slots[i].State != READY || Slots[i].Key != Key) i = -1;
+ }
+ else if((i = Victim()) >= 0)
+ {
+  Stats.Misses++;
+  Fill(i, Key);
+  if(Slots[i].State != READY) i = -1;
+ }
+ if(i >= 0)
+ {
+  Slots[i].Used = ++Clock;
+  Pinned = i;
+  F = &Slots[i].F;
+ }
+ Stats.LastMs = Ms() - t;
+ pthread_mutex_unlock(&Lock);
+ return F;
+}
+
+void FrameCachePrefetch(int *Keys, int N)
+{
+ if(NumSlots == 0) return;
+ // Never ask for more than fits alongside the frame being shown
+ if(N > NumSlots - 1) N = NumSlots - 1;
+ pthread_mutex_lock(&Lock);
+ memcpy(Want, Keys, N * sizeof(int));
+ NumWant = N;
+ pthread_cond_broadcast(&Changed);
+ pthread_mutex_unlock(&Lock);
+}
+
+void FrameCacheForget(int Key)
+{
+ int i;
+
+ pthread_mutex_lock(&Lock);
+ while((i = Find(Key)) >= 0 && Slots[i].State == LOADING) pthread_cond_wait(&Changed, &Lock);
+ if(i >= 0) Slots[i].State = EMPTY;
+ pthread_mutex_unlock(&Lock);
+}
+
+void FrameCacheClear()
+{
+ int i;
+
+ pthread_mutex_lock(&Lock);
+ NumWant = 0;
+ for(i=0; i<NumSlots; i++)
+ {
+  while(Slots[i].State == LOADING) pthread_cond_wait(&Changed, &Lock);
+  Slots[i].State = EMPTY;
+ }
+ pthread_mutex_unlock(&Lock);
+}
+
+void FrameCacheGetStats(struct CacheStats *S)
+{
+ pthread_mutex_lock(&Lock);
+ *S = Stats;
+ pthread_mutex_unlock(&Lock);
+}
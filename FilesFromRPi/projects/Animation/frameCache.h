@@ -0,0 +1,47 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Decoded frame cache
+//
+// Keeps the most recently used frames decoded at display size so
+// stepping back and forth through an animation is a copy to the screen
+// instead of starting a new viewer and decoding a JPEG. A background
+// thread decodes the frames around the one being looked at, so the
+// next step is normally already in the cache.
+//
+// Frames are found by an integer key chosen by the caller. The caller
+// also supplies the loader that decodes the frame for a key.
+//
+///////////////////////////////////////////////////////////////////////
+
+#ifndef FRAMECACHE_H
+#define FRAMECACHE_H
+
+#include "frame.h"
+
+#define CACHE_FRAMES 16 // Decoded frames kept
+#define CACHE_AHEAD  3  // Frames prefetched each way
+
+// Decode the frame for Key into Out, no larger than Wide x High.
+// Returns 0 on success.
+typedef int (*CacheLoader)(int Key, struct Frame *Out, int Wide, int High);
+
+struct CacheStats
+{
+ long Hits;       // Get() found the frame decoded (or being decoded)
+ long Misses;     // Get() had to decode it
+ long Prefetched; // Frames decoded in the background
+ double LastMs;   // Time taken by the last Get()
+};
+
+int  FrameCacheInit(int Slots, int Wide, int High, CacheLoader Load);
+// The frame for Key, decoding it if needed. NULL if it cannot be
+// loaded. The frame stays valid until the next call.
+struct Frame *FrameCacheGet(int Key);
+// Decode these keys in the background, dropping any older request
+void FrameCachePrefetch(int *Keys, int N);
+// Drop one frame, or all of them, after the files change
+void FrameCacheForget(int Key);
+void FrameCacheClear();
+void FrameCacheGetStats(struct CacheStats *S);
+
+#endif
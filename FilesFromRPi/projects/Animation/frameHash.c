@@ -0,0 +1,238 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Perceptual frame hashes. See frameHash.h
+//
+///////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <pthread.h>
+
+#include "frameHash.h"
+#include "decode.h"
+#include "anim.h"
+
+#define GRID_WIDE 9
+#define GRID_HIGH 8
+#define SAMPLES   8    // Samples a side taken from each grid cell
+#define THUMB     256  // JPEGs are decoded no larger than this
+#define MAX_WORKERS 8
+
+static char Path[256];
+static uint64_t *Hashes = NULL; // By frame ID
+static int NumHashes = 0;
+
+// Build the hash from the grid of cell brightnesses
+static uint64_t FromGrid(int Grid[GRID_HIGH][GRID_WIDE])
+{
+ uint64_t h = 0;
+ int x, y;
+
+ for(y=0; y<GRID_HIGH; y++)
+  for(x=0; x<GRID_WIDE-1; x++) h = h << 1 | (Grid[y][x] < Grid[y][x+1]);
+ return h;
+}
+
+// Each grid cell's brightness is the sum of SAMPLES x SAMPLES pixels
+// spread over it, far fewer than the cell holds, which keeps the cost
+// down to a few thousand reads a frame.
+uint64_t FrameHash(struct Frame *F)
+{
+ int Grid[GRID_HIGH][GRID_WIDE];
+ unsigned char *p;
+ int gx, gy, sx, sy, x, y, Sum;
+
+ for(gy=0; gy<GRID_HIGH; gy++)
+  for(gx=0; gx<GRID_WIDE; gx++)
+  {
+   for(Sum=0, sy=0; sy<SAMPLES; sy++)
+   {
+    y = ((gy * SAMPLES + sy) * 2 + 1) * F->High / (GRID_HIGH * SAMPLES * 2);
+    for(sx=0; sx<SAMPLES; sx++)
+    {
+     x = ((gx * SAMPLES + sx) * 2 + 1) * F->Wide / (GRID_WIDE * SAMPLES * 2);
+     p = F->Pixels + (size_t)y * F->Stride;
+     if(F->Format == FRAME_YUYV) Sum += p[x * 2];
+     else Sum += (p[x*4] + p[x*4+1] * 2 + p[x*4+2]) / 4; // BGR to grey
+    }
+   }
+   Grid[gy][gx] = Sum;
+  }
+ return FromGrid(Grid);
+}
+
+// Decode small, using the decoder's 1/8 scaling, and hash that
+static uint64_t HashDecoded(struct Frame *F, int r)
+{
+ uint64_t h;
+
+ h = r == 0 ? FrameHash(F) : 0;
+ free(F->Pixels);
+ return h;
+}
+
+uint64_t FrameHashJpeg(unsigned char *Data, size_t Len)
+{
+ struct Frame F;
+
+ if((F.Pixels = malloc(THUMB * THUMB * 4)) == NULL) return 0;
+ return HashDecoded(&F, DecodeJpegMem(Data, Len, &F, THUMB, THUMB));
+}
+
+uint64_t FrameHashFile(char *Path)
+{
+ struct Frame F;
+
+ if((F.Pixels = malloc(THUMB * THUMB * 4)) == NULL) return 0;
+ return HashDecoded(&F, DecodeJpegFile(Path, &F, THUMB, THUMB));
+}
+
+int FrameHashBits(uint64_t a, uint64_t b)
+{
+ return __builtin_popcountll(a ^ b);
+}
+
+static void Set(int Id, uint64_t Hash)
+{
+ uint64_t *New;
+ int n;
+
+ if(Id < 0) return;
+ if(Id >= NumHashes)
+ {
+  for(n = NumHashes ? NumHashes : 256; n <= Id; n *= 2);
+  if((New = realloc(Hashes, n * sizeof(*Hashes))) == NULL) return;
+  memset(New + NumHashes, 0, (n - NumHashes) * sizeof(*Hashes));
+  Hashes = New;
+  NumHashes = n;
+ }
+ Hashes[Id] = Hash;
+}
+
+int FrameHashOpen(char *Dir)
+{
+ unsigned long long h;
+ FILE *F;
+ int Id;
+
+ snprintf(Path, sizeof(Path), "%s/%s", Dir, HASH_FILE);
+ if((F = fopen(Path, "r")) == NULL) return 0;
+ while(fscanf(F, "%d %llx", &Id, &h) == 2) Set(Id, h);
+ fclose(F);
+ return 0;
+}
+
+// Each hash is added to the end of the file as it is made; a frame
+// hashed twice just has the later line win when it is read back.
+void FrameHashSet(int Id, uint64_t Hash)
+{
+ FILE *F;
+
+ Set(Id, Hash);
+ if(Path[0] && (F = fopen(Path, "a")) != NULL)
+ {
+  fprintf(F, "%d %016llx\n", Id, (unsigned long long)Hash);
+  fclose(F);
+ }
+}
+
+uint64_t FrameHashGet(int Id)
+{
+ return Id >= 0 && Id < NumHashes ? Hashes[Id] : 0;
+}
+
+void FrameHashClear()
+{
+ free(Hashes);
+ Hashes = NULL;
+ NumHashes = 0;
+ if(Path[0]) remove(Path);
+}
+
+////////////////////////////////////////////////////////////////////////
+//
+// Saved video scan
+//
+////////////////////////////////////////////////////////////////////////
+
+static int IsFrame(const struct dirent *e)
+{
+ size_t n = strlen(e->d_name);
+
+ return strncmp(e->d_name, "Frame", 5) == 0 && n > 9 && strcmp(e->d_name + n - 4, ".jpg") == 0;
+}
+
+// Near copies in one video. A packed video's stored hashes are used
+// where it has them.
+static int ScanVideo(char *Dir)
+{
+ struct dirent **List;
+ struct Anim A;
+ unsigned char *Data;
+ uint64_t h, Last = 0;
+ size_t Len;
+ char s[300];
+ int i, N, Dups = 0;
+
+ snprintf(s, sizeof(s), "%s/%s", Dir, ANIM_FILE);
+ if(AnimOpen(s, &A) == 0)
+ {
+  for(i=0; i<A.Frames; i++)
+  {
+   if((h = A.Index[i].Hash) == 0 && (Data = AnimFrame(&A, i, &Len)) != NULL) h = FrameHashJpeg(Data, Len);
+   if(i > 0 && h && Last && FrameHashBits(h, Last) <= HASH_NEAR) Dups++;
+   Last = h;
+  }
+  AnimClose(&A);
+  return Dups;
+ }
+ if((N = scandir(Dir, &List, IsFrame, alphasort)) < 0) return -1;
+ for(i=0; i<N; i++)
+ {
+  snprintf(s, sizeof(s), "%s/%s", Dir, List[i]->d_name);
+  h = FrameHashFile(s);
+  if(i > 0 && h && Last && FrameHashBits(h, Last) <= HASH_NEAR) Dups++;
+  Last = h;
+  free(List[i]);
+ }
+ free(List);
+ return Dups;
+}
+
+struct Scan
+{
+ char **Dirs;
+ int *Dups;
+ int N, Next;
+ pthread_mutex_t Lock;
+};
+
+static void *Scanner(void *Arg)
+{
+ struct Scan *S = Arg;
+ int i;
+
+ for(;;)
+ {
+  pthread_mutex_lock(&S->Lock);
+  i = S->Next++;
+  pthread_mutex_unlock(&S->Lock);
+  if(i >= S->N) break;
+  S->Dups[i] = ScanVideo(S->Dirs[i]);
+ }
+ return NULL;
+}
+
+void FrameHashScan(char **Dirs, int N, int Workers, int *Dups)
+{
+ pthread_t Threads[MAX_WORKERS];
+ struct Scan S = { Dirs, Dups, N, 0, PTHREAD_MUTEX_INITIALIZER };
+ int i, n = 0;
+
+ if(Workers > MAX_WORKERS) Workers = MAX_WORKERS;
+ for(i=0; i<Workers && i<N; i++) if(pthread_create(&Threads[n], NULL, Scanner, &S) == 0) n++;
+ if(n == 0) Scanner(&S);
+ for(i=0; i<n; i++) pthread_join(Threads[i], NULL);
+}
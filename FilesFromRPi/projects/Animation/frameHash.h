@@ -0,0 +1,47 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Perceptual frame hashes
+//
+// Each frame gets a 64 bit difference hash (dHash): the picture is
+// shrunk to a 9x8 grey grid and each bit says whether a cell is
+// brighter than the one to its right. Two frames of the same scene
+// give hashes a few bits apart even after camera noise and JPEG
+// compression, so the number of differing bits tells how alike two
+// frames are. An accidental double press of RECORD gives a near copy
+// of the frame before, which this picks up.
+//
+// The hash of each frame of the animation being made is kept by frame
+// ID in the Hashes file of the frames folder, and saved in the index
+// of a packed video, so it only has to be worked out once.
+//
+///////////////////////////////////////////////////////////////////////
+
+#ifndef FRAMEHASH_H
+#define FRAMEHASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "frame.h"
+
+#define HASH_FILE "Hashes"
+#define HASH_NEAR 5  // Bits apart that still count as the same picture
+
+// Hash a frame in memory (YUYV or BGRX), or a JPEG file or buffer.
+// The JPEG ones return 0 if it could not be decoded.
+uint64_t FrameHash(struct Frame *F);
+uint64_t FrameHashJpeg(unsigned char *Data, size_t Len);
+uint64_t FrameHashFile(char *Path);
+int      FrameHashBits(uint64_t a, uint64_t b);
+
+// Hashes of the frames being recorded, by frame ID
+int      FrameHashOpen(char *Dir);
+void     FrameHashSet(int Id, uint64_t Hash);
+uint64_t FrameHashGet(int Id); // 0 if not known
+void     FrameHashClear();
+
+// Look for near copies of the frame before in saved videos, Workers
+// videos at a time. Dirs are video folders, packed or not. Dups[i] is
+// set to the number found in Dirs[i], or -1 if it could not be read.
+void     FrameHashScan(char **Dirs, int N, int Workers, int *Dups);
+
+#endif
@@ -0,0 +1,136 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Frame pool. See framePool.h
+//
+///////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include "framePool.h"
+
+#ifndef MAP_POPULATE
+#define MAP_POPULATE 0
+#endif
+
+// Lock Len bytes at Base in RAM, raising the soft limit on locked
+// memory as far as the hard one if need be
+static int Lock(unsigned char *Base, size_t Len)
+{
+ struct rlimit r;
+
+ if(mlock(Base, Len) == 0) return 1;
+ if(getrlimit(RLIMIT_MEMLOCK, &r) == 0 && r.rlim_cur != r.rlim_max)
+ {
+  r.rlim_cur = r.rlim_max;
+  if(setrlimit(RLIMIT_MEMLOCK, &r) == 0 && mlock(Base, Len) == 0) return 1;
+ }
+ printf("Frame pool of %zu MB not locked in RAM (%s)\n", Len >> 20, strerror(errno));
+ return 0;
+}
+
+int FramePoolOpen(struct FramePool *P, int N, int Wide, int High, int Format)
+{
+ size_t Page = sysconf(_SC_PAGESIZE), Bytes;
+ int i;
+
+ memset(P, 0, sizeof(*P));
+ if(N > POOL_MAX) N = POOL_MAX;
+ if(N <= 0) return -1;
+ // Each frame starts on a page of its own
+ Bytes = ((size_t)Wide * High * FrameBytesPerPixel(Format) + Page - 1) & ~(Page - 1);
+ P->Len = Bytes * N;
+ P->Base = mmap(NULL, P->Len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+ if(P->Base == MAP_FAILED)
+ {
+  perror("Frame pool");
+  P->Base = NULL;
+  return -1;
+ }
+ P->Locked = Lock(P->Base, P->Len);
+ // Touch every page, in case the mapping was not populated
+ for(i=0; (size_t)i<P->Len; i+=Page) P->Base[i] = 0;
+ for(i=0; i<N; i++)
+ {
+  P->Frames[i].Wide = Wide;
+  P->Frames[i].High = High;
+  P->Frames[i].Stride = Wide * FrameBytesPerPixel(Format);
+  P->Frames[i].Format = Format;
+  P->Frames[i].Pixels = P->Base + Bytes * i;
+  P->Next[i] = i - 1;
+ }
+ P->N = N;
+ P->Top = N;
+ return 0;
+}
+
+struct Frame *FramePoolGet(struct FramePool *P)
+{
+ uint64_t Old, New;
+ int i, n, Max;
+
+ Old = __atomic_load_n(&P->Top, __ATOMIC_ACQUIRE);
+ do
+ {
+  if((i = (int)(uint32_t)Old - 1) < 0)
+  {
+   __atomic_add_fetch(&P->Misses, 1, __ATOMIC_RELAXED);
+   return NULL;
+  }
+  // If i was taken meanwhile this link may be stale, but then the
+  // count has moved on and the swap fails
+  New = ((Old >> 32) + 1) << 32 | (uint32_t)(__atomic_load_n(&P->Next[i], __ATOMIC_RELAXED) + 1);
+ }
+ while(!__atomic_compare_exchange_n(&P->Top, &Old, New, 1, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+ __atomic_add_fetch(&P->Gets, 1, __ATOMIC_RELAXED);
+ n = __atomic_add_fetch(&P->InUse, 1, __ATOMIC_RELAXED);
+ Max = __atomic_load_n(&P->MaxInUse, __ATOMIC_RELAXED);
+ while(n > Max && !__atomic_compare_exchange_n(&P->MaxInUse, &Max, n, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+ return &P->Frames[i];
+}
+
+void FramePoolPut(struct FramePool *P, struct Frame *F)
+{
+ uint64_t Old, New;
+ int i = FramePoolIndex(P, F);
+
+ if(i < 0) return;
+ Old = __atomic_load_n(&P->Top, __ATOMIC_RELAXED);
+ do
+ {
+  __atomic_store_n(&P->Next[i], (int)(uint32_t)Old - 1, __ATOMIC_RELAXED);
+  New = ((Old >> 32) + 1) << 32 | (uint32_t)(i + 1);
+ }
+ while(!__atomic_compare_exchange_n(&P->Top, &Old, New, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+ __atomic_sub_fetch(&P->InUse, 1, __ATOMIC_RELAXED);
+}
+
+int FramePoolIndex(struct FramePool *P, struct Frame *F)
+{
+ return F >= P->Frames && F < P->Frames + P->N ? (int)(F - P->Frames) : -1;
+}
+
+void FramePoolGetStats(struct FramePool *P, struct FramePoolStats *S)
+{
+ S->Frames = P->N;
+ S->InUse = __atomic_load_n(&P->InUse, __ATOMIC_RELAXED);
+ S->MaxInUse = __atomic_load_n(&P->MaxInUse, __ATOMIC_RELAXED);
+ S->Gets = __atomic_load_n(&P->Gets, __ATOMIC_RELAXED);
+ S->Misses = __atomic_load_n(&P->Misses, __ATOMIC_RELAXED);
+ S->Bytes = P->Len;
+ S->Locked = P->Locked;
+}
+
+void FramePoolClose(struct FramePool *P)
+{
+ if(P->Base)
+ {
+  if(P->Locked) munlock(P->Base, P->Len);
+  munmap(P->Base, P->Len);
+ }
+ memset(P, 0, sizeof(*P));
+}
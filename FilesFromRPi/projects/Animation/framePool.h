@@ -0,0 +1,60 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Frame pool
+//
+// A fixed number of frames of one size and format, allocated together
+// when the pool is opened and never after. The memory is touched and
+// locked into RAM up front with mlock(), so capturing into a frame
+// never takes a page fault, and the program's heap does not grow or
+// break up however long it runs.
+//
+// The free frames are kept on a lock free stack. FramePoolGet() and
+// FramePoolPut() can be called from any thread and never wait: Get
+// returns NULL when every frame is in use, and the caller decides
+// whether to wait or go without. The top of the stack carries a count
+// of changes with it, so a frame taken and given back between another
+// thread reading the top and swapping it cannot fool that thread.
+//
+///////////////////////////////////////////////////////////////////////
+
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "frame.h"
+
+#define POOL_MAX 64
+
+struct FramePool
+{
+ struct Frame Frames[POOL_MAX];
+ int Next[POOL_MAX];   // Free stack links, -1 at the bottom
+ uint64_t Top;         // Count of changes << 32 | top frame + 1, 0 if empty
+ int N;
+ unsigned char *Base;  // All the pixels, one mapping
+ size_t Len;
+ int Locked;           // Base is locked in RAM
+ int InUse, MaxInUse;
+ long Gets, Misses;    // Frames taken, and times none was free
+};
+
+struct FramePoolStats
+{
+ int Frames;
+ int InUse;       // Frames taken now
+ int MaxInUse;    // Most taken at once
+ long Gets;
+ long Misses;     // FramePoolGet() calls that found none free
+ size_t Bytes;    // Memory held
+ int Locked;      // Whether it is locked in RAM
+};
+
+int  FramePoolOpen(struct FramePool *P, int N, int Wide, int High, int Format);
+struct Frame *FramePoolGet(struct FramePool *P);
+void FramePoolPut(struct FramePool *P, struct Frame *F);
+int  FramePoolIndex(struct FramePool *P, struct Frame *F);
+void FramePoolGetStats(struct FramePool *P, struct FramePoolStats *S);
+void FramePoolClose(struct FramePool *P);
+
+#endif
@@ -0,0 +1,159 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Saved video gallery. See gallery.h
+//
+///////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "gallery.h"
+#include "fileOps.h"
+#include "anim.h"
+
+static char Folder[200];
+static int NumSlots = 1;
+static long Head = 0; // Generation of the newest video, 0 for none
+
+static void SlotName(long Gen, char *Buf)
+{
+ sprintf(Buf, "Slot%ld", Gen % NumSlots);
+}
+
+// Write a number to a file atomically
+static int WriteNumber(char *Path, long n)
+{
+ char t[280];
+ FILE *F;
+
+ snprintf(t, sizeof(t), "%s.tmp", Path);
+ if((F = fopen(t, "w")) == NULL)
+ {
+  perror(t);
+  return -1;
+ }
+ fprintf(F, "%ld\n", n);
+ if(fclose(F) != 0 || FileRename(t, Path, 0) < 0) return -1;
+ return 0;
+}
+
+// Move the staging folder into the slot for generation Gen
+static int Publish(long Gen)
+{
+ char s[280], Slot[32], Stage[256];
+
+ snprintf(Stage, sizeof(Stage), "%s/%s", Folder, GALLERY_STAGE);
+ snprintf(s, sizeof(s), "%s/%s", Stage, GALLERY_GEN);
+ if(WriteNumber(s, Gen) < 0) return -1;
+ // Only the one video being replaced is removed
+ SlotName(Gen, Slot);
+ snprintf(s, sizeof(s), "%s/%s", Folder, Slot);
+ if(FileRemoveTree(s) < 0 || FileRename(Stage, s, 1) < 0) return -1;
+ snprintf(s, sizeof(s), "%s/%s", Folder, GALLERY_HEAD);
+ if(WriteNumber(s, Gen) < 0) return -1;
+ Head = Gen;
+ return 0;
+}
+
+// Bring videos saved as Video00 (newest), Video01 ... into slots
+static void Convert()
+{
+ char s[280], t[280];
+ int n, i;
+
+ for(n=0; ; n++)
+ {
+  snprintf(s, sizeof(s), "%s/Video%02d", Folder, n);
+  if(access(s, F_OK) < 0) break;
+ }
+ if(n > NumSlots) n = NumSlots;
+ // Oldest first, so the newest ends up with the highest generation
+ for(i=n-1; i>=0; i--)
+ {
+  GalleryStage(t);
+  rmdir(t);
+  snprintf(s, sizeof(s), "%s/Video%02d", Folder, i);
+  if(FileRename(s, t, 1) < 0 || Publish(Head + 1) < 0) return;
+ }
+ if(n) printf("Moved %d saved videos into the gallery\n", n);
+}
+
+int GalleryOpen(char *Dir, int Slots)
+{
+ char s[280];
+ FILE *F;
+
+ snprintf(Folder, sizeof(Folder), "%s", Dir);
+ NumSlots = Slots > 0 ? Slots : 1;
+ Head = 0;
+ snprintf(s, sizeof(s), "%s/%s", Folder, GALLERY_HEAD);
+ if((F = fopen(s, "r")) != NULL)
+ {
+  if(fscanf(F, "%ld", &Head) != 1) Head = 0;
+  fclose(F);
+ }
+ else Convert();
+ return 0;
+}
+
+struct SavedVideo *GalleryNewest(int n)
+{
+ struct SavedVideo *V;
+ char Slot[32];
+ long Gen;
+
+ // Walk back from the head, skipping any slot that does not hold the
+ // generation it should
+ for(Gen = Head; Gen > 0 && Gen > Head - NumSlots; Gen--)
+ {
+  SlotName(Gen, Slot);
+  if((V = CatalogFind(Slot)) == NULL || V->Gen != Gen) continue;
+  if(n-- == 0) return V;
+ }
+ return NULL;
+}
+
+int GalleryCount()
+{
+ struct SavedVideo *V;
+ char Slot[32];
+ long Gen;
+ int n = 0;
+
+ for(Gen = Head; Gen > 0 && Gen > Head - NumSlots; Gen--)
+ {
+  SlotName(Gen, Slot);
+  if((V = CatalogFind(Slot)) != NULL && V->Gen == Gen) n++;
+ }
+ return n;
+}
+
+char *GalleryStage(char *Buf)
+{
+ snprintf(Buf, 256, "%s/%s", Folder, GALLERY_STAGE);
+ FileRemoveTree(Buf);
+ if(mkdir(Buf, 0755) < 0 && errno != EEXIST) perror(Buf);
+ return Buf;
+}
+
+long GalleryPublish()
+{
+ return Publish(Head + 1) < 0 ? -1 : Head;
+}
+
+int GalleryPack(int Ms)
+{
+ char s[280];
+ int i, n = 0;
+
+ for(i=0; i<NumSlots; i++)
+ {
+  snprintf(s, sizeof(s), "%s/Slot%d", Folder, i);
+  if(access(s, F_OK) == 0 && AnimPack(s, Ms) > 0) n++;
+ }
+ if(n) printf("Packed %d saved videos\n", n);
+ return n;
+}
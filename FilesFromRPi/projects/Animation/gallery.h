@@ -0,0 +1,48 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Saved video gallery
+//
+// Saved videos are kept in a ring of GALLERY_SLOTS folders, SlotN.
+// Every save gets the next generation number and goes in slot
+// generation % slots, replacing the oldest video, so no other video is
+// moved or renamed and the cost of a save does not depend on how many
+// videos there are. The generation of the newest video is kept in the
+// Head file, which is written under a temporary name and renamed into
+// place; that rename is what publishes a save. Each slot also holds a
+// Gen file with its own generation, so a slot left half replaced by a
+// crash is recognised and skipped.
+//
+// A save is built in a staging folder first (GalleryStage()) and then
+// published with GalleryPublish(). "The n-th newest video" is worked
+// out from the head, and the saved video catalog says whether that
+// slot really holds it, so no disk access is needed to browse.
+//
+///////////////////////////////////////////////////////////////////////
+
+#ifndef GALLERY_H
+#define GALLERY_H
+
+#include "catalog.h"
+
+#define GALLERY_HEAD  "Head"
+#define GALLERY_GEN   "Gen"
+#define GALLERY_STAGE ".New"
+
+// Open the gallery in Dir with Slots slots. Videos saved by the old
+// scheme (Video00 newest, Video01 ...) are moved into slots the first
+// time. The catalog must already be open on Dir.
+int  GalleryOpen(char *Dir, int Slots);
+// Number of videos that can be browsed
+int  GalleryCount();
+// The n-th newest video (0 is the newest), NULL if there is none
+struct SavedVideo *GalleryNewest(int n);
+// Empty the staging folder and return its path in Buf, for the new
+// video's frames to be put in
+char *GalleryStage(char *Buf);
+// Publish the staged video as the newest, replacing the oldest
+long GalleryPublish();
+// Pack every video still saved as loose frames into its ANIM_FILE,
+// each frame shown for Ms milliseconds. Returns the number packed.
+int  GalleryPack(int Ms);
+
+#endif
@@ -0,0 +1,283 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Event driven button input. See input.h
+//
+// All sources are registered in one epoll set. Events read from any
+// source are converted to struct InputEvent and put in a small queue
+// so one read() returning several edges is handed out one at a time
+// by InputWait().
+//
+///////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
+#include "input.h"
+
+#define MAX_PINS    32
+#define MAX_SOURCES 16 // The station watches 8, leave room for more
+#define QUEUE_SIZE  64
+
+struct Source
+{
+ int Fd;
+ int Type; // INPUT_GPIO, INPUT_KBD, INPUT_FAKE or INPUT_WATCH
+ void (*Ready)(); // For INPUT_WATCH
+};
+
+static int Epoll = -1;
+static struct Source Sources[MAX_SOURCES];
+static int NumSources = 0;
+
+// Pins requested from the chip and their last known levels
+static int Pins[MAX_PINS];
+static int Levels[MAX_PINS];
+static int NumPins = 0;
+
+// Keyboard mapping, Keys[0] is the '1' key
+static int *Keys = NULL;
+static int NumKeys = 0;
+
+// Events read but not yet handed out
+static struct InputEvent Queue[QUEUE_SIZE];
+static int QHead = 0, QTail = 0;
+
+uint64_t InputNow()
+{
+ struct timespec t;
+
+ clock_gettime(CLOCK_MONOTONIC, &t);
+ return (uint64_t)t.tv_sec * 1000000000ull + t.tv_nsec;
+}
+
+// Add an event to the queue. If the queue is full the oldest event
+// is dropped since the newest level is the one that matters.
+static void Push(int Pin, int Level, int Type, uint64_t TimeNs)
+{
+ struct InputEvent *E = &Queue[QTail];
+
+ E->Pin = Pin;
+ E->Level = Level;
+ E->Source = Type;
+ E->TimeNs = TimeNs;
+ QTail = (QTail + 1) % QUEUE_SIZE;
+ if(QTail == QHead) QHead = (QHead + 1) % QUEUE_SIZE;
+}
+
+static int Pop(struct InputEvent *E)
+{
+ if(QHead == QTail) return 0;
+ *E = Queue[QHead];
+ QHead = (QHead + 1) % QUEUE_SIZE;
+ return 1;
+}
+
+static void SetLevel(int Pin, int Level)
+{
+ int i;
+
+ for(i=0; i<NumPins; i++) if(Pins[i] == Pin) Levels[i] = Level;
+}
+
+int InputLevel(int Pin)
+{
+ int i;
+
+ for(i=0; i<NumPins; i++) if(Pins[i] == Pin) return Levels[i];
+ return 0;
+}
+
+static int AddSource(int Fd, int Type)
+{
+ struct epoll_event ev;
+
+ if(Epoll < 0 && (Epoll = epoll_create1(EPOLL_CLOEXEC)) < 0)
+ {
+  perror("epoll_create1");
+  return -1;
+ }
+ if(NumSources == MAX_SOURCES)
+ {
+  printf("Too many input sources, %d is not watched\n", Fd);
+  return -1;
+ }
+ memset(&ev, 0, sizeof(ev));
+ ev.events = EPOLLIN;
+ ev.data.u32 = NumSources;
+ if(epoll_ctl(Epoll, EPOLL_CTL_ADD, Fd, &ev) < 0)
+ {
+  perror("epoll_ctl");
+  return -1;
+ }
+ Sources[NumSources].Fd = Fd;
+ Sources[NumSources].Type = Type;
+ NumSources++;
+ return 0;
+}
+
+int InputOpen(char *Chip, int *P, int N)
+{
+ struct gpio_v2_line_request Req;
+ struct gpio_v2_line_values Val;
+ int Fd, i;
+
+ if(N > MAX_PINS) N = MAX_PINS;
+ if((Fd = open(Chip, O_RDONLY | O_CLOEXEC)) < 0)
+ {
+  perror(Chip);
+  return -1;
+ }
+ // Ask for all button lines in one request: inputs with pull downs,
+ // events on both edges, time stamped from CLOCK_MONOTONIC.
+ memset(&Req, 0, sizeof(Req));
+ for(i=0; i<N; i++) Req.offsets[i] = P[i];
+ Req.num_lines = N;
+ strcpy(Req.consumer, "Animation");
+ Req.config.flags = GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_BIAS_PULL_DOWN |
+                    GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING;
+ if(ioctl(Fd, GPIO_V2_GET_LINE_IOCTL, &Req) < 0)
+ {
+  perror("GPIO_V2_GET_LINE_IOCTL");
+  close(Fd);
+  return -1;
+ }
+ close(Fd); // The line request keeps its own file descriptor
+
+ // Read the starting levels so InputLevel() is right before any edge
+ memset(&Val, 0, sizeof(Val));
+ Val.mask = (N == 64) ? ~0ull : (1ull << N) - 1;
+ ioctl(Req.fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &Val);
+ for(i=0; i<N; i++)
+ {
+  Pins[i] = P[i];
+  Levels[i] = (Val.bits >> i) & 1;
+ }
+ NumPins = N;
+
+ return AddSource(Req.fd, INPUT_GPIO);
+}
+
+int InputAddKeyboard(int *K, int N)
+{
+ struct termios term;
+
+ // Use termios to turn off line buffering so each key is seen at once
+ tcgetattr(STDIN_FILENO, &term);
+ term.c_lflag &= ~ICANON;
+ tcsetattr(STDIN_FILENO, TCSANOW, &term);
+
+ Keys = K;
+ NumKeys = N;
+ return AddSource(STDIN_FILENO, INPUT_KBD);
+}
+
+int InputAddFake(int Fd)
+{
+ return AddSource(Fd, INPUT_FAKE);
+}
+
+int InputAddWatch(int Fd, void (*Ready)())
+{
+ if(AddSource(Fd, INPUT_WATCH) < 0) return -1;
+ Sources[NumSources-1].Ready = Ready;
+ return 0;
+}
+
+// Read the line events waiting on a GPIO or fake source
+static int ReadLines(struct Source *S)
+{
+ struct gpio_v2_line_event ev[16];
+ ssize_t n;
+ int i;
+
+ if((n = read(S->Fd, ev, sizeof(ev))) <= 0) return n;
+ // Writers are expected to write whole records, a pipe keeps writes
+ // of this size intact.
+ for(i=0; i<n/(ssize_t)sizeof(ev[0]); i++)
+ {
+  int Level = ev[i].id == GPIO_V2_LINE_EVENT_RISING_EDGE;
+
+  SetLevel(ev[i].offset, Level);
+  Push(ev[i].offset, Level, S->Type, ev[i].timestamp_ns);
+ }
+ return n;
+}
+
+// Each number key reads as a press immediately followed by a release
+static int ReadKeys(struct Source *S)
+{
+ char c[16];
+ ssize_t n;
+ int i, k;
+ uint64_t Now = InputNow();
+
+ if((n = read(S->Fd, c, sizeof(c))) <= 0) return n;
+ for(i=0; i<n; i++)
+ {
+  k = c[i] - '1';
+  if(k < 0 || k >= NumKeys) continue;
+  Push(Keys[k], 1, INPUT_KBD, Now);
+  Push(Keys[k], 0, INPUT_KBD, Now);
+ }
+ return n;
+}
+
+int InputWait(struct InputEvent *E, int TimeoutMs)
+{
+ struct epoll_event ev[MAX_SOURCES];
+ uint64_t Now, Deadline = InputNow() + (uint64_t)TimeoutMs * 1000000ull;
+ int n, i, Wait = TimeoutMs;
+
+ while(!Pop(E))
+ {
+  if(Epoll < 0) return -1;
+  // Only wait for what is left of the time out. Keys that are not
+  // mapped produce no event and a signal cuts the wait short, neither
+  // should push the time out back.
+  if(TimeoutMs >= 0)
+  {
+   Now = InputNow();
+   Wait = Now >= Deadline ? 0 : (Deadline - Now + 999999) / 1000000;
+  }
+  if((n = epoll_wait(Epoll, ev, MAX_SOURCES, Wait)) < 0)
+  {
+   if(errno == EINTR) continue;
+   perror("epoll_wait");
+   return -1;
+  }
+  if(n == 0 && TimeoutMs >= 0) return 0;
+  for(i=0; i<n; i++)
+  {
+   struct Source *S = &Sources[ev[i].data.u32];
+
+   if(S->Type == INPUT_WATCH) S->Ready();
+   else if((S->Type == INPUT_KBD ? ReadKeys(S) : ReadLines(S)) <= 0)
+   {
+    // The other end of a fake source went away
+    epoll_ctl(Epoll, EPOLL_CTL_DEL, S->Fd, NULL);
+   }
+  }
+  if(QHead == QTail && TimeoutMs >= 0 && InputNow() >= Deadline) return 0;
+ }
+ return 1;
+}
+
+void InputClose()
+{
+ int i;
+
+ // Watched descriptors belong to whoever added them
+ for(i=0; i<NumSources; i++) if(Sources[i].Type != INPUT_KBD && Sources[i].Type != INPUT_WATCH) close(Sources[i].Fd);
+ NumSources = 0;
+ if(Epoll >= 0) close(Epoll);
+ Epoll = -1;
+ QHead = QTail = 0;
+}
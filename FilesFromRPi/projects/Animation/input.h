@@ -0,0 +1,61 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Event driven button input
+//
+// The buttons are read through the GPIO character device
+// (/dev/gpiochipN) instead of polling the pin levels. The kernel
+// queues an event with a time stamp for every edge on a requested
+// line, so the program can sleep in epoll_wait() until something
+// happens instead of spinning a core in ReadButtons().
+//
+// The keyboard (for use without buttons) and any number of fake line
+// sources are multiplexed through the same epoll set. A fake source is
+// just a file descriptor, normally the read end of a pipe, carrying
+// struct gpio_v2_line_event records exactly as the kernel would send
+// them. This allows the button handling to be run on any Linux box,
+// either against such a pipe or against a gpio-sim chip.
+//
+///////////////////////////////////////////////////////////////////////
+
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdint.h>
+
+// Default GPIO chip on the Raspberry Pi 3/4
+#define GPIO_CHIP "/dev/gpiochip0"
+
+// Where an event came from
+#define INPUT_GPIO 0
+#define INPUT_KBD  1
+#define INPUT_FAKE 2
+#define INPUT_WATCH 3 // Not a button, see InputAddWatch()
+
+struct InputEvent
+{
+ int Pin;         // GPIO line offset, the same number used in Buttons[]
+ int Level;       // 1 if the line went high, 0 if it went low
+ int Source;      // INPUT_GPIO, INPUT_KBD or INPUT_FAKE
+ uint64_t TimeNs; // CLOCK_MONOTONIC time of the edge in nanoseconds
+};
+
+// Request the listed lines as inputs with pull downs and edge events
+int InputOpen(char *Chip, int *Pins, int NumPins);
+// Use the number keys as buttons. Key '1' is Keys[0] and so on
+int InputAddKeyboard(int *Keys, int NumKeys);
+// Add a fake line source carrying struct gpio_v2_line_event records
+int InputAddFake(int Fd);
+// Watch some other descriptor in the same epoll set. Ready() is
+// called from InputWait() whenever Fd is readable; it produces no
+// button event.
+int InputAddWatch(int Fd, void (*Ready)());
+// Wait up to TimeoutMs (-1 is forever) for the next edge.
+// Returns 1 with *E filled in, 0 on timeout and -1 on error.
+int InputWait(struct InputEvent *E, int TimeoutMs);
+// Last known level of a requested pin
+int InputLevel(int Pin);
+// Current CLOCK_MONOTONIC time in nanoseconds
+uint64_t InputNow();
+void InputClose();
+
+#endif
@@ -0,0 +1,374 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Lanes. See lanes.h
+//
+// Each lane has one lock, held only to queue and take jobs, which are
+// milliseconds long, so the threads of a pool hardly ever wait on it.
+//
+///////////////////////////////////////////////////////////////////////
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include "lanes.h"
+
+struct Job
+{
+ void (*Fn)(void *Arg);
+ void *Arg;
+ void (*Done)(void *Arg);
+ int *Finished;    // Set when a LaneCall() job has run
+};
+
+struct Queue
+{
+ struct Job Jobs[LANE_QUEUE];
+ int Head, Len;
+};
+
+struct Lane
+{
+ struct LaneConfig C;
+ pthread_t Threads[LANE_THREADS];
+ int NumThreads;
+ struct Queue Q[LANE_THREADS]; // One for each thread
+ int Next;                     // Queue the next job is given to
+ int Running;                  // Jobs being run now
+ int Stopping;
+ int Warned;                   // Priority could not be set
+ pthread_mutex_t Lock;
+ pthread_cond_t Work;          // A job was queued
+ pthread_cond_t Finished;      // A job was run
+ struct LaneStats S;
+ double Since;                 // When its threads started
+};
+
+// Which lane and queue a thread serves
+struct Who
+{
+ int Lane, Me;
+};
+
+static struct Lane Lanes[LANE_MAX];
+static struct Who Whos[LANE_MAX][LANE_THREADS];
+static int NumLanes = 0;
+static int Home = -1;         // The lane with no threads
+
+// Done() functions waiting to be reaped
+static struct Job Reap[LANE_MAX * LANE_THREADS * LANE_QUEUE];
+static int ReapHead = 0, ReapLen = 0;
+static pthread_mutex_t ReapLock = PTHREAD_MUTEX_INITIALIZER;
+static int ReapFd = -1;
+
+static double Ms()
+{
+ struct timespec t;
+
+ clock_gettime(CLOCK_MONOTONIC, &t);
+ return t.tv_sec * 1000.0 + t.tv_nsec / 1e6;
+}
+
+static int Depth(struct Lane *L)
+{
+ int i, n = 0;
+
+ for(i=0; i<L->NumThreads; i++) n += L->Q[i].Len;
+ return n;
+}
+
+void LaneAdopt(int Lane)
+{
+ struct Lane *L;
+ struct sched_param p;
+ cpu_set_t Set;
+ long Cores = sysconf(_SC_NPROCESSORS_ONLN);
+ int i, r;
+
+ if(Lane < 0 || Lane >= NumLanes) return;
+ L = &Lanes[Lane];
+ CPU_ZERO(&Set);
+ for(i=0; i<Cores && i<32; i++) if(L->C.Cores & (1u << i)) CPU_SET(i, &Set);
+ // Cores this box does not have are left out, no cores at all means any
+ if(CPU_COUNT(&Set) > 0 && (r = pthread_setaffinity_np(pthread_self(), sizeof(Set), &Set)) != 0)
+  printf("Lane %s: could not pin to cores %#x (%s)\n", L->C.Name, L->C.Cores, strerror(r));
+ if(L->C.Priority > 0)
+ {
+  memset(&p, 0, sizeof(p));
+  p.sched_priority = L->C.Priority;
+  if((r = pthread_setschedparam(pthread_self(), SCHED_FIFO, &p)) != 0 && !L->Warned++)
+   printf("Lane %s: no SCHED_FIFO priority %d (%s)\n", L->C.Name, L->C.Priority, strerror(r));
+ }
+}
+
+// Take the next job for thread Me: its own oldest, or else the oldest
+// on the longest of the other queues. Lane lock held.
+static int Take(struct Lane *L, int Me, struct Job *J)
+{
+ struct Queue *Q = &L->Q[Me];
+ int i;
+
+ if(Q->Len == 0)
+ {
+  for(i=0; i<L->NumThreads; i++) if(L->Q[i].Len > Q->Len) Q = &L->Q[i];
+  if(Q->Len == 0) return 0;
+  L->S.Stolen++;
+ }
+ *J = Q->Jobs[Q->Head];
+ Q->Head = (Q->Head + 1) % LANE_QUEUE;
+ Q->Len--;
+ return 1;
+}
+
+// Queue a job, on the next thread's queue that has room. Lane lock
+// held.
+static int Give(struct Lane *L, struct Job *J)
+{
+ struct Queue *Q;
+ int i, d;
+
+ for(i=0; i<L->NumThreads; i++)
+ {
+  Q = &L->Q[(L->Next + i) % L->NumThreads];
+  if(Q->Len == LANE_QUEUE) continue;
+  Q->Jobs[(Q->Head + Q->Len++) % LANE_QUEUE] = *J;
+  L->Next = (L->Next + i + 1) % L->NumThreads;
+  if((d = Depth(L)) > L->S.MaxDepth) L->S.MaxDepth = d;
+  pthread_cond_signal(&L->Work);
+  return 0;
+ }
+ return -1;
+}
+
+static void PostDone(struct Job *J)
+{
+ uint64_t One = 1;
+ int Full;
+
+ pthread_mutex_lock(&ReapLock);
+ if(!(Full = ReapLen == sizeof(Reap) / sizeof(Reap[0])))
+  Reap[(ReapHead + ReapLen++) % (sizeof(Reap) / sizeof(Reap[0]))] = *J;
+ pthread_mutex_unlock(&ReapLock);
+ if(Full) printf("Lane results are not being reaped\n");
+ else write(ReapFd, &One, sizeof(One));
+}
+
+static void *Worker(void *Arg)
+{
+ struct Who *W = Arg;
+ struct Lane *L = &Lanes[W->Lane];
+ struct Job J;
+ double t;
+
+ LaneAdopt(W->Lane);
+ pthread_mutex_lock(&L->Lock);
+ for(;;)
+ {
+  while(!Take(L, W->Me, &J))
+  {
+   if(L->Stopping)
+   {
+    pthread_mutex_unlock(&L->Lock);
+    return NULL;
+   }
+   pthread_cond_wait(&L->Work, &L->Lock);
+  }
+  L->Running++;
+  pthread_mutex_unlock(&L->Lock);
+
+  t = Ms();
+  J.Fn(J.Arg);
+  t = Ms() - t;
+  if(J.Done) PostDone(&J);
+
+  pthread_mutex_lock(&L->Lock);
+  L->Running--;
+  L->S.Jobs++;
+  L->S.BusyMs += t;
+  if(J.Finished) *J.Finished = 1;
+  pthread_cond_broadcast(&L->Finished);
+ }
+}
+
+int LanesStart(struct LaneConfig *Config, int N)
+{
+ struct Lane *L;
+ int i, k;
+
+ if(NumLanes > 0 || N > LANE_MAX) return -1;
+ if((ReapFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+ {
+  perror("eventfd");
+  return -1;
+ }
+ for(i=0; i<N; i++)
+ {
+  L = &Lanes[i];
+  memset(L, 0, sizeof(*L));
+  L->C = Config[i];
+  if(L->C.Threads > LANE_THREADS) L->C.Threads = LANE_THREADS;
+  pthread_mutex_init(&L->Lock, NULL);
+  pthread_cond_init(&L->Work, NULL);
+  pthread_cond_init(&L->Finished, NULL);
+  L->Since = Ms();
+  if(L->C.Threads == 0 && Home < 0) Home = i;
+ }
+ NumLanes = N;
+ for(i=0; i<N; i++)
+ {
+  L = &Lanes[i];
+  for(k=0; k<L->C.Threads; k++)
+  {
+   Whos[i][k].Lane = i;
+   Whos[i][k].Me = k;
+   if(pthread_create(&L->Threads[L->NumThreads], NULL, Worker, &Whos[i][k]) == 0) L->NumThreads++;
+  }
+  if(L->NumThreads < L->C.Threads) printf("Lane %s has %d of %d threads\n", L->C.Name, L->NumThreads, L->C.Threads);
+ }
+ return 0;
+}
+
+// A lane that runs its jobs in the caller: the one with no threads,
+// any lane when there are no lanes, or a lane called from its own thread
+static int Inline(int Lane)
+{
+ int i;
+
+ if(Lane < 0 || Lane >= NumLanes || Lanes[Lane].NumThreads == 0) return 1;
+ for(i=0; i<Lanes[Lane].NumThreads; i++) if(pthread_equal(Lanes[Lane].Threads[i], pthread_self())) return 1;
+ return 0;
+}
+
+int LaneRun(int Lane, void (*Fn)(void *Arg), void *Arg, void (*Done)(void *Arg))
+{
+ struct Job J = { Fn, Arg, Done, NULL };
+ struct Lane *L = &Lanes[Lane];
+ int r;
+
+ if(Inline(Lane))
+ {
+  Fn(Arg);
+  if(Done) Done(Arg);
+  return 0;
+ }
+ pthread_mutex_lock(&L->Lock);
+ if((r = Give(L, &J)) < 0) L->S.Dropped++;
+ pthread_mutex_unlock(&L->Lock);
+ return r;
+}
+
+void LaneCall(int Lane, void (*Fn)(void *Arg), void *Arg)
+{
+ struct Lane *L = &Lanes[Lane];
+ int Finished = 0;
+ struct Job J = { Fn, Arg, NULL, &Finished };
+
+ if(Inline(Lane))
+ {
+  Fn(Arg);
+  return;
+ }
+ pthread_mutex_lock(&L->Lock);
+ while(Give(L, &J) < 0) pthread_cond_wait(&L->Finished, &L->Lock);
+ while(!Finished) pthread_cond_wait(&L->Finished, &L->Lock);
+ pthread_mutex_unlock(&L->Lock);
+}
+
+int LaneDepth(int Lane)
+{
+ struct Lane *L = &Lanes[Lane];
+ int n;
+
+ if(Lane < 0 || Lane >= NumLanes) return 0;
+ pthread_mutex_lock(&L->Lock);
+ n = Depth(L) + L->Running;
+ pthread_mutex_unlock(&L->Lock);
+ return n;
+}
+
+int LanesFd() { return ReapFd; }
+
+void LanesReap()
+{
+ struct Job J;
+ uint64_t n;
+ double t;
+ int Got;
+
+ if(ReapFd < 0) return;
+ read(ReapFd, &n, sizeof(n));
+ for(;;)
+ {
+  pthread_mutex_lock(&ReapLock);
+  if((Got = ReapLen > 0))
+  {
+   J = Reap[ReapHead];
+   ReapHead = (ReapHead + 1) % (sizeof(Reap) / sizeof(Reap[0]));
+   ReapLen--;
+  }
+  pthread_mutex_unlock(&ReapLock);
+  if(!Got) break;
+  t = Ms();
+  J.Done(J.Arg);
+  if(Home >= 0)
+  {
+   Lanes[Home].S.Jobs++;
+   Lanes[Home].S.BusyMs += Ms() - t;
+  }
+ }
+}
+
+void LaneGetStats(int Lane, struct LaneStats *S)
+{
+ struct Lane *L = &Lanes[Lane];
+ double Up;
+
+ memset(S, 0, sizeof(*S));
+ if(Lane < 0 || Lane >= NumLanes) return;
+ pthread_mutex_lock(&L->Lock);
+ *S = L->S;
+ S->Depth = Depth(L);
+ pthread_mutex_unlock(&L->Lock);
+ if(Lane == Home)
+ {
+  pthread_mutex_lock(&ReapLock);
+  S->Depth = ReapLen;
+  pthread_mutex_unlock(&ReapLock);
+ }
+ Up = (Ms() - L->Since) * (L->NumThreads ? L->NumThreads : 1);
+ S->Util = Up > 0 ? S->BusyMs / Up : 0;
+}
+
+char *LaneName(int Lane)
+{
+ return Lane >= 0 && Lane < NumLanes ? Lanes[Lane].C.Name : "none";
+}
+
+void LanesStop()
+{
+ struct Lane *L;
+ int i, k;
+
+ for(i=0; i<NumLanes; i++)
+ {
+  L = &Lanes[i];
+  pthread_mutex_lock(&L->Lock);
+  while(Depth(L) > 0 || L->Running > 0) pthread_cond_wait(&L->Finished, &L->Lock);
+  L->Stopping = 1;
+  pthread_cond_broadcast(&L->Work);
+  pthread_mutex_unlock(&L->Lock);
+  for(k=0; k<L->NumThreads; k++) pthread_join(L->Threads[k], NULL);
+ }
+ LanesReap();
+ NumLanes = 0;
+ Home = -1;
+ close(ReapFd);
+ ReapFd = -1;
+}
@@ -0,0 +1,72 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Lanes
+//
+// A lane is a queue of jobs with its own threads, pinned to the cores
+// given for it and, if wanted, run at a SCHED_FIFO priority. Work that
+// must be done in order on one device (the camera, the screen) goes on
+// a lane with one thread, which also means nothing else has to lock
+// around it. A lane with several threads is a pool: each thread has
+// its own queue, jobs are handed out in turn, and a thread that runs
+// out takes the oldest job waiting on the busiest of the others.
+//
+// A lane given no threads is the thread that starts the lanes, the
+// one reading the buttons. Its jobs are the Done() functions of jobs
+// run on the other lanes, which are queued for it and run by
+// LanesReap() when LanesFd() is readable, so results can be handed
+// back to code that is not thread safe. That thread takes its lane's
+// cores and priority with LaneAdopt() once it has started the threads
+// it keeps, as a thread starts out with the cores and priority of the
+// one that started it. For the same reason a job that starts threads
+// of its own gives them its lane's.
+//
+// If the lanes were never started every job is run at once by the
+// caller, the same as before there were lanes.
+//
+///////////////////////////////////////////////////////////////////////
+
+#ifndef LANES_H
+#define LANES_H
+
+#define LANE_MAX     6
+#define LANE_THREADS 4   // Most threads on one lane
+#define LANE_QUEUE   32  // Jobs that can wait for each thread
+
+struct LaneConfig
+{
+ char *Name;
+ int Threads;      // 0 for the calling thread
+ unsigned Cores;   // Bit n for core n, 0 for any
+ int Priority;     // SCHED_FIFO priority, 0 for the normal scheduler
+};
+
+struct LaneStats
+{
+ int Depth;        // Jobs waiting now
+ int MaxDepth;     // Most seen waiting
+ long Jobs;        // Jobs run
+ long Stolen;      // Of those, run by a thread they were not given to
+ long Dropped;     // Not queued because the lane was full
+ double BusyMs;    // Time spent running jobs
+ double Util;      // BusyMs over the time its threads have been up
+};
+
+// Start the threads of every lane
+int  LanesStart(struct LaneConfig *Config, int N);
+// Queue Fn(Arg) on a lane. Done(Arg), if given, runs on the lane
+// with no threads once Fn has returned. Returns -1 if the lane is full.
+int  LaneRun(int Lane, void (*Fn)(void *Arg), void *Arg, void (*Done)(void *Arg));
+// Run Fn(Arg) on a lane and wait for it
+void LaneCall(int Lane, void (*Fn)(void *Arg), void *Arg);
+int  LaneDepth(int Lane);  // Jobs waiting or running
+// Give the calling thread a lane's cores and priority, for threads
+// started elsewhere that do that lane's kind of work
+void LaneAdopt(int Lane);
+int  LanesFd();
+void LanesReap();
+void LaneGetStats(int Lane, struct LaneStats *S);
+char *LaneName(int Lane);
+// Wait for all queued work, run what is left to reap and stop
+void LanesStop();
+
+#endif
@@ -20,6 +20,11 @@
 // the 3.3 volt line to the NO and a ground line to the NC to give a 
 // hard ground to unpressed buttons.
 //
+// The buttons are read through the GPIO character device rather than
+// by polling the pin levels (see input.c). The kernel time stamps
+// every edge and the program sleeps in epoll until a button or key is
+// pressed, so the main loop no longer keeps a core busy.
+//
 // There are 7 buttons, defined:
 // 
 //
@@ -60,6 +65,11 @@
 #define DEBUG 1      // Print debug messages
 #define USE_KBD 1    // For keyboard use without buttons
 #define USE_CAMERA 1 // To leave camera off for debug  
+#define USE_V4L2 0   // Grab frames from CAMERA_DEV instead of with scrot
+#define USE_XSHM 1   // Otherwise grab the live video off the screen in process
+#define RAW_JOURNAL 0 // With USE_V4L2, keep frames raw until saved or played
+#define USE_PLAYER 1 // Play with the built in player instead of feh
+#define USE_LANES 1  // Capture, drawing and encoding on threads of their own
 
 // Video Implementation:
 // 
@@ -87,6 +97,20 @@
 // scrot command:
 // scrot <output file>
 //
+// With USE_V4L2 set, frames are instead copied straight out of the
+// V4L2 device CAMERA_DEV and compressed in process (capture.c and
+// encode.c), with no temporary file or extra process. Compression
+// runs on worker threads so RECORD returns at once. This needs a
+// camera that libcamera-vid is not holding open, such as a USB camera.
+// For testing, CAMERA_DEV can be the vivid virtual driver or a file
+// of raw YUYV frames. If the capture fails scrot is used.
+//
+// Without USE_V4L2 but with USE_XSHM set, the frame is read off the
+// screen in process (screenGrab.c): the X server copies the full
+// screen live video into shared memory, and the frame is compressed on
+// the worker threads as a camera frame would be. scrot is only used if
+// that cannot be set up.
+//
 // The feh library is used to play the animation. The one command plays
 // all files in the Frames folder in numerical order
 //
@@ -101,8 +125,43 @@
 // --recursive show subfolders as well. SInce only Frames is a subfolder
 // --quiet to suppress output to the console
 // this just shows the saved animation.
+//
+// With USE_PLAYER set, the built in player (player.c) is used instead.
+// It plays at a steady PLAY_FPS, decoding a few frames ahead, and
+// starts showing frames at once rather than after feh's preload pass.
+// It draws on an X window when there is an X session, otherwise
+// straight to the HDMI output through DRM/KMS or the frame buffer
+// (display.c), with no tearing. feh is still used if no display can
+// be opened.
+//
+// A video plays on the player's own thread, so the buttons are read
+// while it plays. Any button stops it, and PLAY does nothing else.
+//
+// With USE_LANES set the work is split over lanes of threads kept to
+// cores of their own (lanes.c): the buttons on core 0, the camera and
+// screen grabs on core 1 next to the drawing, and encoding on cores 2
+// and 3. The timeline and the rest of the program's state are only
+// touched on the button thread.
 // 
-// Erasing frames uses the standard linux remove command rm
+// The order of the frames is kept in a timeline (timeline.c), a list
+// of frame IDs saved as Frames/Manifest.txt. Each frame is saved once
+// as Frames/Take<ID>.jpg. The sequential Frame%05d.jpg names feh needs
+// are only made when the frames are exported, which is done as links
+// in the EXPORT_DIR folder.
+//
+// Erasing frames removes the files directly (fileOps.c), no rm
+// command or shell is run.
+//
+// Every frame written is also linked into the Blobs folder under the
+// hash of its contents (blobStore.c). A frame identical to one already
+// there is replaced with a link to the stored copy, so repeated frames
+// take no more space. Blobs nothing links to any more are removed when
+// the frames are cleared.
+//
+// With RAW_JOURNAL set (and USE_V4L2), RECORD only copies the camera
+// frame into a memory mapped journal file, Session.raw (rawJournal.c).
+// The frames are encoded to JPEG on every core at once when the
+// animation is played.
 //
 // To hide task bar, in task bar, right clink on "Panel Settings"
 // -> Advanced. Check Minimize panel when not in use
@@ -114,35 +173,35 @@
 // area that shows up. Left click on "Resolution" option in the 
 // drop down menu.
 //
-// This reqiures forked processes to allow the multiple video handlers 
-// to be used. Forked processes are used for the live video feed
-// via libcamera and to play the animation using feh. Both of these 
-// are started via a system() command. When they are started. the
-// getpid() command is used to get the new pid and store it in the
-// shared memory Share[] array. Unfortunately, at least for feh,
-// executing the system command creates a process but that then
-// creates another process whose pid is not retrieveable via getpid()
-// instead, I use the ps command and pipe it to a file then look for
-// feh under the CMD column to find the pid to kill.
-//
-// the ps command (process status) to list all processes and pipe it
-// to proc.txt is:
-//
-// ps a > proc.txt
+// This reqiures separate processes to allow the multiple video
+// handlers to be used. They are used for the live video feed via
+// libcamera and to show frames using feh. Both are started by the
+// supervisor (supervisor.c) with posix_spawn(), so the pid it keeps is
+// the program itself rather than a shell that started it. Each is held
+// by a pidfd, so stopping one signals exactly that process and waits
+// for it to go, without searching the ps listing for its name.
 
 ///////////////////////////////////////////////////////////////////////
 
 #include <stdio.h>
 #include <ctype.h>      // for toupper
-#include <termios.h>  
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>     // Needeed for sleep() and usleep()
-#include <bcm2835.h>
-#include <sys/mman.h>
-#include <sys/select.h> // Needed for kbhit()
-#include <sys/ioctl.h>  // Needed for kbhit()
 #include <time.h>
+
+#include "input.h"      // Button and keyboard events
+#include "debounce.h"   // Press, release, hold and repeat from raw edges
+#include "capture.h"    // Frames straight from the camera
+#include "encode.h"     // In process JPEG compression
+#include "player.h"     // Built in frame player
+#include "timeline.h"   // Frame order, kept apart from the file names
+#include "supervisor.h" // Helper programs run and stopped by pidfd
+#include "fileOps.h"    // rm, mv, cp and ls without a shell
+#include "blobStore.h"  // Each distinct frame stored once
+#include "rawJournal.h" // Frames kept raw until they are needed
+#include "screenGrab.h" // The live video read off the screen
+#include "lanes.h"      // Threads pinned to cores for each kind of work
                   
 // Basic defines
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
@@ -157,12 +216,27 @@
 #define NO_PID    -1
 
 #define FULL_PATH "/home/rpi/projects/Animation/"
+#define CAMERA_DEV "/dev/video0"
+#define RAW_FILE FULL_PATH "Session.raw" // The raw frame journal
+#define RAW_MB 512   // Its size, 4 MB holds one 1920x1080 frame
+#define PLAY_FPS 12  // Frame rate of the built in player
+#define EXPORT_DIR "Export" // Frames in order for feh
+#define LANE_INPUT   0 // Lanes: the buttons and the program's state,
+#define LANE_CAPTURE 1 // the camera and screen grabs,
+#define LANE_WORK    2 // encoding,
+#define LANE_DISPLAY 3 // and drawing on the screen
 
 // Globals, Assign the button defines to an array to allow button 
 // checking in a loop 
 int Buttons[] = { PLAY, RECORD, RESTART, SHUTDOWN };
 // Name the buttons for use in diagnostic messages
 char BText[][32] = { "Play", "Record", "Restart", "Shutdown"};
+// Debounce, hold and repeat times in microseconds for each button
+struct ButtonConfig ButtonTiming[] = {
+ { PLAY,     20000, 0, 0 },
+ { RECORD,   20000, 0, 0 },
+ { RESTART,  20000, 0, 0 },
+ { SHUTDOWN, 20000, 0, 0 } };
     
 // Figure how many buttons are defined
 int NumButtons = sizeof(Buttons)/sizeof(Buttons[0]);
@@ -170,9 +244,37 @@ int FrameCount;     // Keeps count of total frames recorded
 int CurrentFrame;   // Track current frame location
 int CurrentPreview; // Track which video is being previewed
 
-int *Share; // Shared memory to get the camera pid. This allows the
+// Supervisor handles of the helper programs. This allows the
 // Continous video started in StartCamera() to be stopped by KillCamera()
-// Otherwise the live video can't be stopped
+int Helper[] = { NO_PID, NO_PID };
+
+struct Display *Playing = NULL; // Output of the video playing, if any
+
+// The lanes, in LANE_ order: name, threads, cores, SCHED_FIFO priority.
+// The Raspberry Pi has 4 cores.
+struct LaneConfig LaneTable[] = {
+ { "input",   0, 0x1, 30 },
+ { "capture", 1, 0x2, 20 },
+ { "work",    2, 0xC, 0 },
+ { "display", 1, 0x2, 20 } };
+
+// A frame taken for the animation, see GrabFrame()
+struct Shot
+{
+ int Id, Wide, High;
+ char *Path;
+ int r;
+};
+
+// A video to start playing, see StartPlay()
+struct Play
+{
+ char **Paths;
+ int N;
+ char *Folder;      // Or the frames in here
+ struct Display *D;
+ int r;
+};
 
 int main()
 {
@@ -184,28 +286,57 @@ int main()
  void GrabFrame(int Frame, int Wide, int High);
  void Shutdown();
  void ShowPressedButton(int Button);
+ void PlayDone();
+ void StopPlaying();
+ void AdoptWork();
  
  int B;
 
- // Allocate the shared memory for the video camera pid
- Share = mmap(NULL, 32, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
- // Set the PIDs to show not forked processes
- Share[VIDEO_PID] = NO_PID;
- Share[FRAME_PID] = NO_PID;
-
  // Move to the program folder. This does not seem to always work since
  // full paths are often needed.
 // system("cd /home/rpi/projects/Animation");
  
+ // The lanes come first, so the threads started below can take their
+ // cores
+ if(USE_LANES && LanesStart(LaneTable, sizeof(LaneTable)/sizeof(LaneTable[0])) == 0)
+ {
+  // Done() functions are run from the input loop. Without it every
+  // job is run at once instead, as with no lanes.
+  if(InputAddWatch(LanesFd(), LanesReap) < 0) LanesStop();
+  else EncodeOnStart(AdoptWork);
+ }
+ TimelineLoad(FULL_PATH "Frames");
+ // Identical frames share one file. Collecting also drops blobs left
+ // over from the last session that nothing refers to any more.
+ if(BlobOpen(FULL_PATH BLOB_DIR) == 0) EncodeOnDone(BlobPut);
  Restart();        // Initialize values
- InitGPIO();       // Start the BCM2835 library to allow reading the buttons
+ // Helpers that exit are reaped here, not in a signal handler
+ if(SuperFd() >= 0 && InputAddWatch(SuperFd(), SuperReap) < 0)
+  printf("Helpers that exit will not be reaped\n");
+ InitGPIO();       // Request the button lines to allow reading the buttons
  if(USE_CAMERA) StartCamera();    // Turn on the live video
+ if(USE_V4L2 && CaptureOpen(CAMERA_DEV, V_WIDE, V_HIGH) < 0) printf("No capture device\n");
+ if(USE_V4L2) EncodeStart(ENCODE_SLOTS, ENCODE_WORKERS, V_WIDE, V_HIGH, FRAME_YUYV);
+ else if(USE_XSHM && ScreenGrabOpen(0, 0, V_WIDE, V_HIGH) == 0)
+  EncodeStart(ENCODE_SLOTS, ENCODE_WORKERS, V_WIDE, V_HIGH, FRAME_BGRX);
+ if(USE_V4L2 && RAW_JOURNAL) RawOpen(RAW_FILE, (size_t)RAW_MB << 20, V_WIDE, V_HIGH);
+ // Videos play on the player thread, which says here when it is done
+ if(InputAddWatch(PlayerFd(), PlayDone) < 0)
+  printf("A video that ends stays up until a button is pressed\n");
+ // Every long lived thread is running, the buttons can have core 0
+ if(USE_LANES) LaneAdopt(LANE_INPUT);
 
  while(1)
  {
   if((B = ReadButtons()) != NO_BUTTON) // Look for a button press
   {
    ShowPressedButton(B);
+   // Any button stops a video that is playing. PLAY does nothing else.
+   if(PlayerBusy())
+   {
+    StopPlaying();
+    if(B == PLAY) continue;
+   }
    switch(B)
    {
     // Delete the current video   
@@ -233,53 +364,41 @@ int main()
 // a button press is read as a HIGH value. The pins are configured
 // with pull down resistors but a ground is attached to the NC terminals.
 
-// Initialize the pushbuttons
+// Initialize the pushbuttons. All button lines are requested from the
+// GPIO chip as inputs with pulldown resistors and edge events.
 void InitGPIO()
 {
- int i;
-
- // Initialize the BCM2835 library, used to read button presses here
- if(!bcm2835_init()) printf("No BCM2835\n");    
-
- for(i=0; i<NumButtons; i++)
- {
-  // Configure all button pins as input      
-  bcm2835_gpio_fsel(Buttons[i],BCM2835_GPIO_FSEL_INPT);  
-  // Add pulldown resistors to all pins
-  bcm2835_gpio_set_pud(Buttons[i],BCM2835_GPIO_PUD_DOWN);  
- } 
+ DebounceInit(ButtonTiming, NumButtons);
+ if(InputOpen(GPIO_CHIP, Buttons, NumButtons) < 0) printf("No GPIO chip\n");
+ // The number keys represent the indices in Buttons starting at 1
+ if(USE_KBD) InputAddKeyboard(Buttons, NumButtons);
 }
 
-// A basic button read just looks for the first pressed button in the
-// array. Alternatively, if USE_KBD is pressed, the number keys 
-// represent the indices in Buttons starting at 1
+// Sleep until a button is pressed (or a number key is typed) and
+// return it. The raw edges go through the debouncer so only clean
+// presses and auto repeats come back. Releases and holds are just
+// shown in the DEBUG print along with how late the event was handled.
 int ReadButtons()
 {
- int kbhit();
+ struct InputEvent In;
+ struct ButtonEvent E;
 
- int i, Found = -1;
-
- // bcm2835_gpio_lev(); returns HIGH or LOW
- if(USE_KBD && kbhit())
+ for(;;)
  {
-  i = getchar() - '1';
-  if(i > 0 && i < 8) return Buttons[i];
- }
-
- // Query each button in sequence
-
- // Only the first button found is returned but the all buttons are
- // scanned and displayed in the DEBUG print since there have been 
- // lots of issues with false button reads, both from the actual
- // switches and hardware and from Raspberry Pi anomalies.
- for(i=0; i<NumButtons; i++) if(bcm2835_gpio_lev(Buttons[i]) == HIGH)
- {
-//  if(DEBUG) printf("Button %s Pressed\n", BText[i]);
-  if(Found == -1) Found = i; // If it's the first press found, save it
+  while(DebounceGet(&E))
+  {
+   if(DEBUG) printf("%s %d at %llu us, %llu us late\n", DebounceName(E.Type), E.Pin,
+                    (unsigned long long)E.TimeUs, (unsigned long long)(InputNow()/1000 - E.TimeUs));
+   if(E.Type == BTN_PRESS || E.Type == BTN_REPEAT) return E.Pin;
+  }
+  // Sleep until the next edge or until the debouncer has something due
+  switch(InputWait(&In, DebounceWaitMs(InputNow()/1000, -1)))
+  {
+   case 1  : DebounceFeed(In.Pin, In.Level, In.TimeNs/1000); break;
+   case 0  : DebounceTick(InputNow()/1000);                   break;
+   default : return NO_BUTTON;
+  }
  }
- // If a button has been pressed and at least 1 second has elapsed
- if(Found != -1) return Buttons[Found]; // Send the button info back
- return NO_BUTTON;
 }
 
 ///////////////////////////////////////////////////////////////////////
@@ -304,70 +423,209 @@ void ShowFrameInCurrent(int Frame)
  ShowFrame(s);
 }
 */
-// Kill the frame process
+// Stop the frame viewer
 void KillFrame()
 {
- void ps_kill(char *p);   
-    
- extern int *Share; // PIDs are in shared memory     
- 
- char s[64];
- // Build the kill command for the saved pid
- sprintf(s, "kill -kill %d", Share[FRAME_PID]);
- if(DEBUG) printf("Kill command: %s\n", s);
- // Kill the process
- system(s);
- // Now find the feh process and kill that
- ps_kill("feh");
+ extern int Helper[];
+
+ if(DEBUG) printf("Stopping frame viewer\n");
+ SuperStop(Helper[FRAME_PID]);
+ Helper[FRAME_PID] = NO_PID;
 }
 
-// Playing the recorded video uses the feh routine to play all frames in
-// the Frames folder.
+// Playing the recorded video uses the built in player on the frames in
+// timeline order. Failing that the frames are exported with sequential
+// names and played with feh.
 void Play()
 {
  void PlayVideo(char *Folder); 
+ int  PlayTimeline();
+ void FramesToDisk();
 
- PlayVideo("Frames");
+ FramesToDisk(); // Make sure every recorded frame is on disk
+ if(USE_PLAYER && PlayTimeline() == 0) return;
+ TimelineExport(FULL_PATH EXPORT_DIR);
+ PlayVideo(EXPORT_DIR);
 }
 
-// Add the current view to the animation
+// Add the current view to the animation as frame n. The frames from
+// n on move up one place in the timeline.
 void GrabFrame(int n, int w, int h)
 {
  void StartCamera();
  void KillCamera();   
- void SystemFile(char *Command, char *File);
-
- char s[256];	
-
+ void TakeShot(void *Arg);
+
+ char t[256];	
+ char *Scrot[] = { "scrot", t, NULL };
+ struct Shot Shot;
+ int Id;
+ char *Flash[] = { "feh", "--quiet", "--hide-pointer", "-F", "-p", "--on-last-slide=quit",
+                   "--slideshow-delay", "0.3", FULL_PATH "BlackOut", NULL };
+
+ // Copy the frame straight from the camera if it is available, or
+ // else straight off the screen, on the capture lane. This is quick
+ // enough that the BlackOut flash is not needed.
+ if(n > TimelineCount()) n = TimelineCount();
+ if((Id = TimelineInsert(n)) < 0) return;
+ TimelinePath(Id, t);
+ memset(&Shot, 0, sizeof(Shot));
+ Shot.Id = Id;
+ Shot.Wide = w;
+ Shot.High = h;
+ Shot.Path = t;
+ LaneCall(LANE_CAPTURE, TakeShot, &Shot);
+ if(Shot.r < 0)
+ {
 // KillCamera();	    
- // Going to full screen simplifies the above since scot can directly
- // save the image
-printf("1: %s\n", s);
- sprintf(s, "scrot %sFrames/Frame%05d.jpg", FULL_PATH, n);
-
+  // Going to full screen simplifies the above since scot can directly
+  // save the image
 //sprintf(s, "scrot %sFrames/Grab.jpg", FULL_PATH);
-printf("1: %s\n", s);
-system(s);
+  if(DEBUG) printf("scrot %s\n", t);
+  SuperRun(Scrot);
 //sprintf(s, "convert %sFrames/Grab.jpg -resize %dX%d  %sFrames/Frame%05d.jpg", FULL_PATH, V_WIDE/2, V_HIGH/2, FULL_PATH, n);
 //system(s); 
 // Halve the resolution of the grabbed image and store it 
- CurrentFrame++;  // Update the current frame index 
- FrameCount++;    // And the total frame count
+  SuperRun(Flash);
+  // Take a frame that never arrived out of the timeline again
+  if(access(t, F_OK) < 0)
+  {
+   printf("Could not grab frame %d\n", n);
+   TimelineErase(n);
+   return;
+  }
+ }
+ CurrentFrame = n; // The new frame is the current one
+ FrameCount = TimelineCount(); // And the total frame count
  if(DEBUG) printf("Record Frame #%d\n", FrameCount);
- SystemFile("feh --quiet --hide-pointer  -F -p --on-last-slide=quit --slideshow-delay 0.3 %s%s", "BlackOut");
+}
+
+// Take a frame for GrabFrame(), on the capture lane
+void TakeShot(void *Arg)
+{
+ int  CaptureToFile(char *Path, int Wide, int High);
+ int  CaptureToJournal(int Id, int Wide, int High);
+ int  ScreenToFile(char *Path);
+
+ struct Shot *S = Arg;
+
+ if(!USE_V4L2) S->r = ScreenToFile(S->Path);
+ else if(CaptureToJournal(S->Id, S->Wide, S->High) == 0) S->r = 0;
+ else S->r = CaptureToFile(S->Path, S->Wide, S->High);
+}
+
+// Read the live video off the screen into a free encoder slot and
+// queue it to be saved as a JPEG, like CaptureToFile()
+int ScreenToFile(char *Path)
+{
+ struct Frame *F;
+
+ if(!USE_XSHM || (F = EncodeSlot()) == NULL) return -1;
+ if(ScreenGrab(F) < 0)
+ {
+  EncodeRelease(F);
+  return -1;
+ }
+ EncodeQueue(F, Path);
+ if(DEBUG) printf("Screen grab took %.1f ms\n", ScreenGrabMs());
+ return 0;
+}
+
+// Grab a w x h frame from the capture device into a free encoder slot
+// and queue it to be saved as a JPEG in the background. This returns
+// as soon as the frame is copied, the file appears a little later.
+int CaptureToFile(char *Path, int w, int h)
+{
+ struct EncodeStats S;
+ struct Frame *F;
+
+ if((F = EncodeSlot()) == NULL) return -1;
+ if(CaptureGrab(F, 0, 0, w, h) < 0)
+ {
+  EncodeRelease(F);
+  return -1;
+ }
+ EncodeQueue(F, Path);
+ if(DEBUG)
+ {
+  EncodeGetStats(&S);
+  printf("Encode queue %d of %d, %.1f ms per frame, at most %d slots in use%s\n", S.Depth, S.Slots,
+         S.AvgMs, S.MaxInUse, S.Locked ? "" : " (not locked in RAM)");
+ }
+ return 0;
+}
+
+// Copy a w x h frame from the capture device into the raw journal as
+// frame Id. It is encoded later, by FramesToDisk(). Returns -1 if there
+// is no journal or it is full.
+int CaptureToJournal(int Id, int w, int h)
+{
+ struct RawStats S;
+ struct Frame *F;
+
+ if(!RAW_JOURNAL || (F = RawSlot(Id)) == NULL) return -1;
+ if(CaptureGrab(F, 0, 0, w, h) < 0)
+ {
+  RawDiscard(Id);
+  return -1;
+ }
+ if(DEBUG)
+ {
+  RawGetStats(&S);
+  printf("Raw journal %d of %d frames\n", S.Used, S.Slots);
+ }
+ return 0;
+}
+
+// Encode the frames still raw in the journal on the work lane
+void EncodeRaw(void *Arg)
+{
+ *(int *)Arg = RawEncodeAll(TimelinePath, ENCODE_WORKERS + 1);
+}
+
+// Encode the frames still raw in the journal, all cores at once, and
+// wait for the background encoder, so every frame is a file on disk
+void FramesToDisk()
+{
+ struct RawStats S;
+ int n = 0;
+
+ if(RAW_JOURNAL) LaneCall(LANE_WORK, EncodeRaw, &n);
+ if(n > 0 && DEBUG)
+ {
+  RawGetStats(&S);
+  printf("Encoded the raw frames in %.0f ms, %.1f frames per second\n", S.EncodeMs, S.EncodeFps);
+ }
+ EncodeDrain();
+}
+
+// Background encoders run on the work lane's cores
+void AdoptWork()
+{
+ LaneAdopt(LANE_WORK);
 }
 
 // Erase all frames and reset the counters 
 void Restart()
 {
- void SystemFile(char *Command, char *File);
-  
+ struct BlobStats B;
+
  // Initialize the counters
  FrameCount = 0;
  CurrentFrame = -1; 
  CurrentPreview = 0;  
  // Erase all old frames
- SystemFile("rm %s%s", "Frames/*");
+ EncodeDrain();
+ RawClear();
+ TimelineClear();
+ FileEmpty(FULL_PATH "Frames");
+ TimelineSave();
+ BlobCollect();
+ if(DEBUG)
+ {
+  BlobGetStats(&B);
+  printf("Frame store: %ld blobs, %.2fx dedupe, %lld kB saved\n", B.Blobs, B.Ratio, B.Saved / 1024);
+ }
 }
 /*
 // Erase the just current frame. Renumber the remaining framesso that
@@ -396,37 +654,30 @@ void Erase()
 // Camera Handling
 //
 // "libcamera-vid -t 0" allows non-recording real-time video but the
-// process is not readily stopped. So run it as a forked process and
-// stop it as needed with the "kill -kill <pid>" command.
+// process is not readily stopped. So run it as a separate process and
+// stop it as needed through the supervisor.
 //
 ////////////////////////////////////////////////////////////////////////
 
 void StartCamera()
 {
- extern int *Share;   
- char s[128];
-
- // Set up a forked process for the camera
- pid_t pid = fork();
-
- if(pid == 0) // Skip this if it's the parent process
- {
-  // Start the camera as a separate process   
-  sprintf(s, "libcamera-vid -t 0 --width %d --height %d -f", V_WIDE, V_HIGH); 
-  system(s);
-  Share[VIDEO_PID] = getpid(); // Save the camera process pid in shared memory
-  exit(0);  // This does not kill the camera. May not be needed.
- }
+ extern int Helper[];
+ char w[16], h[16];
+ char *Argv[] = { "libcamera-vid", "-t", "0", "--width", w, "--height", h, "-f", NULL };
+
+ if(SuperRunning(Helper[VIDEO_PID])) return;
+ // Start the camera as a separate process
+ sprintf(w, "%d", V_WIDE);
+ sprintf(h, "%d", V_HIGH);
+ Helper[VIDEO_PID] = SuperStart(Argv);
 }    
 
 void KillCamera()
 {
- extern int *Share;      
- 
- char s[64];
- // Build the kill command for the saved pid
- sprintf(s, "kill -kill %d", Share[VIDEO_PID]);
- system(s);
+ extern int Helper[];
+
+ SuperStop(Helper[VIDEO_PID]);
+ Helper[VIDEO_PID] = NO_PID;
 }
 
 ////////////////////////////////////////////////////////////////////////
@@ -437,8 +688,14 @@ void KillCamera()
 
 void PlayVideo(char *Folder)
 {
- void SystemFile(char* Command, char *File); 
-  
+ int  PlayFolder(char *Folder);
+
+ char s[256];
+ char *Feh[] = { "feh", "--quiet", "--hide-pointer", "-F", "-p", "--on-last-slide=quit",
+                 "--slideshow-delay", "0.001", s, NULL };
+
+ sprintf(s, "%s%s", FULL_PATH, Folder);
+ if(USE_PLAYER && PlayFolder(s) == 0) return;
  // feh options are:
  // -F --fullscreen
  // -Z --auto-zoom : zoom to screen size in fullscreen
@@ -449,7 +706,89 @@ void PlayVideo(char *Folder)
  // this just shows the saved animation.
  // system("feh --quiet --hide-pointer  -Z -p --on-last-slide=quit --slideshow-delay 0.001 --recursive");
  // system("feh --quiet --hide-pointer  -Z -p --on-last-slide=quit --slideshow-delay 0.001 /Frames");
- SystemFile("feh --quiet --hide-pointer  -F -p --on-last-slide=quit --slideshow-delay 0.001 %s%s", Folder);
+ SuperRun(Feh);
+}
+
+// Play the current animation in timeline order with the built in
+// player on a full screen window. The play goes on in the background,
+// PlayDone() is called when it ends. Returns -1 if that could not be
+// done.
+int PlayTimeline()
+{
+ void StartPlay(void *Arg);
+
+ extern struct Display *Playing;
+ struct Play P;
+ char s[256];
+ int i;
+
+ memset(&P, 0, sizeof(P));
+ P.N = TimelineCount();
+ if((P.D = DisplayOpen(V_WIDE, V_HIGH)) == NULL) return -1;
+ P.r = -1;
+ if((P.Paths = calloc(P.N + 1, sizeof(char *))) != NULL)
+ {
+  for(i=0; i<P.N; i++) P.Paths[i] = strdup(TimelinePath(TimelineId(i), s));
+  LaneCall(LANE_DISPLAY, StartPlay, &P);
+  for(i=0; i<P.N; i++) free(P.Paths[i]);
+  free(P.Paths);
+ }
+ if(P.r < 0) DisplayClose(P.D);
+ else Playing = P.D;
+ return P.r;
+}
+
+// Play the frames in a folder with the built in player on a full
+// screen window, in the background. Returns -1 if that could not be
+// done.
+int PlayFolder(char *Folder)
+{
+ void StartPlay(void *Arg);
+
+ extern struct Display *Playing;
+ struct Play P;
+
+ memset(&P, 0, sizeof(P));
+ P.Folder = Folder;
+ if((P.D = DisplayOpen(V_WIDE, V_HIGH)) == NULL) return -1;
+ LaneCall(LANE_DISPLAY, StartPlay, &P);
+ if(P.r < 0) DisplayClose(P.D);
+ else Playing = P.D;
+ return P.r;
+}
+
+// Start the player from the display lane, so its threads run on the
+// display lane's cores
+void StartPlay(void *Arg)
+{
+ struct Play *P = Arg;
+
+ if(P->Folder) P->r = PlayerStartDir(P->Folder, PLAY_FPS, P->D);
+ else P->r = PlayerStart(P->Paths, P->N, PLAY_FPS, P->D);
+}
+
+// The player has come to the end or been stopped. Take its window
+// away, which shows the live video again.
+void PlayDone()
+{
+ extern struct Display *Playing;
+ struct PlayerStats S;
+
+ if(PlayerFinish(&S) < 0) return;
+ DisplayClose(Playing);
+ Playing = NULL;
+ if(!DEBUG) return;
+ printf("Played %d of %d frames at %.1f fps (%.0f wanted), jitter %.1f ms, first frame in %.0f ms\n",
+        S.Shown, S.Frames, S.Fps, S.TargetFps, S.JitterMs, S.StartMs);
+ if(S.Stopped) printf("Stopped %.1f ms after the button\n", S.StopMs);
+}
+
+// Stop the video playing, if there is one, and wait for it
+void StopPlaying()
+{
+ if(!PlayerBusy()) return;
+ PlayerCancel();
+ PlayDone();
 }
 
 /*
@@ -458,33 +797,18 @@ void PlayVideo(char *Folder)
 void ShowFrame(char *Frame)
 {
  void KillFrame();   
- int CountFiles(char *Folder);   
     
- extern int *Share;
- char s[128];
+ extern int Helper[];
+ char s[256];
+ char *Argv[] = { "feh", s, NULL };
 
  if(DEBUG) printf("In ShowFrame()\n");
 
- // If there is an active Frame thread, kill it
- if(Share[FRAME_PID] != NO_PID) 
- {
-  if(DEBUG) printf ("Killing frame proc %d\n", Share[FRAME_PID]);
-  KillFrame();
- }
- // Set up a forked process for the camera
- pid_t pid = fork();
-
- if(pid == 0) // Skip this if it's the parent process
- {
-  Share[FRAME_PID] = getpid(); // Save the camera process pid in shared memory   
-  if(DEBUG)printf("Show Frame %s, PID %d\n", Frame, Share[FRAME_PID]);   
-  // Show the frame
-  sprintf(s, "feh %s%s &", FULL_PATH, Frame);
-//  sprintf(s, "convert display -size %dx%d Frames/Frame%05d.jpg &", V_WIDE, V_HIGH, Which);
-if(DEBUG) printf("%s\n",s);
-  system(s);   
-  exit(0);  // May not be needed.
- }
+ // If there is an active Frame viewer, stop it
+ if(Helper[FRAME_PID] != NO_PID) KillFrame();
+ // Show the frame
+ sprintf(s, "%s%s", FULL_PATH, Frame);
+ Helper[FRAME_PID] = SuperStart(Argv);
 }    
 */
 
@@ -494,53 +818,13 @@ if(DEBUG) printf("%s\n",s);
 //
 ////////////////////////////////////////////////////////////////////////
 
-// Function to read a line from a file
-char *GetLine(FILE *f)
-{
- static char s[256];
- int i=0;
- 
- while(!feof(f) && (s[i++] = getc(f)) != '\n');
- s[i] = '\0'; 
-
- return s;
-}
-
-// Kill a process based on the CMD
-void ps_kill(char *p)
-{
- void SystemFile(char *Command, char *File); 
-  
- char r[256], *s, *t;
- FILE *F;
- int id;
- 
- SystemFile("ps a > %s%s", "proc.txt");
- sprintf(r, "%sproc.txt", FULL_PATH); 
- F = fopen(r, "r"); // Open the proc file
- while(!feof(F))
- {
-  s = GetLine(F); // Grab each line of the file
-  t = strchr(s, ':'); // Advance a pointer to the : in the time field
-  if(t != NULL) t = strstr(t, p); // Look for the matching CMD
-  if(t != NULL) // If found
-  {
-   sscanf(s, "%d", &id);          // Get the PID
-   sprintf(r, "kill -kill %d", id);  // Set up the kill string
-   system(r);                    // Kill the process
-   if(DEBUG) printf("Killing %s pid %d\n", p, id);
-  }
- }
- fclose(F);                     // Close the proc.txt file
- sprintf(r, "%sproc.txt", FULL_PATH); 
- system(r);         // Delete the proc.txt file
-}
-
 void Shutdown()
 {
- ps_kill("libcamera-vid");
-// ps_kill("main");   
- sleep(6);
+ void KillCamera();
+
+ LanesStop(); // Let frames being encoded finish
+ KillCamera();
+ SuperStopAll(); // Each stop waits for the helper to exit
  system("sudo halt");
  system("sudo shutdown -h now");
  system("sudo poweroff");
@@ -576,36 +860,3 @@ void ShowPressedButton(int B)
  for(i=0; i<NumButtons; i++) if(Buttons[i] == B)
   printf("Button %s Pressed\n", BText[i]);
 }
-
-int kbhit() {
-    static const int STDIN = 0;
-    static int initialized = 0;
-
-    if (! initialized) {
-        // Use termios to turn off line buffering
-        struct termios term;
-        tcgetattr(STDIN, &term);
-        term.c_lflag &= ~ICANON;
-        tcsetattr(STDIN, TCSANOW, &term);
-        setbuf(stdin, NULL);
-        initialized = 1;
-    }
-
-    int bytesWaiting;
-    ioctl(STDIN, FIONREAD, &bytesWaiting);
-    return bytesWaiting;
-}
-
-// Sends a system command with a file name in the string
-// This ius only needed because realtive file paths, after
-// a system cd command to the folder, seem to be unreliable.
-// The comman arg will have two adhjacent %s in it for the
-// path and name
-void SystemFile(char *Command, char *File)
-{
- char s[256];
-
- sprintf(s, Command, FULL_PATH, File);
- printf("SysFile: %s\n", s);
- system(s);
-}
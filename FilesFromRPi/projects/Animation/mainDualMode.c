@@ -11,14 +11,69 @@
 // the frame files are in the format Framennnnn.jpg where the "nnnnn" is
 // a 5-digit number indicating the sequence number of the frame. The
 // Saved folder contains up to MAX_SAVED saved videos. Each video is
-// contained in its own folder with folders named Videonn with nn being
-// the two digit number of the saved video. Frame files within the each
-// Videonn folder have the same naming as those in the Frames folder.
-// The latest saved video is always in Video00 with all other saved
-// videos having sequentially higher numbers. Videos in excess of
-// MAX_SAVED are deleted. Single frames are about 115 kB meaning 90
+// contained in its own folder, one of MAX_SAVED ring slots named SlotN
+// (see gallery.c). Frame files within each slot have the same naming
+// as those in the Frames folder. Each save takes the next generation
+// number and the slot of the oldest video, and the Saved/Head file
+// holds the generation of the latest one, so saving never renames the
+// other videos. Single frames are about 115 kB meaning 90
 // videos of 100 frames each require 1 GB.
 //
+// The program keeps a catalog of the saved videos in memory (catalog.c)
+// built when it starts and kept current with inotify, so browsing the
+// saved videos does not read the Saved folder each time.
+//
+// With SAVE_PACKED set, a saved video is one file, Video.anim, in its
+// slot (anim.c) rather than a Frame file per frame: a header, an index
+// of where each frame is and how long it shows, then the JPEG frames.
+// It is played and previewed from a memory mapping of the file, with
+// no file lookups per frame. Slots still holding loose frames are
+// packed when the program starts.
+//
+// With RAW_JOURNAL set (and USE_V4L2), RECORD only copies the camera
+// frame into a memory mapped journal file, Session.raw (rawJournal.c).
+// The frames are encoded to JPEG on every core at once when the
+// animation is saved or played, so frames erased before then are
+// never encoded. The viewer shows them straight from the journal.
+//
+// With ONION_LAYERS set (and USE_V4L2) the program draws the live
+// view itself instead of running libcamera-vid, and blends the last
+// ONION_LAYERS frames recorded over it (onion.c), so the animator can
+// see where things were in the frames before.
+//
+// With AUTO_CAPTURE set (and USE_V4L2), RECORD does not take the frame
+// at once. It waits until the camera picture has stopped changing for
+// STILL_MS (motion.c), so the visitor's hand is out of the shot.
+// Pressing RECORD again while it waits takes the frame straight away.
+//
+// Every frame written is also linked into the Blobs folder under the
+// hash of its contents (blobStore.c). A frame identical to one already
+// there, from this session or an earlier one, is replaced with a link
+// to the stored copy, so repeated frames take no more space. Blobs
+// that no frame or saved video links to any more are removed when
+// the frames are cleared and after each save.
+//
+// With DEFLICKER set, a video being saved has the frame to frame
+// brightness drift of the room lights and the camera taken out first
+// (deflicker.c). This works on the saved copy, the frames of the
+// animation being made are left as they were.
+//
+// With USE_LANES set the work is split over lanes of threads kept to
+// cores of their own (lanes.c): the buttons on core 0, the camera and
+// screen grabs on core 1 next to the drawing, and encoding, saving and
+// deflickering on cores 2 and 3, so a save going on does not hold up
+// the buttons or the live view. The gallery, the timeline and the rest
+// of the program's state are only touched on the button thread. A job
+// on another lane hands its result back with a Done() function, which
+// runs there.
+//
+// Each frame recorded gets a perceptual hash (frameHash.c). A frame
+// that is nearly the same picture as the frame before, usually from
+// RECORD pressed twice, is reported or, with DUP_POLICY set to
+// DUP_DROP, erased again. The hashes are kept with the frames and in
+// the packed video, and at start up the saved videos are checked for
+// frames recorded twice.
+//
 // Button Implementation:
 //
 // The GPIO pins are used to read the buttons. Using a positive logic
@@ -28,6 +83,11 @@
 // The GPIO pins are configured with internal pull down resistors so
 // when a button is pressed, the sensing line goes low.
 //
+// The buttons are read through the GPIO character device rather than
+// by polling the pin levels (see input.c). The kernel time stamps
+// every edge and the program sleeps in epoll until a button or key is
+// pressed, so the main loop no longer keeps a core busy.
+//
 // The systme has two modes of operation: creating videos and viewing
 // saved videos. AllButtons are dual function. Five buttons are used for
 // creating videos, four for viewing saved videos and one additional
@@ -117,6 +177,22 @@
 // w and h are the cropped size, x0 y0 is the upper left corner of the 
 // crop. For cropping, the top gray bar in the video viewer is 30 pixels
 //
+// With USE_V4L2 set, frames are instead copied straight out of the
+// V4L2 device CAMERA_DEV and compressed in process (capture.c and
+// encode.c), with no screen shot, temporary file or extra process.
+// Compression runs on worker threads so RECORD returns at once.
+// This needs a camera that libcamera-vid is not holding open, such as
+// a USB camera. For testing, CAMERA_DEV can be the vivid virtual
+// driver or a file of raw YUYV frames. If the capture fails the
+// scrot and convert route is used.
+//
+// Without USE_V4L2 but with USE_XSHM set, the frame is read off the
+// screen in process (screenGrab.c): the X server copies just the
+// PREVIEW_X, PREVIEW_Y rectangle under the title bar into shared
+// memory, and the frame is compressed on the worker threads as a
+// camera frame would be. scrot and convert are only used if that
+// cannot be set up.
+//
 // The feh library is used to play the animation. The one command plays
 // all files in the Frames folder in numerical order
 //
@@ -131,8 +207,33 @@
 // --recursive show subfolders as well. SInce only Frames is a subfolder
 // --quiet to suppress output to the console
 // this just shows the saved animation.
+//
+// With USE_PLAYER set, the built in player (player.c) is used instead.
+// It plays at a steady PLAY_FPS, decoding a few frames ahead, and
+// starts showing frames at once rather than after feh's preload pass.
+// It plays on a thread of its own while the buttons are still read:
+// any button stops it within a frame and then does what it does, and
+// PLAY pressed again only stops it.
+// It draws on an X window when there is an X session, otherwise
+// straight to the HDMI output through DRM/KMS or the frame buffer
+// (display.c), with no tearing. feh is still used if no display can
+// be opened.
+//
+// With USE_VIEWER set, stepping back and forth through the frames
+// draws into one viewer window that stays open, from a cache of
+// decoded frames (frameCache.c). The frames either side of the one
+// shown are decoded in the background, so a step is normally just a
+// copy to the screen. The viewer is hidden again by any other button.
 // 
-// Erasing frames uses the standard linux remove command rm
+// The order of the frames is kept in a timeline (timeline.c), a list
+// of frame IDs saved as Frames/Manifest.txt. Each frame is saved once
+// as Frames/Take<ID>.jpg, so erasing a frame deletes one file and
+// renames nothing. The sequential Frame%05d.jpg names feh and the
+// saved videos use are only made when the frames are exported, which
+// is done as links rather than copies.
+//
+// Erasing frames removes the files directly (fileOps.c), no rm
+// command or shell is run.
 //
 // To hide task bar, in task bar, right clink on "Panel Settings"
 // -> Advanced. Check Minimize panel when not in use
@@ -144,40 +245,61 @@
 // area that shows up. Left click on "Resolution" option in the 
 // drop down menu.
 //
-// This reqiures forked processes to allow the multiple video handlers 
-// to be used. Forked processes are used for the live video feed
-// via libcamera and to play the animation using feh. Both of these 
-// are started via a system() command. When they are started. the
-// getpid() command is used to get the new pid and store it in the
-// shared memory Share[] array. Unfortunately, at least for feh,
-// executing the system command creates a process but that then
-// creates another process whose pid is not retrieveable via getpid()
-// instead, I use the ps command and pipe it to a file then look for
-// feh under the CMD column to find the pid to kill.
-//
-// the ps command (process status) to list all processes and pipe it
-// to proc.txt is:
-//
-// ps a > proc.txt
+// This reqiures separate processes to allow the multiple video
+// handlers to be used. They are used for the live video feed via
+// libcamera and to show frames using feh. Both are started by the
+// supervisor (supervisor.c) with posix_spawn(), so the pid it keeps is
+// the program itself rather than a shell that started it. Each is held
+// by a pidfd, so stopping one signals exactly that process and waits
+// for it to go, without searching the ps listing for its name.
 
 
 ///////////////////////////////////////////////////////////////////////
 
 #include <stdio.h>
 #include <ctype.h>  // for toupper
-#include <termios.h>  
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h> // Needeed for sleep() and usleep()
-#include <bcm2835.h>
-#include <sys/mman.h>
-#include <sys/select.h> // Needed for kbhit()
-#include <sys/ioctl.h> // Needed for kbhit()
-//#include <stropts.h> // Needed for kbhit()
 #include <time.h>
+#include <stdint.h>
+#include <sys/timerfd.h>
+
+#include "input.h"  // Button and keyboard events
+#include "debounce.h" // Press, release, hold and repeat from raw edges
+#include "capture.h"  // Frames straight from the camera
+#include "encode.h"   // In process JPEG compression
+#include "player.h"   // Built in frame player
+#include "decode.h"   // JPEG decoding for display
+#include "frameCache.h" // Decoded frames for stepping through
+#include "timeline.h" // Frame order, kept apart from the file names
+#include "supervisor.h" // Helper programs run and stopped by pidfd
+#include "fileOps.h"    // rm, mv, cp and ls without a shell
+#include "catalog.h"    // Saved videos, kept current by inotify
+#include "gallery.h"    // Ring of saved video slots
+#include "blobStore.h"  // Each distinct frame stored once
+#include "anim.h"       // Saved videos packed in one file
+#include "rawJournal.h" // Frames kept raw until they are needed
+#include "onion.h"      // Last frames blended over the live view
+#include "motion.h"     // Waits for the scene to be still
+#include "frameHash.h"  // Spots a frame recorded twice
+#include "deflicker.h"  // Evens out brightness drift when saving
+#include "screenGrab.h" // The live video read off the screen
+#include "lanes.h"      // Threads pinned to cores for each kind of work
 
 #define DEBUG 1
 #define USE_KBD 1
+#define USE_V4L2 0   // Grab frames from CAMERA_DEV instead of with scrot
+#define USE_XSHM 1   // Otherwise grab the preview off the screen in process
+#define RAW_JOURNAL 0 // With USE_V4L2, keep frames raw until saved or played
+#define ONION_LAYERS 2 // With USE_V4L2, recorded frames shown over the live view
+#define AUTO_CAPTURE 0 // With USE_V4L2, RECORD waits for hands to leave the scene
+#define USE_PLAYER 1 // Play with the built in player instead of feh
+#define USE_VIEWER 1 // Step through frames in a cached viewer, not feh
+#define SAVE_PACKED 1 // Save videos as one ANIM_FILE, not a folder of frames
+#define DUP_POLICY DUP_WARN // What RECORD does with a near copy of the frame before
+#define DEFLICKER 1   // Take the flicker out of videos as they are saved
+#define USE_LANES 1   // Capture, drawing and saving on threads of their own
 
 // Basic defines
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
@@ -191,6 +313,27 @@
 #define FRAME_PID  1
 #define NO_PID    -1
 
+#define CAMERA_DEV "/dev/video0"
+#define PREVIEW_X 0  // Where the live video sits on the screen, below
+#define PREVIEW_Y 30 // the viewer's title bar
+#define RAW_FILE "Session.raw" // The raw frame journal
+#define RAW_MB 512   // Its size, 4 MB holds one 1920x1080 frame
+#define ONION_OPACITY 40 // Percent, for the newest onion skin frame
+#define PREVIEW_FPS 15   // Frame rate of the onion skin preview
+#define STILL_MS 600     // Auto capture: how long the scene must be still
+#define STILL_LEVEL 3    // and the most change per pixel (0-255) that counts
+#define MOTION_FPS 30    // Camera frames looked at per second while waiting
+#define DUP_KEEP 0       // Duplicate policies: keep the frame quietly,
+#define DUP_WARN 1       // keep it but say so,
+#define DUP_DROP 2       // or erase it again
+#define PLAY_FPS 12  // Frame rate of the built in player
+#define LANE_INPUT   0 // Lanes: the buttons and the program's state,
+#define LANE_CAPTURE 1 // the camera, screen grabs and onion skin,
+#define LANE_WORK    2 // encoding, saving and deflickering,
+#define LANE_DISPLAY 3 // and drawing on the screen
+#define EXPORT_DIR "Export" // Frames in order for feh
+#define RECORD_INSERT 1 // Record after the frame on show, not at the end
+
 #define MAX_SAVED 25         // Maximum number of videos saved 
 #define MIN_SAVE_INTERVAL 30 // Minimum time between video saves
 
@@ -203,6 +346,17 @@
 int Buttons[] = { FRAME_BCK, FRAME_FWD, PLAY, RECORD, ERASE, RESTART, SHUTDOWN, SWITCH_MODE };
 // Name the buttons for use in diagnostic messages
 char BText[][32] = { "Back", "Forward" , "Play", "Record", "Erase", "Restart", "Shutdown",  "Mode"};
+// Debounce, hold and repeat times in microseconds for each button.
+// Holding Back or Forward steps through the frames.
+struct ButtonConfig ButtonTiming[] = {
+ { FRAME_BCK,   20000, 500000, 150000 },
+ { FRAME_FWD,   20000, 500000, 150000 },
+ { PLAY,        20000, 0, 0 },
+ { RECORD,      20000, 0, 0 },
+ { ERASE,       20000, 0, 0 },
+ { RESTART,     20000, 0, 0 },
+ { SHUTDOWN,    20000, 0, 0 },
+ { SWITCH_MODE, 20000, 0, 0 } };
     
 // Figure how many buttons are defined
 int NumButtons = sizeof(Buttons)/sizeof(Buttons[0]);
@@ -210,14 +364,83 @@ int FrameCount;     // Keeps count of total frames recorded
 int CurrentFrame;   // Track current frame location
 int CurrentPreview; // Track which video is being previewed
 
-int *Share; // Shared memory to get the camera pid. This allows the
+// Supervisor handles of the helper programs. This allows the
 // Continous video started in StartCamera() to be stopped by KillCamera()
-// Otherwise the live video can't be stopped
+int Helper[] = { NO_PID, NO_PID };
+
+struct Display *Viewer = NULL; // Window used to step through frames
+volatile int ViewerUp = 0;      // The viewer has the screen, not the live view
+struct Display *Preview = NULL; // Live view drawn for the onion skin
+struct Display *Playing = NULL; // Output of the video playing, if any
+int PreviewTimer = -1;
+int WatchTimer = -1;            // Paces the auto capture motion checks
 
 // Last time a button was pressed
 time_t LastPress = 0;
 int Mode = MODE_CREATE;
 
+// The lanes, in LANE_ order: name, threads, cores, SCHED_FIFO priority.
+// The Raspberry Pi has 4 cores.
+struct LaneConfig LaneTable[] = {
+ { "input",   0, 0x1, 30 },
+ { "capture", 1, 0x2, 20 },
+ { "work",    2, 0xC, 0 },
+ { "display", 1, 0x2, 20 } };
+int Saving = 0; // A save is being finished on the work lane
+
+// A frame taken for the animation, see GrabFrame()
+struct Shot
+{
+ int Id, Wide, High;
+ char *Path;
+ uint64_t Hash;
+ int r;
+};
+
+// A camera frame for the motion detector, see WatchTick()
+struct Look
+{
+ struct Frame Live;
+ int Ok;    // Live holds a frame
+ int Busy;  // Queued and not handed back yet
+};
+
+// A video being saved, see SaveVideo()
+struct Save
+{
+ char Dir[256];     // The staging folder
+ int N;             // Frames linked into it
+ uint64_t *Hashes;  // Their perceptual hashes, in order
+ int r;             // Frames saved, or -1
+};
+
+// A video to start playing, see StartPlay()
+struct Play
+{
+ char **Paths;
+ int N;
+ char *Folder;      // Or the frames in here
+ struct Display *D;
+ int r;
+};
+
+// Saved videos to look for duplicate frames in, see ReportDuplicates()
+struct Scan
+{
+ char **Dirs;
+ int *Dups;
+ int N;
+ double Ms;
+};
+
+// A frame for a window, see ShowOn()
+struct Draw
+{
+ struct Display *D;
+ struct Frame *F;
+ int r;
+};
+
 int main()
 {
  void StartCamera();
@@ -241,20 +464,58 @@ int main()
  void PlaySaved();
  void SaveVideo();
 
- int CountFiles(char *Folder);
  void ShowPressedButton(int Button);
+ int  LoadFrame(int n, struct Frame *Out, int Wide, int High);
+ void ReportDuplicates();
+ int  PreviewStart();
+ void WatchStart();
+ void Record();
+ void PlayDone();
+ void StopPlaying();
+ void AdoptWork();
  
  int B;
 
- // Allocate the shared memory for the video camera pid
- Share = mmap(NULL, 32, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
- // Set the PIDs to show not forked processes
- Share[VIDEO_PID] = NO_PID;
- Share[FRAME_PID] = NO_PID;
- 
+ // The lanes come first, so the threads started below can take their
+ // cores
+ if(USE_LANES && LanesStart(LaneTable, sizeof(LaneTable)/sizeof(LaneTable[0])) == 0)
+ {
+  // Done() functions are run from the input loop. Without it every
+  // job is run at once instead, as with no lanes.
+  if(InputAddWatch(LanesFd(), LanesReap) < 0) LanesStop();
+  else EncodeOnStart(AdoptWork);
+ }
+ TimelineLoad("Frames");
+ // Identical frames share one file. Collecting also drops blobs left
+ // over from the last session that nothing refers to any more.
+ if(BlobOpen(BLOB_DIR) == 0) EncodeOnDone(BlobPut);
+ FrameHashOpen("Frames");
+ // Helpers that exit are reaped here, not in a signal handler
+ if(SuperFd() >= 0 && InputAddWatch(SuperFd(), SuperReap) < 0)
+  printf("Helpers that exit will not be reaped\n");
  Restart();        // Initialize values
- InitGPIO();       // Start the BCM2835 library to allow reading the buttons
- StartCamera();    // Turn on the live video
+ InitGPIO();       // Request the button lines to allow reading the buttons
+ if(!USE_V4L2 || !ONION_LAYERS) StartCamera();    // Turn on the live video
+ if(USE_V4L2 && CaptureOpen(CAMERA_DEV, V_WIDE, V_HIGH) < 0) printf("No capture device\n");
+ if(USE_V4L2) EncodeStart(ENCODE_SLOTS, ENCODE_WORKERS, V_WIDE, V_HIGH, FRAME_YUYV);
+ else if(USE_XSHM && ScreenGrabOpen(PREVIEW_X, PREVIEW_Y, V_WIDE, V_HIGH) == 0)
+  EncodeStart(ENCODE_SLOTS, ENCODE_WORKERS, V_WIDE, V_HIGH, FRAME_BGRX);
+ if(USE_V4L2 && RAW_JOURNAL) RawOpen(RAW_FILE, (size_t)RAW_MB << 20, V_WIDE, V_HIGH);
+ // Or draw the live video here, with the onion skin over it
+ if(USE_V4L2 && ONION_LAYERS && PreviewStart() < 0) StartCamera();
+ if(USE_V4L2 && AUTO_CAPTURE) WatchStart();
+ if(USE_VIEWER) FrameCacheInit(CACHE_FRAMES, V_WIDE, V_HIGH, LoadFrame);
+ // List the saved videos once, then follow changes as they happen
+ if(CatalogOpen("Saved") == 0 && InputAddWatch(CatalogFd(), CatalogUpdate) < 0)
+  printf("Saved videos are only looked at again when the gallery is used\n");
+ GalleryOpen("Saved", MAX_SAVED);
+ if(SAVE_PACKED) GalleryPack(1000 / PLAY_FPS);
+ if(DEBUG) ReportDuplicates();
+ // Videos play on the player thread, which says here when it is done
+ if(InputAddWatch(PlayerFd(), PlayDone) < 0)
+  printf("A video that ends stays up until a button is pressed\n");
+ // Every long lived thread is running, the buttons can have core 0
+ if(USE_LANES) LaneAdopt(LANE_INPUT);
 
  system("cd /home/rpi/projects/Animation");
 
@@ -265,12 +526,30 @@ int main()
   {
    ShowPressedButton(B);
    LastPress = time(NULL);             // Reset the inactivity timer 
-// This if is for switching between modes
-//   if(B == SWITCH_MODE) Mode = Mode == MODE_CREATE ? MODE_VIEW : MODE_CREATE; 
-//   if(DEBUG) printf("Mode: %s\n", Mode == MODE_CREATE ? "Create" : "View");
+   // Any button stops a video that is playing. PLAY does nothing else.
+   if(PlayerBusy())
+   {
+    StopPlaying();
+    if(B == PLAY) continue;
+   }
+   // Only stepping through frames keeps the viewer up
+   if(B != FRAME_BCK && B != FRAME_FWD && ViewerUp)
+   {
+    DisplayHide(Viewer);
+    ViewerUp = 0;
+   }
+   // SWITCH_MODE moves between making an animation and looking at the
+   // saved ones. ReadButtons() falls back to MODE_CREATE after
+   // MODE_TIMEOUT seconds with no button pressed.
+   if(B == SWITCH_MODE)
+   {
+    Mode = Mode == MODE_CREATE ? MODE_VIEW : MODE_CREATE;
+    if(DEBUG) printf("Mode: %s\n", Mode == MODE_CREATE ? "Create" : "View");
+    continue;
+   }
 
-//   if(Mode == MODE_CREATE)
-//   { 
+   if(Mode == MODE_CREATE)
+   {
     switch(B)
     {
      ////////////////////////////////////////////////////////////////////
@@ -297,14 +576,14 @@ int main()
      // Play the animations 
      case PLAY      : Play();                                      break;
    
-     // Grab the current image an put it last in the sequence 
-     case RECORD    : GrabFrame(FrameCount, V_WIDE, V_HIGH);       break;
+     // Grab the current image an put it after the current frame, or
+     // last in the sequence
+     case RECORD    : Record();                                    break;
      
      case SHUTDOWN  : Shutdown();                                  break;
     }
-//   }
-// This "else" is for viewing videos
-/*
+   }
+   // Viewing the saved videos
    else
    {
     switch(B)
@@ -325,13 +604,12 @@ int main()
      case FRAME_FWD : CurrentPreview++; ShowPreview();             break;
  
      // Play selected saved video
-    case PLAY       : PlaySaved();                                 break;
+     case PLAY      : PlaySaved();                                 break;
+
+     case SHUTDOWN  : Shutdown();                                  break;
     }
    }
-*/
   }
-//  CheckTimeOut(); // This was only for returning to the record menu
-                    // after inactivity after viewing videos 
  }
  return 1;
 }
@@ -346,63 +624,47 @@ int main()
 // a button press is reaqd as a LOW value. The pins are configured
 // with pull down resistors.
 
-// Initialize the pushbuttons
+// Initialize the pushbuttons. All button lines are requested from the
+// GPIO chip as inputs with pulldown resistors and edge events.
 void InitGPIO()
 {
- int i;
-
- // Initialize the BCM2835 library, used to read button presses here
- if(!bcm2835_init()) printf("No BCM2835\n");    
-
- for(i=0; i<NumButtons; i++)
- {
-  // Configure all button pins as input      
-  bcm2835_gpio_fsel(Buttons[i],BCM2835_GPIO_FSEL_INPT);  
-  // Add pulldown resistors to all pins
-  bcm2835_gpio_set_pud(Buttons[i],BCM2835_GPIO_PUD_DOWN);  
- } 
+ DebounceInit(ButtonTiming, NumButtons);
+ if(InputOpen(GPIO_CHIP, Buttons, NumButtons) < 0) printf("No GPIO chip\n");
+ // The number keys represent the indices in Buttons starting at 1
+ if(USE_KBD) InputAddKeyboard(Buttons, NumButtons);
 }
 
-// A basic button read just looks for the first pressed button in the
-// array. Alternatively, if USE_KBD is pressed, the number keys 
-// represent the indices in Buttons starting at 1
+// Sleep until a button is pressed (or a number key is typed) and
+// return it. The raw edges go through the debouncer so only clean
+// presses and auto repeats come back. Releases and holds are just
+// shown in the DEBUG print along with how late the event was handled.
+// When idle the wait times out after MODE_TIMEOUT seconds so the
+// mode can still fall back to MODE_CREATE when nobody is around.
 int ReadButtons()
 {
- int kbhit();
-
  extern time_t LastPress;  
 
- time_t Now = time(NULL);    // Get the current time
- int i, Found = -1;
-// char c;
+ struct InputEvent In;
+ struct ButtonEvent E;
 
- // bcm2835_gpio_lev(); returns HIGH or LOW
- if(USE_KBD)
+ for(;;)
  {
-  if(!kbhit()) return NO_BUTTON; 
-  printf("Key: %c\n", getchar());
-  return NO_BUTTON; //Button[ c - '1'];
- }
-
- // Query each button in sequence
-
- // Only the first button found is returned but the all buttons are
- // scanned and displayed in the DEBUG print since there have been 
- // lots of issues with false button reads, both from the actual
- // switches and hardware and from Raspberry Pi anomalies.
- for(i=0; i<NumButtons; i++) if(bcm2835_gpio_lev(Buttons[i]) == HIGH)
- {
-//  if(DEBUG) printf("Button %s Pressed\n", BText[i]);
-  if(Found == -1) Found = i; // If it's the first press found, save it
- }
- // If a button has been pressed and at least 1 second has elapsed
- if(Found != -1 && Now - LastPress > 0) 
- {
-  LastPress = Now; // Update the last pressed time to current time
-  return Buttons[Found]; // Send the button info back
+  while(DebounceGet(&E))
+  {
+   if(DEBUG) printf("%s %d at %llu us, %llu us late\n", DebounceName(E.Type), E.Pin,
+                    (unsigned long long)E.TimeUs, (unsigned long long)(InputNow()/1000 - E.TimeUs));
+   if(E.Type == BTN_PRESS || E.Type == BTN_REPEAT) return E.Pin;
+  }
+  // Sleep until the next edge or until the debouncer has something due
+  switch(InputWait(&In, DebounceWaitMs(InputNow()/1000, MODE_TIMEOUT*1000)))
+  {
+   case 1  : DebounceFeed(In.Pin, In.Level, In.TimeNs/1000); break;
+   case 0  : DebounceTick(InputNow()/1000);
+             if(time(NULL) - LastPress > MODE_TIMEOUT) Mode = MODE_CREATE;
+             break;
+   default : return NO_BUTTON;
+  }
  }
- if(Now - LastPress > MODE_TIMEOUT) Mode = MODE_CREATE; 
- return NO_BUTTON;
 }
 
 ///////////////////////////////////////////////////////////////////////
@@ -414,6 +676,8 @@ int ReadButtons()
 void ShowFrameInCurrent(int Frame)
 {
  void ShowFrame(char *Frame); 
+ int  ShowCachedFrame(int n);
+ void FramesToDisk();
   
  extern int FrameCount, CurrentFrame; 
   
@@ -421,11 +685,59 @@ void ShowFrameInCurrent(int Frame)
  // Decrement the frame position with wrap around
  if(CurrentFrame < 0)  CurrentFrame = FrameCount-1;
  if(CurrentFrame >= FrameCount)  CurrentFrame = 0;
+ if(FrameCount == 0) return;
+ if(USE_VIEWER && ShowCachedFrame(CurrentFrame) == 0) return;
  // Build the frame file name
- sprintf(s, "Frames/Frame%05d.jpg", CurrentFrame);
- // Show the frame
+ TimelinePath(TimelineId(CurrentFrame), s);
+ // Show the frame once it has been written
+ FramesToDisk();
  ShowFrame(s);
 }
+// Show frame n in the viewer window from the frame cache, then have
+// the frames either side of it decoded in the background, wrapping
+// around the same way the Back and Forward buttons do. Frames are
+// cached by ID so they stay valid when other frames are erased.
+int ShowCachedFrame(int n)
+{
+ int ShowOn(struct Display *D, struct Frame *F);
+
+ extern int FrameCount;
+ extern struct Display *Viewer;
+ extern volatile int ViewerUp;
+
+ struct CacheStats S;
+ struct Frame *F;
+ int Near[2*CACHE_AHEAD], i, k = 0;
+
+ if(Viewer == NULL && (Viewer = DisplayOpen(V_WIDE, V_HIGH)) == NULL) return -1;
+ EncodeDrain(); // The frame may still be being written
+ if((F = FrameCacheGet(TimelineId(n))) == NULL) return -1;
+ ViewerUp = 1;
+ ShowOn(Viewer, F);
+ for(i=1; i<=CACHE_AHEAD && i<FrameCount; i++)
+ {
+  Near[k++] = TimelineId((n + i) % FrameCount);
+  Near[k++] = TimelineId((n - i + FrameCount) % FrameCount);
+ }
+ FrameCachePrefetch(Near, k);
+ if(DEBUG)
+ {
+  FrameCacheGetStats(&S);
+  printf("Frame %d in %.1f ms, cache hits %ld misses %ld prefetched %ld\n", n, S.LastMs, S.Hits, S.Misses, S.Prefetched);
+ }
+ return 0;
+}
+
+// Frame cache loader: decode the frame with ID Id, or convert it
+// straight from the raw journal if it has not been encoded yet
+int LoadFrame(int Id, struct Frame *Out, int Wide, int High)
+{
+ char s[256];
+
+ if(RAW_JOURNAL && RawLoad(Id, Out, Wide, High) == 0) return 0;
+ return DecodeJpegFile(TimelinePath(Id, s), Out, Wide, High);
+}
+
 /*
  * 
 void ShowPreviousFrame()
@@ -462,87 +774,265 @@ void ShowNextFrame()
  ShowFrame(s);
 }
 */
-// Kill the frame process
+// Stop the frame viewer
 void KillFrame()
 {
- void ps_kill(char *p);   
-    
- extern int *Share; // PIDs are in shared memory     
- 
- char s[64];
- // Build the kill command for the saved pid
- sprintf(s, "kill -kill %d", Share[FRAME_PID]);
- if(DEBUG) printf("Kill command: %s\n", s);
- // Kill the process
- system(s);
- // Now find the feh process and kill that
- ps_kill("feh");
-}
-
-// Playing the recorded video uses the feh routine to play all frames in
-// the Frames folder.
+ extern int Helper[];
+
+ if(DEBUG) printf("Stopping frame viewer\n");
+ SuperStop(Helper[FRAME_PID]);
+ Helper[FRAME_PID] = NO_PID;
+}
+
+// Playing the recorded video uses the built in player on the frames in
+// timeline order. Failing that the frames are exported with sequential
+// names and played with feh.
 void Play()
 {
  void PlayVideo(char *Folder); 
+ int  PlayTimeline();
+ void FramesToDisk();
 
- PlayVideo("Frames");
+ FramesToDisk(); // Make sure every recorded frame is on disk
+ if(USE_PLAYER && PlayTimeline() == 0) return;
+ TimelineExport(EXPORT_DIR);
+ PlayVideo(EXPORT_DIR);
 }
 
-// Add the current view to the animation
+// Add the current view to the animation as frame n. The frames from
+// n on move up one place in the timeline, no files are renamed.
 void GrabFrame(int n, int w, int h)
 {
  void StartCamera();
  void KillCamera();   
+ void TakeShot(void *Arg);
+ void Erase();
 
- char s[256];	
-
+ char s[32], t[256];	
+ char *Scrot[] = { "scrot", "Scrot.jpg", NULL };
+ char *Crop[] = { "convert", "Scrot.jpg", "-crop", s, t, NULL };
+ struct Shot Shot;
+ uint64_t Hash = 0, Prev;
+ int Id;
+
+ // Copy the frame straight from the camera if it is available, or
+ // else straight off the screen, on the capture lane
+ if(n > TimelineCount()) n = TimelineCount();
+ if((Id = TimelineInsert(n)) < 0) return;
+ TimelinePath(Id, t);
+ memset(&Shot, 0, sizeof(Shot));
+ Shot.Id = Id;
+ Shot.Wide = w;
+ Shot.High = h;
+ Shot.Path = t;
+ LaneCall(LANE_CAPTURE, TakeShot, &Shot);
+ Hash = Shot.Hash;
+ if(Shot.r < 0)
+ {
 // KillCamera();	    
 // sprintf(s, "libcamera-jpeg -t 1 -n -o Frames/Frame%05d.jpg --width %d --height %d", n, w, h);
- // Grab a full screen
- system("scrot Scrot.jpg");
- // Crop it and save the result at the Frame n position
- sprintf(s, "convert Scrot.jpg -crop %dx%d+0+30 Frames/Frame%05d.jpg", V_WIDE, V_HIGH, n);
- system(s);
- // Delete the original screen shot
- system("rm Scrot.jpg");
- CurrentFrame++;  // Update the current frame index 
- FrameCount++;    // And the total frame count
+  // Grab a full screen
+  SuperRun(Scrot);
+  // Crop it and save the result at the Frame n position
+  sprintf(s, "%dx%d+0+30", V_WIDE, V_HIGH);
+  SuperRun(Crop);
+  // Delete the original screen shot
+  FileRemove("Scrot.jpg");
+  // Take a frame that never arrived out of the timeline again
+  if(access(t, F_OK) < 0)
+  {
+   printf("Could not grab frame %d\n", n);
+   TimelineErase(n);
+   return;
+  }
+  if(DUP_POLICY != DUP_KEEP) Hash = FrameHashFile(t);
+ }
+ CurrentFrame = n; // The new frame is the current one
+ FrameCount = TimelineCount(); // And the total frame count
  if(DEBUG) printf("Record Frame #%d\n", FrameCount);
 
+ // A frame hardly different from the one before is most likely RECORD
+ // pressed twice
+ if(Hash == 0) return;
+ FrameHashSet(Id, Hash);
+ if(DUP_POLICY == DUP_KEEP || n == 0 || (Prev = FrameHashGet(TimelineId(n - 1))) == 0 ||
+    FrameHashBits(Hash, Prev) > HASH_NEAR) return;
+ printf("Frame %d is the same picture as frame %d (%d bits apart)%s\n", n, n - 1,
+        FrameHashBits(Hash, Prev), DUP_POLICY == DUP_DROP ? ", dropped" : "");
+ if(DUP_POLICY == DUP_DROP)
+ {
+  Erase();
+  CurrentFrame = n - 1;
+ }
+
 // StartCamera();
 // ShowFrame(n);
 }
 
+// Take a frame for GrabFrame(), on the capture lane
+void TakeShot(void *Arg)
+{
+ int  CaptureToFile(char *Path, int Wide, int High, uint64_t *Hash);
+ int  CaptureToJournal(int Id, int Wide, int High, uint64_t *Hash);
+ int  ScreenToFile(char *Path, uint64_t *Hash);
+
+ struct Shot *S = Arg;
+
+ if(!USE_V4L2) S->r = ScreenToFile(S->Path, &S->Hash);
+ else if(CaptureToJournal(S->Id, S->Wide, S->High, &S->Hash) == 0) S->r = 0;
+ else S->r = CaptureToFile(S->Path, S->Wide, S->High, &S->Hash);
+}
+
+// Read the live video off the screen into a free encoder slot and
+// queue it to be saved as a JPEG, like CaptureToFile()
+int ScreenToFile(char *Path, uint64_t *Hash)
+{
+ struct Frame *F;
+
+ if(!USE_XSHM || (F = EncodeSlot()) == NULL) return -1;
+ if(ScreenGrab(F) < 0)
+ {
+  EncodeRelease(F);
+  return -1;
+ }
+ if(DUP_POLICY != DUP_KEEP) *Hash = FrameHash(F);
+ EncodeQueue(F, Path);
+ if(DEBUG) printf("Screen grab took %.1f ms\n", ScreenGrabMs());
+ return 0;
+}
+
+// Grab a w x h frame from the capture device into a free encoder slot
+// and queue it to be saved as a JPEG in the background. This returns
+// as soon as the frame is copied, the file appears a little later.
+// The frame's perceptual hash is put in Hash.
+int CaptureToFile(char *Path, int w, int h, uint64_t *Hash)
+{
+ struct EncodeStats S;
+ struct Frame *F;
+
+ if((F = EncodeSlot()) == NULL) return -1;
+ if(CaptureGrab(F, 0, 0, w, h) < 0)
+ {
+  EncodeRelease(F);
+  return -1;
+ }
+ if(DUP_POLICY != DUP_KEEP) *Hash = FrameHash(F);
+ OnionPush(F);
+ EncodeQueue(F, Path);
+ if(DEBUG)
+ {
+  EncodeGetStats(&S);
+  printf("Encode queue %d of %d, %.1f ms per frame, at most %d slots in use%s\n", S.Depth, S.Slots,
+         S.AvgMs, S.MaxInUse, S.Locked ? "" : " (not locked in RAM)");
+ }
+ return 0;
+}
+
+// Copy a w x h frame from the capture device into the raw journal as
+// frame Id. It is encoded later, by FramesToDisk(). Returns -1 if there
+// is no journal or it is full.
+int CaptureToJournal(int Id, int w, int h, uint64_t *Hash)
+{
+ struct RawStats S;
+ struct Frame *F;
+
+ if(!RAW_JOURNAL || (F = RawSlot(Id)) == NULL) return -1;
+ if(CaptureGrab(F, 0, 0, w, h) < 0)
+ {
+  RawDiscard(Id);
+  return -1;
+ }
+ if(DUP_POLICY != DUP_KEEP) *Hash = FrameHash(F);
+ OnionPush(F);
+ if(DEBUG)
+ {
+  RawGetStats(&S);
+  printf("Raw journal %d of %d frames\n", S.Used, S.Slots);
+ }
+ return 0;
+}
+
+// Encode the frames still raw in the journal on the work lane
+void EncodeRaw(void *Arg)
+{
+ *(int *)Arg = RawEncodeAll(TimelinePath, ENCODE_WORKERS + 1);
+}
+
+// Encode the frames still raw in the journal, all cores at once, and
+// wait for the background encoder, so every frame is a file on disk
+void FramesToDisk()
+{
+ struct RawStats S;
+ int n = 0;
+
+ if(RAW_JOURNAL) LaneCall(LANE_WORK, EncodeRaw, &n);
+ if(n > 0 && DEBUG)
+ {
+  RawGetStats(&S);
+  printf("Encoded the raw frames in %.0f ms, %.1f frames per second\n", S.EncodeMs, S.EncodeFps);
+ }
+ EncodeDrain();
+}
+
+// Background encoders run on the work lane's cores
+void AdoptWork()
+{
+ LaneAdopt(LANE_WORK);
+}
+
+// The onion skin belongs to the capture lane, which blends it
+void ClearOnion(void *Arg)
+{
+ (void)Arg;
+ OnionClear();
+}
+
 // Erase all frames and reset the counters 
 void Restart()
 {
+ void ClearOnion(void *Arg);
+
+ struct BlobStats B;
+
  // Initialize the counters
  FrameCount = 0;
  CurrentFrame = -1; 
  CurrentPreview = 0;  
  // Erase all old frames
- system ("rm Frames/*");
+ EncodeDrain();
+ RawClear();
+ LaneCall(LANE_CAPTURE, ClearOnion, NULL);
+ FrameHashClear();
+ FrameCacheClear();
+ TimelineClear();
+ FileEmpty("Frames");
+ TimelineSave();
+ BlobCollect();
+ if(DEBUG)
+ {
+  BlobGetStats(&B);
+  printf("Frame store: %ld blobs, %.2fx dedupe, %lld kB saved\n", B.Blobs, B.Ratio, B.Saved / 1024);
+ }
 }
 
-// Erase the just current frame. Renumber the remaining framesso that
-// the CurrentFrame increment and decrement will work.
+// Erase the just current frame. Only the timeline changes, the later
+// frames keep their files and simply move up one place in the list.
 void Erase()
 {
+ void ClearOnion(void *Arg);
+
  extern int CurrentFrame, FrameCount;   
- int Dex;
+ int Id;
  char t[256];
 
  if(DEBUG) printf("Erasing Frame %d\n", CurrentFrame);
- sprintf(t, "rm Frames/Frame%05d.jpg", CurrentFrame);
- system(t);
- // With the frame removed, renumber all higher frames
- FrameCount--;
- for(Dex = CurrentFrame; Dex < FrameCount; Dex++)
- {
-  sprintf(t, "mv Frames/Frame%05d.jpg Frames/Frame%05d.jpg", Dex+1, Dex);
-  printf("Rename: %s\n", t);
-  system(t);     
- }
+ if((Id = TimelineErase(CurrentFrame)) < 0) return;
+ FrameCount = TimelineCount();
+ EncodeDrain(); // The frame may still be being written
+ RawDiscard(Id); // Or never have been encoded at all
+ LaneCall(LANE_CAPTURE, ClearOnion, NULL);
+ FileRemove(TimelinePath(Id, t));
+ FrameCacheForget(Id);
 }
 
 ////////////////////////////////////////////////////////////////////////
@@ -550,37 +1040,210 @@ void Erase()
 // Camera Handling
 //
 // "libcamera-vid -t 0" allows non-recording real-time video but the
-// process is not readily stopped. So run it as a forked process and
-// stop it as needed with the "kill -kill <pid>" command.
+// process is not readily stopped. So run it as a separate process and
+// stop it as needed through the supervisor.
 //
 ////////////////////////////////////////////////////////////////////////
 
 void StartCamera()
 {
- extern int *Share;   
- char s[128];
+ extern int Helper[];
+ char w[16], h[16];
+ char *Argv[] = { "libcamera-vid", "-t", "0", "--width", w, "--height", h, NULL };
+
+ if(SuperRunning(Helper[VIDEO_PID])) return;
+ // Start the camera as a separate process
+ sprintf(w, "%d", V_WIDE);
+ sprintf(h, "%d", V_HIGH);
+ Helper[VIDEO_PID] = SuperStart(Argv);
+}    
 
- // Set up a forked process for the camera
- pid_t pid = fork();
+// Show the live camera with the onion skin over it. A timer in the main
+// loop draws a new frame PREVIEW_FPS times a second. This takes the
+// place of libcamera-vid, which cannot draw anything over its preview.
+int PreviewStart()
+{
+ void PreviewTick();
+
+ extern struct Display *Preview;
+ extern int PreviewTimer;
+ struct itimerspec t;
 
- if(pid == 0) // Skip this if it's the parent process
+ if(OnionInit(ONION_LAYERS, ONION_OPACITY, V_WIDE, V_HIGH) < 0) return -1;
+ if((Preview = DisplayOpen(V_WIDE, V_HIGH)) == NULL) return -1;
+ if((PreviewTimer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0)
  {
-  // Start the camera as a separate process   
-  sprintf(s, "libcamera-vid -t 0 --width %d --height %d", V_WIDE, V_HIGH); 
-  system(s);
-  Share[VIDEO_PID] = getpid(); // Save the camera process pid in shared memory
-  exit(0);  // This does not kill the camera. May not be needed.
+  perror("timerfd_create");
+  DisplayClose(Preview);
+  Preview = NULL;
+  return -1;
  }
-}    
+ t.it_interval.tv_sec = 0;
+ t.it_interval.tv_nsec = 1000000000L / PREVIEW_FPS;
+ t.it_value = t.it_interval;
+ timerfd_settime(PreviewTimer, 0, &t, NULL);
+ // Nothing would draw the live view, so libcamera-vid shows it instead
+ if(InputAddWatch(PreviewTimer, PreviewTick) < 0)
+ {
+  close(PreviewTimer);
+  PreviewTimer = -1;
+  DisplayClose(Preview);
+  Preview = NULL;
+  return -1;
+ }
+ if(DEBUG) OnionBenchmark();
+ return 0;
+}
+
+// Draw one frame of the live view. It is grabbed and blended on the
+// capture lane and drawn on the display lane. A tick that comes while
+// the frame before is still on its way is skipped, as are ticks while
+// the player or the viewer has the screen, since on DRM showing the
+// live view would take the screen back from them.
+void PreviewTick()
+{
+ void DrawLive(void *Arg);
+
+ extern int PreviewTimer;
+ extern volatile int ViewerUp;
+ static struct Frame F[2]; // Live, and as shown
+ uint64_t Ticks;
+
+ if(read(PreviewTimer, &Ticks, sizeof(Ticks)) < 0) return;
+ if(PlayerBusy() || ViewerUp) return;
+ if(LaneDepth(LANE_CAPTURE) > 0) return;
+ if(F[0].Pixels == NULL) F[0].Pixels = malloc((size_t)V_WIDE * V_HIGH * 2);
+ if(F[1].Pixels == NULL) F[1].Pixels = malloc((size_t)V_WIDE * V_HIGH * 4);
+ if(F[0].Pixels == NULL || F[1].Pixels == NULL) return;
+ LaneRun(LANE_CAPTURE, DrawLive, F, NULL);
+}
+
+// Grab a camera frame, put the onion skin over it and draw it, on the
+// capture lane
+void DrawLive(void *Arg)
+{
+ void DrawLiveJob(void *Arg);
+
+ extern struct Display *Preview;
+ struct Frame *F = Arg;
+ struct Draw J = { Preview, &F[1], -1 };
+
+ if(CaptureGrab(&F[0], 0, 0, V_WIDE, V_HIGH) < 0) return;
+ OnionApply(&F[0]);
+ if(DecodeYuyv(&F[0], &F[1], V_WIDE, V_HIGH) == 0) LaneCall(LANE_DISPLAY, DrawLiveJob, &J);
+}
+
+// A live frame that reaches the display lane after the viewer took the
+// screen is dropped. ViewerUp is set before the viewer's frame is
+// queued, so this sees it for any live frame queued behind that one.
+void DrawLiveJob(void *Arg)
+{
+ void DrawJob(void *Arg);
+
+ extern volatile int ViewerUp;
+
+ if(!ViewerUp) DrawJob(Arg);
+}
+
+// Set up auto capture: the motion detector and the timer that feeds it
+// camera frames while it is armed
+void WatchStart()
+{
+ void WatchTick();
+
+ extern int WatchTimer;
+
+ if(MotionInit(V_WIDE, V_HIGH) < 0) return;
+ if((WatchTimer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0)
+ {
+  perror("timerfd_create");
+  return;
+ }
+ // Without the timer RECORD takes the frame at once
+ if(InputAddWatch(WatchTimer, WatchTick) < 0)
+ {
+  close(WatchTimer);
+  WatchTimer = -1;
+ }
+}
+
+static void SetWatch(int On)
+{
+ extern int WatchTimer;
+ struct itimerspec t;
+
+ memset(&t, 0, sizeof(t));
+ if(On) t.it_interval.tv_nsec = 1000000000L / MOTION_FPS;
+ t.it_value = t.it_interval;
+ timerfd_settime(WatchTimer, 0, &t, NULL);
+}
+
+// RECORD takes a frame, or with auto capture waits for the scene to be
+// still first. Pressing RECORD again while waiting takes it at once.
+void Record()
+{
+ extern int WatchTimer;
+
+ if(!USE_V4L2 || !AUTO_CAPTURE || WatchTimer < 0 || MotionArmed())
+ {
+  MotionDisarm();
+  if(WatchTimer >= 0) SetWatch(0);
+  GrabFrame(RECORD_INSERT ? CurrentFrame + 1 : FrameCount, V_WIDE, V_HIGH);
+  return;
+ }
+ if(DEBUG) printf("Waiting for the scene to be still\n");
+ MotionArm(STILL_MS, STILL_LEVEL);
+ SetWatch(1);
+}
+
+// Look at one camera frame while auto capture is armed. The frame is
+// grabbed on the capture lane and looked at by WatchFeed() back here.
+void WatchTick()
+{
+ void WatchGrab(void *Arg);
+ void WatchFeed(void *Arg);
+
+ extern int WatchTimer;
+ static struct Look L;
+ uint64_t Ticks;
+
+ if(read(WatchTimer, &Ticks, sizeof(Ticks)) < 0) return;
+ if(L.Busy || !MotionArmed()) return;
+ if(L.Live.Pixels == NULL && (L.Live.Pixels = malloc((size_t)V_WIDE * V_HIGH * 2)) == NULL) return;
+ L.Busy = 1;
+ if(LaneRun(LANE_CAPTURE, WatchGrab, &L, WatchFeed) < 0) L.Busy = 0;
+}
+
+void WatchGrab(void *Arg)
+{
+ struct Look *L = Arg;
+
+ L->Ok = CaptureGrab(&L->Live, 0, 0, V_WIDE, V_HIGH) == 0;
+}
+
+void WatchFeed(void *Arg)
+{
+ struct Look *L = Arg;
+ struct MotionStats S;
+
+ L->Busy = 0;
+ if(!L->Ok || !MotionArmed() || MotionFeed(&L->Live) == 0) return;
+ SetWatch(0);
+ if(DEBUG)
+ {
+  MotionGetStats(&S);
+  printf("Still for %.0f ms after %ld frames (peak change %.1f, %.2f ms a frame)\n",
+         S.StillMs, S.Frames, S.MaxLevel, S.LastMs);
+ }
+ GrabFrame(RECORD_INSERT ? CurrentFrame + 1 : FrameCount, V_WIDE, V_HIGH);
+}
 
 void KillCamera()
 {
- extern int *Share;      
- 
- char s[64];
- // Build the kill command for the saved pid
- sprintf(s, "kill -kill %d", Share[VIDEO_PID]);
- system(s);
+ extern int Helper[];
+
+ SuperStop(Helper[VIDEO_PID]);
+ Helper[VIDEO_PID] = NO_PID;
 }
 
 ////////////////////////////////////////////////////////////////////////
@@ -591,18 +1254,32 @@ void KillCamera()
 
 void ShowPreview()
 {
- int CountFiles(char *Folder);
  void ShowFrame(char *Frame);
+ int  ShowPackedFrame(char *Path);
 
  extern int CurrentPreview;
  // See how many saved videos there are
- int Count = CountFiles("Saved");
- char s[128];
+ int Count = GalleryCount();
+ struct SavedVideo *V;
+ char s[128], Dir[80];
  
+ if(Count == 0) return;
  if(CurrentPreview < 0) CurrentPreview = Count-1;
  if(CurrentPreview >= Count) CurrentPreview = 0;
  
- sprintf(s, "Saved/Video%02d/Frame00000.jpg", CurrentPreview);
+ // CurrentPreview 0 is the newest video. The gallery is looked at
+ // again here, and a video removed meanwhile leaves nothing to show.
+ if((V = GalleryNewest(CurrentPreview)) == NULL) return;
+ snprintf(Dir, sizeof(Dir), "Saved/%s", V->Name);
+ sprintf(s, "%s/%s", Dir, ANIM_FILE);
+ if(SAVE_PACKED && ShowPackedFrame(s) == 0) return;
+ // feh cannot read a packed video, and it has no loose frames
+ if(access(s, F_OK) == 0)
+ {
+  printf("Could not show %s\n", s);
+  return;
+ }
+ sprintf(s, "%s/Frame00000.jpg", Dir);
  ShowFrame(s);  
 }
 
@@ -612,47 +1289,114 @@ void PlaySaved()
   
  extern int CurrentPreview;
  
+ struct SavedVideo *V = GalleryNewest(CurrentPreview);
  char s[128]; 
   
- sprintf(s, "Saved/Video%02d", CurrentPreview); 
+ if(V == NULL) return;
+ sprintf(s, "Saved/%s", V->Name); 
  PlayVideo(s); 
 }
  
 void SaveVideo()
 {
- int CountFiles(char* Folder); 
- 
+ void FramesToDisk();
+ void SaveStaged(void *Arg);
+ void FinishSave(void *Arg);
+
+ extern int Saving;
  static time_t LastSave = 0;
  time_t ThisTime = time(NULL);
+ struct Save *S;
  int i;
- char Cmd[128];
 
+ if(Saving)
+ {
+  printf("Still saving the last video\n");
+  return;
+ }
  if(ThisTime - LastSave < MIN_SAVE_INTERVAL && !DEBUG) return;
+ // A save takes the oldest video's slot, so saving nothing would only
+ // lose a video
+ if(TimelineCount() == 0) return;
  LastSave = ThisTime;
+ if((S = calloc(1, sizeof(*S))) == NULL) return;
+
+ FramesToDisk(); // All frames must be on disk before they are copied
+ // Link the frames in timeline order into the staging folder and note
+ // their hashes. The animation can then go on changing while the work
+ // lane packs the copy into one file or leaves it under sequential
+ // names, and it is published as the newest video. Only the oldest
+ // video, whose slot it takes, is touched.
+ S->N = TimelineCount();
+ if(TimelineExport(GalleryStage(S->Dir)) < 0 || (S->Hashes = calloc(S->N + 1, sizeof(*S->Hashes))) == NULL)
+ {
+  free(S);
+  return;
+ }
+ for(i=0; i<S->N; i++) S->Hashes[i] = FrameHashGet(TimelineId(i));
+ Saving = 1;
+ if(LaneRun(LANE_WORK, SaveStaged, S, FinishSave) < 0) FinishSave(S);
+}
 
- // See how many saved videos there are
- int Count = CountFiles("Saved");
- if(DEBUG) printf("%d Saved Videos found\n", Count);
+// Finish the video staged by SaveVideo(), on the work lane
+void SaveStaged(void *Arg)
+{
+ int PackStaged(char *Dir, int N, uint64_t *Hashes);
 
- // Move all existing videos up one slot  
- for(i=Count; i>0; i--)
+ struct Save *S = Arg;
+ struct DeflickerStats D;
+ char s[300];
+ int i;
+
+ S->r = S->N;
+ // Deflickering writes every frame again, so it is done on the links
+ // in the staging folder, which are packed afterwards
+ if(DEFLICKER && DeflickerDir(S->Dir, DEFLICKER_RADIUS, 0) < 0) S->r = -1;
+ else if(SAVE_PACKED) S->r = PackStaged(S->Dir, S->N, S->Hashes);
+ // Kept as loose frames, the new files go in the frame store, so a
+ // frame that comes out the same as in an earlier save shares its blob
+ else if(DEFLICKER)
+  for(i=0; i<S->N; i++)
+  {
+   snprintf(s, sizeof(s), "%s/Frame%05d.jpg", S->Dir, i);
+   BlobPut(s);
+  }
+ if(DEFLICKER && DEBUG)
  {
-  sprintf(Cmd, "mv Saved/Video%02d Video%02d", i-1, i); 
-  printf("Cmd: %s\n", Cmd);
-  system(Cmd);
+  DeflickerGetStats(&D);
+  printf("Deflickered %d frames (%d failed) in %.0f + %.0f ms, levels moved by up to %d\n",
+         D.Frames, D.Failed, D.HistMs, D.ApplyMs, D.MaxShift);
  }
+}
+
+// Publish the finished video, back on the button thread
+void FinishSave(void *Arg)
+{
+ void ReportLanes();
+
+ extern int Saving, CurrentPreview;
+ struct Save *S = Arg;
+ struct BlobStats B;
+ long Gen;
 
- // If the limit has been reached, delete the oldest file
- if(Count == MAX_SAVED)
+ Saving = 0;
+ if(S->r >= 0 && (Gen = GalleryPublish()) >= 0)
  {
-  sprintf(Cmd, "rm Saved/Video%02d", MAX_SAVED); 
-  system(Cmd); 
+  // Every video is now one older, browse from the new one
+  CurrentPreview = 0;
+  // The video whose slot was reused may have held the last links to
+  // some frames
+  BlobCollect();
+  if(DEBUG)
+  {
+   BlobGetStats(&B);
+   printf("Saved video %ld (%d frames), %d saved videos\n", Gen, S->r, GalleryCount());
+   printf("Frame store: %ld blobs, %.2fx dedupe, %lld kB saved\n", B.Blobs, B.Ratio, B.Saved / 1024);
+   ReportLanes();
+  }
  }
- // Save the new video as Video00 
- // The mv command should work as well but it places the Frames
- // folder, not just the files into the Video00 folder so
- // use rsync instead.
- system("rsync -a Frames/ Saved/Video00/");
+ free(S->Hashes);
+ free(S);
 }
 
 ////////////////////////////////////////////////////////////////////////
@@ -663,7 +1407,20 @@ void SaveVideo()
 
 void PlayVideo(char *Folder)
 {
- char s[128];
+ int PlayFolder(char *Folder);
+
+ char *Feh[] = { "feh", "--quiet", "--hide-pointer", "-Z", "-p", "--on-last-slide=quit",
+                 "--slideshow-delay", "0.001", Folder, NULL };
+ char s[280];
+
+ if(USE_PLAYER && PlayFolder(Folder) == 0) return;
+ // Only the built in player can play a packed video
+ snprintf(s, sizeof(s), "%s/%s", Folder, ANIM_FILE);
+ if(access(s, F_OK) == 0)
+ {
+  printf("Could not play %s\n", s);
+  return;
+ }
  // feh options are:
  // -F --fullscreen
  // -Z --auto-zoom : zoom to screen size in fullscreen
@@ -674,118 +1431,261 @@ void PlayVideo(char *Folder)
  // this just shows the saved animation.
  // system("feh --quiet --hide-pointer  -Z -p --on-last-slide=quit --slideshow-delay 0.001 --recursive");
  // system("feh --quiet --hide-pointer  -Z -p --on-last-slide=quit --slideshow-delay 0.001 /Frames");
- sprintf(s, "feh --quiet --hide-pointer  -Z -p --on-last-slide=quit --slideshow-delay 0.001 %s", Folder);
- system(s);
+ SuperRun(Feh);
 }
 
-// Display a saved frame. This checks for an existing frame thread
-// and kills it then restarts the thread to show the frame.
-void ShowFrame(char *Frame)
+// Play the current animation in timeline order with the built in
+// player on a full screen window. Returns -1 if that could not be done.
+int PlayTimeline()
 {
- void KillFrame();   
- int CountFiles(char *Folder);   
-    
- extern int *Share;
- char s[128];
+ void StartPlay(void *Arg);
 
- if(DEBUG) printf("In ShowFrame()\n");
+ extern struct Display *Playing;
+ struct Play P;
+ char s[256];
+ int i;
+
+ memset(&P, 0, sizeof(P));
+ P.N = TimelineCount();
+ if((P.D = DisplayOpen(V_WIDE, V_HIGH)) == NULL) return -1;
+ P.r = -1;
+ if((P.Paths = calloc(P.N + 1, sizeof(char *))) != NULL)
+ {
+  for(i=0; i<P.N; i++) P.Paths[i] = strdup(TimelinePath(TimelineId(i), s));
+  LaneCall(LANE_DISPLAY, StartPlay, &P);
+  for(i=0; i<P.N; i++) free(P.Paths[i]);
+  free(P.Paths);
+ }
+ if(P.r < 0) DisplayClose(P.D);
+ else Playing = P.D;
+ return P.r;
+}
+
+// Start the player from the display lane, so its threads run on the
+// display lane's cores
+void StartPlay(void *Arg)
+{
+ struct Play *P = Arg;
+
+ if(P->Folder) P->r = PlayerStartDir(P->Folder, PLAY_FPS, P->D);
+ else P->r = PlayerStart(P->Paths, P->N, PLAY_FPS, P->D);
+}
 
- // If there is an active Frame thread, kill it
- if(Share[FRAME_PID] != NO_PID) 
+// Draw F on D. All drawing is done on the display lane.
+void DrawJob(void *Arg)
+{
+ struct Draw *J = Arg;
+
+ J->r = J->D->Show(J->D, J->F);
+}
+
+int ShowOn(struct Display *D, struct Frame *F)
+{
+ struct Draw J = { D, F, -1 };
+
+ LaneCall(LANE_DISPLAY, DrawJob, &J);
+ return J.r;
+}
+
+// Pack the N frames exported to Dir, with their hashes, into
+// Dir/ANIM_FILE and remove them once packed. Returns the number of
+// frames packed or -1.
+int PackStaged(char *Dir, int N, uint64_t *Hashes)
+{
+ char **Paths, s[280];
+ int i, r = -1;
+
+ if((Paths = calloc(N + 1, sizeof(char *))) == NULL) return -1;
+ for(i=0; i<N; i++)
  {
-  if(DEBUG) printf ("Killing frame proc %d\n", Share[FRAME_PID]);
-  KillFrame();
+  snprintf(s, sizeof(s), "%s/Frame%05d.jpg", Dir, i);
+  if((Paths[i] = strdup(s)) == NULL) break;
  }
- // Set up a forked process for the camera
- pid_t pid = fork();
+ snprintf(s, sizeof(s), "%s/%s", Dir, ANIM_FILE);
+ if(i == N) r = AnimWrite(s, Paths, Hashes, N, 1000 / PLAY_FPS);
+ for(i=0; i<N; i++)
+ {
+  if(r >= 0) FileRemove(Paths[i]);
+  free(Paths[i]);
+ }
+ free(Paths);
+ return r;
+}
 
- if(pid == 0) // Skip this if it's the parent process
+// List the saved videos that have frames recorded twice, looking at
+// several videos at once on the work lane
+void ReportDuplicates()
+{
+ void ScanJob(void *Arg);
+ void ScanDone(void *Arg);
+
+ struct SavedVideo *V;
+ struct Scan *S;
+ int i, N = CatalogCount();
+
+ if((S = calloc(1, sizeof(*S))) == NULL) return;
+ S->N = N;
+ S->Dirs = calloc(N + 1, sizeof(char *));
+ S->Dups = calloc(N + 1, sizeof(int));
+ for(i=0; S->Dirs && S->Dups && i<N; i++)
  {
-  Share[FRAME_PID] = getpid(); // Save the camera process pid in shared memory   
-  if(DEBUG)printf("Show Frame %s, PID %d\n", Frame, Share[FRAME_PID]);   
-  // Show the frame
-  sprintf(s, "feh %s &", Frame);
-//  sprintf(s, "convert display -size %dx%d Frames/Frame%05d.jpg &", V_WIDE, V_HIGH, Which);
-if(DEBUG) printf("%s\n",s);
-  system(s);   
-  exit(0);  // May not be needed.
+  V = CatalogGet(i);
+  if((S->Dirs[i] = malloc(strlen(V->Name) + 8)) == NULL) break;
+  sprintf(S->Dirs[i], "Saved/%s", V->Name);
  }
-}    
+ if(!S->Dirs || !S->Dups || i < N || LaneRun(LANE_WORK, ScanJob, S, ScanDone) < 0)
+ {
+  S->N = -1; // Nothing to report
+  ScanDone(S);
+ }
+}
 
-////////////////////////////////////////////////////////////////////////
-//
-// Utility functions
-//
-////////////////////////////////////////////////////////////////////////
+void ScanJob(void *Arg)
+{
+ struct Scan *S = Arg;
+ struct timespec t0, t1;
 
-// Function to read a line from a file
-char *GetLine(FILE *f)
+ clock_gettime(CLOCK_MONOTONIC, &t0);
+ FrameHashScan(S->Dirs, S->N, ENCODE_WORKERS + 1, S->Dups);
+ clock_gettime(CLOCK_MONOTONIC, &t1);
+ S->Ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+}
+
+void ScanDone(void *Arg)
 {
- static char s[256];
- int i=0;
- 
- while(!feof(f) && (s[i++] = getc(f)) != '\n');
- s[i] = '\0'; 
+ struct Scan *S = Arg;
+ int i;
 
- return s;
+ for(i=0; i<S->N; i++) if(S->Dups[i] > 0) printf("%s has %d frames recorded twice\n", S->Dirs[i], S->Dups[i]);
+ if(S->N >= 0) printf("Looked for duplicate frames in %d saved videos in %.0f ms\n", S->N, S->Ms);
+ for(i=0; S->Dirs && S->Dirs[i]; i++) free(S->Dirs[i]);
+ free(S->Dirs);
+ free(S->Dups);
+ free(S);
 }
 
-// Kill a process based on the CMD
-void ps_kill(char *p)
+// Print how busy each lane has been
+void ReportLanes()
 {
- char r[80], *s, *t;
- FILE *F;
- int id;
- 
- system("ps a > proc.txt"); // Send proc info the proc.txt
- F = fopen("proc.txt", "r"); // Open the proc file
- while(!feof(F))
- {
-  s = GetLine(F); // Grab each line of the file
-  t = strchr(s, ':'); // Advance a pointer to the : in the time field
-  if(t != NULL) t = strstr(t, p); // Look for the matching CMD
-  if(t != NULL) // If found
-  {
-   sscanf(s, "%d", &id);          // Get the PID
-   sprintf(r, "kill -kill %d", id);  // Set up the kill string
-   system(r);                    // Kill the process
-   if(DEBUG) printf("Killing %s pid %d\n", p, id);
-  }
+ struct LaneStats S;
+ int i;
+
+ for(i=0; USE_LANES && i<(int)(sizeof(LaneTable)/sizeof(LaneTable[0])); i++)
+ {
+  LaneGetStats(i, &S);
+  printf("Lane %-7s %4.1f%% busy, %ld jobs (%ld stolen, %ld dropped), %d waiting, at most %d\n",
+         LaneName(i), S.Util * 100, S.Jobs, S.Stolen, S.Dropped, S.Depth, S.MaxDepth);
  }
- fclose(F);                     // Close the proc.txt file
- system("rm proc.txt");         // Delete the proc.txt file
 }
 
+// Show the first frame of a packed video in the viewer window, decoded
+// straight from the mapped file. Returns -1 if that could not be done.
+int ShowPackedFrame(char *Path)
+{
+ void KillFrame();
+ int  ShowOn(struct Display *D, struct Frame *F);
+
+ extern struct Display *Viewer;
+ extern volatile int ViewerUp;
+ extern int Helper[];
+ static struct Frame F;
+ struct Anim A;
+ unsigned char *Data;
+ size_t Len;
+ int r = -1;
+
+ if(Viewer == NULL && (Viewer = DisplayOpen(V_WIDE, V_HIGH)) == NULL) return -1;
+ if(F.Pixels == NULL && (F.Pixels = malloc((size_t)V_WIDE * V_HIGH * 4)) == NULL) return -1;
+ if(AnimOpen(Path, &A) < 0) return -1;
+ if((Data = AnimFrame(&A, 0, &Len)) != NULL && DecodeJpegMem(Data, Len, &F, V_WIDE, V_HIGH) == 0)
+ {
+  if(Helper[FRAME_PID] != NO_PID) KillFrame();
+  ViewerUp = 1;
+  r = ShowOn(Viewer, &F);
+ }
+ AnimClose(&A);
+ return r;
+}
+
+// Play the frames in a folder with the built in player on a full
+// screen window. Returns -1 if that could not be done.
+int PlayFolder(char *Folder)
+{
+ void StartPlay(void *Arg);
+
+ extern struct Display *Playing;
+ struct Play P;
+
+ memset(&P, 0, sizeof(P));
+ P.Folder = Folder;
+ if((P.D = DisplayOpen(V_WIDE, V_HIGH)) == NULL) return -1;
+ LaneCall(LANE_DISPLAY, StartPlay, &P);
+ if(P.r < 0) DisplayClose(P.D);
+ else Playing = P.D;
+ return P.r;
+}
+
+// The player has come to the end or been stopped. Take its window
+// away, which shows the live video again.
+void PlayDone()
+{
+ extern struct Display *Playing;
+ struct PlayerStats S;
+
+ if(PlayerFinish(&S) < 0) return;
+ DisplayClose(Playing);
+ Playing = NULL;
+ if(!DEBUG) return;
+ printf("Played %d of %d frames at %.1f fps (%.0f wanted), jitter %.1f ms, first frame in %.0f ms\n",
+        S.Shown, S.Frames, S.Fps, S.TargetFps, S.JitterMs, S.StartMs);
+ if(S.Stopped) printf("Stopped %.1f ms after the button\n", S.StopMs);
+}
+
+// Stop the video playing, if there is one, and wait for it
+void StopPlaying()
+{
+ if(!PlayerBusy()) return;
+ PlayerCancel();
+ PlayDone();
+}
+
+// Display a saved frame. This checks for an existing frame thread
+// and kills it then restarts the thread to show the frame.
+void ShowFrame(char *Frame)
+{
+ void KillFrame();   
+    
+ extern int Helper[];
+ char *Argv[] = { "feh", Frame, NULL };
+
+ if(DEBUG) printf("In ShowFrame()\n");
+
+ // If there is an active Frame viewer, stop it
+ if(Helper[FRAME_PID] != NO_PID) KillFrame();
+ // Show the frame
+//  sprintf(s, "convert display -size %dx%d Frames/Frame%05d.jpg &", V_WIDE, V_HIGH, Which);
+ Helper[FRAME_PID] = SuperStart(Argv);
+ if(DEBUG) printf("Show Frame %s, handle %d\n", Frame, Helper[FRAME_PID]);
+}    
+
+////////////////////////////////////////////////////////////////////////
+//
+// Utility functions
+//
+////////////////////////////////////////////////////////////////////////
+
 void Shutdown()
 {
- ps_kill("libcamera-vid");
-// ps_kill("main");   
- sleep(6);
+ void KillCamera();
+
+ LanesStop(); // Let a save that is going on finish
+ KillCamera();
+ SuperStopAll(); // Each stop waits for the helper to exit
  system("sudo halt");
  system("sudo shutdown -h now");
  system("sudo poweroff");
 }
 
-// Return the count of the number of files in a folder
-// Here used in managing the Saved folder
-int CountFiles(char *Folder)
-{
- int Count;
- FILE *F;
- char s[80];
- 
- if(DEBUG) printf("Counting Files in %s\n", Folder);
- // Create the counting command, sending the 
- // result to Count.txt
- sprintf(s, "ls %s -1 | wc -l > Count.txt", Folder);
- system(s);                   // Execute it.
- F = fopen("Count.txt", "r"); // Open the Count file
- fscanf(F, "%d", &Count);     // Read the value into Count
- fclose(F);                   // Close Count.txt
-// system("rm Count.txt");      // Delete Count.txt
- return Count;
-} 
-
 void CheckTimeOut()
 {
  time_t Now = time(NULL);
@@ -801,21 +1701,3 @@ void ShowPressedButton(int B)
   printf("Button %s Pressed\n", BText[i]);
 }
 
-int kbhit() {
-    static const int STDIN = 0;
-    static int initialized = 0;
-
-    if (! initialized) {
-        // Use termios to turn off line buffering
-        struct termios term;
-        tcgetattr(STDIN, &term);
-        term.c_lflag &= ~ICANON;
-        tcsetattr(STDIN, TCSANOW, &term);
-        setbuf(stdin, NULL);
-        initialized = 1;
-    }
-
-    int bytesWaiting;
-    ioctl(STDIN, FIONREAD, &bytesWaiting);
-    return bytesWaiting;
-}
@@ -0,0 +1,182 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Stillness detector for auto capture. See motion.h
+//
+///////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "motion.h"
+
+static unsigned char *Plane[2]; // This frame's and the last frame's luma
+static int PlaneWide, PlaneHigh, Have = 0;
+static int Armed = 0, StillFor, StillLevel;
+static double StillSince;       // When the scene last moved
+static struct MotionStats Stats;
+
+static double Ms()
+{
+ struct timespec t;
+
+ clock_gettime(CLOCK_MONOTONIC, &t);
+ return t.tv_sec * 1000.0 + t.tv_nsec / 1e6;
+}
+
+#if defined(__ARM_NEON)
+unsigned long MotionSad(const unsigned char *a, const unsigned char *b, size_t N)
+{
+ uint32x4_t Sum = vdupq_n_u32(0);
+ unsigned long r;
+ size_t i;
+
+ for(i=0; i+16<=N; i+=16)
+  Sum = vpadalq_u16(Sum, vpaddlq_u8(vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i))));
+ r = vgetq_lane_u32(Sum, 0) + vgetq_lane_u32(Sum, 1) + vgetq_lane_u32(Sum, 2) + vgetq_lane_u32(Sum, 3);
+ for(; i<N; i++) r += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+ return r;
+}
+#elif defined(__SSE2__)
+unsigned long MotionSad(const unsigned char *a, const unsigned char *b, size_t N)
+{
+ __m128i Sum = _mm_setzero_si128();
+ unsigned long r;
+ size_t i;
+
+ for(i=0; i+16<=N; i+=16)
+  Sum = _mm_add_epi64(Sum, _mm_sad_epu8(_mm_loadu_si128((const __m128i *)(a + i)),
+                                        _mm_loadu_si128((const __m128i *)(b + i))));
+ r = _mm_cvtsi128_si32(Sum) + _mm_cvtsi128_si32(_mm_srli_si128(Sum, 8));
+ for(; i<N; i++) r += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+ return r;
+}
+#else
+unsigned long MotionSad(const unsigned char *a, const unsigned char *b, size_t N)
+{
+ unsigned long r = 0;
+ size_t i;
+
+ for(i=0; i<N; i++) r += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+ return r;
+}
+#endif
+
+int MotionInit(int Wide, int High)
+{
+ PlaneWide = Wide / MOTION_SCALE;
+ PlaneHigh = High / MOTION_SCALE;
+ Plane[0] = malloc((size_t)PlaneWide * PlaneHigh);
+ Plane[1] = malloc((size_t)PlaneWide * PlaneHigh);
+ if(Plane[0] == NULL || Plane[1] == NULL || PlaneWide == 0 || PlaneHigh == 0)
+ {
+  printf("Could not start the motion detector\n");
+  free(Plane[0]);
+  free(Plane[1]);
+  Plane[0] = Plane[1] = NULL;
+  return -1;
+ }
+ return 0;
+}
+
+void MotionArm(int StillMs, int Level)
+{
+ StillFor = StillMs;
+ StillLevel = Level;
+ Have = 0;
+ memset(&Stats, 0, sizeof(Stats));
+ Armed = Plane[0] != NULL;
+}
+
+void MotionDisarm() { Armed = 0; }
+int  MotionArmed() { return Armed; }
+
+// Shrink the Y samples of a YUYV frame to one byte per
+// MOTION_SCALE x MOTION_SCALE block. Only two rows of each block are
+// read, a quarter of the way down and three quarters. One row was not
+// enough to keep the noise of a dim scene (tests/testMotion) under the
+// still level.
+static void Shrink(struct Frame *F, unsigned char *Out)
+{
+ unsigned char *Row, *Next;
+ int x, y, k, Sum;
+
+ for(y=0; y<PlaneHigh; y++)
+ {
+  Row = F->Pixels + (size_t)(y * MOTION_SCALE + MOTION_SCALE / 4) * F->Stride;
+  Next = Row + (size_t)(MOTION_SCALE / 2) * F->Stride;
+  for(x=0; x<PlaneWide; x++, Row+=MOTION_SCALE*2, Next+=MOTION_SCALE*2)
+  {
+   for(Sum=0, k=0; k<MOTION_SCALE*2; k+=2) Sum += Row[k] + Next[k];
+   *Out++ = Sum / (MOTION_SCALE * 2);
+  }
+ }
+}
+
+// The change per pixel of the most changed MOTION_TILE square of the
+// plane. A hand moving over part of the scene barely moves the average
+// over the whole picture but stands out in its own tiles.
+static double Change(unsigned char *a, unsigned char *b)
+{
+ unsigned long Sad;
+ double Level, Max = 0;
+ int tx, ty, y, w, h;
+ size_t At;
+
+ for(ty=0; ty<PlaneHigh; ty+=MOTION_TILE)
+  for(tx=0; tx<PlaneWide; tx+=MOTION_TILE)
+  {
+   w = PlaneWide - tx < MOTION_TILE ? PlaneWide - tx : MOTION_TILE;
+   h = PlaneHigh - ty < MOTION_TILE ? PlaneHigh - ty : MOTION_TILE;
+   for(Sad=0, y=ty; y<ty+h; y++)
+   {
+    At = (size_t)y * PlaneWide + tx;
+    Sad += MotionSad(a + At, b + At, w);
+   }
+   Level = (double)Sad / (w * h);
+   if(Level > Max) Max = Level;
+  }
+ return Max;
+}
+
+int MotionFeed(struct Frame *F)
+{
+ unsigned char *t;
+ double Now = Ms();
+
+ if(!Armed || F->Format != FRAME_YUYV || F->Wide / MOTION_SCALE != PlaneWide ||
+    F->High / MOTION_SCALE != PlaneHigh) return 0;
+ Shrink(F, Plane[0]);
+ Stats.Frames++;
+ if(!Have)
+ {
+  Have = 1;
+  StillSince = Now;
+ }
+ else
+ {
+  Stats.Level = Change(Plane[0], Plane[1]);
+  if(Stats.Level > Stats.MaxLevel) Stats.MaxLevel = Stats.Level;
+  if(Stats.Level > StillLevel) StillSince = Now;
+ }
+ t = Plane[0];
+ Plane[0] = Plane[1];
+ Plane[1] = t;
+ Stats.StillMs = Now - StillSince;
+ Stats.LastMs = Ms() - Now;
+ if(Stats.StillMs < StillFor) return 0;
+ Armed = 0;
+ return 1;
+}
+
+void MotionGetStats(struct MotionStats *S)
+{
+ *S = Stats;
+}
@@ -0,0 +1,50 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Stillness detector for auto capture
+//
+// Decides when the scene in front of the camera has stopped moving, so
+// a frame can be taken once the animator's hands are out of the way.
+// Each camera frame is shrunk to a 1/MOTION_SCALE luma plane, and the
+// mean absolute difference from the previous one is worked out for
+// each MOTION_TILE square with a vector sum of absolute differences.
+// The most changed square gives the level of motion. Once that has
+// stayed at or below the still level for long enough the detector
+// fires.
+//
+// At 1920x1080 the plane is 240x135 bytes, so a frame costs well
+// under a millisecond and one core keeps up with the camera.
+//
+///////////////////////////////////////////////////////////////////////
+
+#ifndef MOTION_H
+#define MOTION_H
+
+#include <stddef.h>
+#include "frame.h"
+
+#define MOTION_SCALE 8
+#define MOTION_TILE  16 // Plane pixels a side of the areas compared
+
+struct MotionStats
+{
+ long Frames;      // Frames looked at
+ double Level;     // Change per pixel of the most changed tile, 0-255
+ double MaxLevel;  // Highest Level since armed
+ double StillMs;   // How long the scene has been still
+ double LastMs;    // Time taken on the last frame
+};
+
+int  MotionInit(int Wide, int High);
+// Start watching. The detector fires once the change per pixel has
+// been no more than Level for StillMs.
+void MotionArm(int StillMs, int Level);
+void MotionDisarm();
+int  MotionArmed();
+// Look at a YUYV camera frame. Returns 1 when the scene has been
+// still long enough, which also disarms the detector.
+int  MotionFeed(struct Frame *F);
+// Sum of |a[i] - b[i]|
+unsigned long MotionSad(const unsigned char *a, const unsigned char *b, size_t N);
+void MotionGetStats(struct MotionStats *S);
+
+#endif
@@ -0,0 +1,191 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Onion skin. See onion.h
+//
+///////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "onion.h"
+
+static struct Frame Layer[ONION_MAX]; // Layer[0] is the newest
+static int NumLayers = 0, Kept = 0;
+static int Opacity = 0;               // Of the newest layer, out of 256
+static size_t Bytes = 0;
+
+// Dst = (Dst * (256 - Alpha) + Src * Alpha) / 256. Every kernel works
+// this out in 16 bits exactly the same way, so they give the same
+// bytes.
+static void BlendScalar(unsigned char *Dst, const unsigned char *Src, size_t N, int Alpha)
+{
+ size_t i;
+
+ for(i=0; i<N; i++) Dst[i] = (Dst[i] * (256 - Alpha) + Src[i] * Alpha) >> 8;
+}
+
+#if defined(__ARM_NEON)
+static void BlendNeon(unsigned char *Dst, const unsigned char *Src, size_t N, int Alpha)
+{
+ uint16x8_t Lo, Hi;
+ uint8x16_t d, s;
+ size_t i;
+
+ for(i=0; i+16<=N; i+=16)
+ {
+  d = vld1q_u8(Dst + i);
+  s = vld1q_u8(Src + i);
+  Lo = vmulq_n_u16(vmovl_u8(vget_low_u8(d)), 256 - Alpha);
+  Hi = vmulq_n_u16(vmovl_u8(vget_high_u8(d)), 256 - Alpha);
+  Lo = vmlaq_n_u16(Lo, vmovl_u8(vget_low_u8(s)), Alpha);
+  Hi = vmlaq_n_u16(Hi, vmovl_u8(vget_high_u8(s)), Alpha);
+  vst1q_u8(Dst + i, vcombine_u8(vshrn_n_u16(Lo, 8), vshrn_n_u16(Hi, 8)));
+ }
+ BlendScalar(Dst + i, Src + i, N - i, Alpha);
+}
+#define BlendFast BlendNeon
+#define FAST_NAME "NEON"
+#elif defined(__SSE2__)
+static void BlendSse2(unsigned char *Dst, const unsigned char *Src, size_t N, int Alpha)
+{
+ __m128i a = _mm_set1_epi16(Alpha), b = _mm_set1_epi16(256 - Alpha), z = _mm_setzero_si128();
+ __m128i d, s, Lo, Hi;
+ size_t i;
+
+ for(i=0; i+16<=N; i+=16)
+ {
+  d = _mm_loadu_si128((const __m128i *)(Dst + i));
+  s = _mm_loadu_si128((const __m128i *)(Src + i));
+  Lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, z), b), _mm_mullo_epi16(_mm_unpacklo_epi8(s, z), a));
+  Hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, z), b), _mm_mullo_epi16(_mm_unpackhi_epi8(s, z), a));
+  Lo = _mm_srli_epi16(Lo, 8);
+  Hi = _mm_srli_epi16(Hi, 8);
+  _mm_storeu_si128((__m128i *)(Dst + i), _mm_packus_epi16(Lo, Hi));
+ }
+ BlendScalar(Dst + i, Src + i, N - i, Alpha);
+}
+#define BlendFast BlendSse2
+#define FAST_NAME "SSE2"
+#endif
+
+#ifdef BlendFast
+static OnionKernel Blend = BlendFast;
+#else
+static OnionKernel Blend = BlendScalar;
+#endif
+
+int OnionInit(int Layers, int OpacityPct, int Wide, int High)
+{
+ int i;
+
+ if(Layers > ONION_MAX) Layers = ONION_MAX;
+ Bytes = (size_t)Wide * High * FrameBytesPerPixel(FRAME_YUYV);
+ Opacity = OpacityPct * 256 / 100;
+ for(NumLayers=0; NumLayers<Layers; NumLayers++)
+  if((Layer[NumLayers].Pixels = malloc(Bytes)) == NULL) break;
+ Kept = 0;
+ if(NumLayers < Layers)
+ {
+  for(i=0; i<NumLayers; i++) free(Layer[i].Pixels);
+  NumLayers = 0;
+  return -1;
+ }
+ return 0;
+}
+
+void OnionPush(struct Frame *F)
+{
+ struct Frame Oldest;
+ int r;
+
+ if(NumLayers == 0 || F->Format != FRAME_YUYV || (size_t)F->Stride * F->High > Bytes) return;
+ // Reuse the oldest copy's memory for the new one
+ Oldest = Layer[NumLayers - 1];
+ memmove(Layer + 1, Layer, (NumLayers - 1) * sizeof(*Layer));
+ Layer[0] = Oldest;
+ Layer[0].Wide = F->Wide;
+ Layer[0].High = F->High;
+ Layer[0].Stride = F->Wide * 2;
+ Layer[0].Format = FRAME_YUYV;
+ for(r=0; r<F->High; r++)
+  memcpy(Layer[0].Pixels + (size_t)r * Layer[0].Stride, F->Pixels + (size_t)r * F->Stride, Layer[0].Stride);
+ if(Kept < NumLayers) Kept++;
+}
+
+void OnionApply(struct Frame *Live)
+{
+ int k, r;
+
+ // Oldest and faintest first, so the newest ends up on top
+ for(k=Kept-1; k>=0; k--)
+ {
+  if(Layer[k].Wide != Live->Wide || Layer[k].High != Live->High || Live->Format != FRAME_YUYV) continue;
+  if(Live->Stride == Layer[k].Stride) Blend(Live->Pixels, Layer[k].Pixels, (size_t)Live->Stride * Live->High, Opacity >> k);
+  else for(r=0; r<Live->High; r++)
+   Blend(Live->Pixels + (size_t)r * Live->Stride, Layer[k].Pixels + (size_t)r * Layer[k].Stride, Layer[k].Stride, Opacity >> k);
+ }
+}
+
+void OnionClear()
+{
+ Kept = 0;
+}
+
+static double Ms()
+{
+ struct timespec t;
+
+ clock_gettime(CLOCK_MONOTONIC, &t);
+ return t.tv_sec * 1000.0 + t.tv_nsec / 1e6;
+}
+
+// Blend a screen sized YUYV frame over and over with one kernel
+static void Time(char *Name, OnionKernel Kernel, unsigned char *Dst, unsigned char *Src, int Pixels)
+{
+ double t;
+ int n = 0;
+
+ t = Ms();
+ do
+ {
+  Kernel(Dst, Src, (size_t)Pixels * 2, 128);
+  n++;
+ } while(Ms() - t < 200);
+ t = Ms() - t;
+ printf("Onion blend %-6s %7.1f Mpixel/s, %.2f ms a frame\n", Name, (double)Pixels * n / t / 1000, t / n);
+}
+
+void OnionBenchmark()
+{
+ unsigned char *Dst, *Src;
+ int Pixels = 1920 * 1080;
+ size_t i;
+
+ Dst = malloc((size_t)Pixels * 2);
+ Src = malloc((size_t)Pixels * 2);
+ if(Dst == NULL || Src == NULL)
+ {
+  free(Dst);
+  free(Src);
+  return;
+ }
+ for(i=0; i<(size_t)Pixels*2; i++)
+ {
+  Dst[i] = i * 7;
+  Src[i] = i * 13;
+ }
+ Time("scalar", BlendScalar, Dst, Src, Pixels);
+#ifdef BlendFast
+ Time(FAST_NAME, BlendFast, Dst, Src, Pixels);
+#endif
+ free(Dst);
+ free(Src);
+}
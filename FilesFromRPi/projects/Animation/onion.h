@@ -0,0 +1,39 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Onion skin
+//
+// Keeps copies of the last few frames recorded and blends them over
+// the live camera frame, so the animator can see where things were and
+// judge how far to move them. The newest frame is blended at the
+// opacity given, each older one at half the opacity of the one after
+// it.
+//
+// The blending works on the YUYV bytes straight from the camera,
+// before the frame is converted for display, so it touches half the
+// memory a BGRX blend would. It is done 16 bytes at a time with NEON
+// on the Pi, with SSE2 on a PC, and one byte at a time otherwise.
+//
+///////////////////////////////////////////////////////////////////////
+
+#ifndef ONION_H
+#define ONION_H
+
+#include <stddef.h>
+#include "frame.h"
+
+#define ONION_MAX 3  // Frames that can be shown at once
+
+// Blend N bytes of Src over Dst, Alpha out of 256
+typedef void (*OnionKernel)(unsigned char *Dst, const unsigned char *Src, size_t N, int Alpha);
+
+int  OnionInit(int Layers, int OpacityPct, int Wide, int High);
+// Keep a copy of a frame just recorded
+void OnionPush(struct Frame *F);
+// Blend the kept frames over a live frame of the same size and format
+void OnionApply(struct Frame *Live);
+// Forget the kept frames, after erasing or starting again
+void OnionClear();
+// Time each blend kernel built in and print megapixels per second
+void OnionBenchmark();
+
+#endif
@@ -0,0 +1,397 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Frame player. See player.h
+//
+///////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+
+#include "player.h"
+#include "decode.h"
+
+// Decode ahead ring. Slot k % PLAYER_AHEAD holds frame k.
+static struct Frame Ring[PLAYER_AHEAD];
+static int RingOk[PLAYER_AHEAD];   // Frame decoded without error
+static size_t RingBytes = 0;       // Size of each slot's buffer
+
+static pthread_mutex_t Lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t Changed = PTHREAD_COND_INITIALIZER;
+static int Decoded;   // Frames decoded so far
+static int Played;    // Frames finished with by the player
+static volatile int Cancelled; // Set by PlayerCancel(), under Lock
+static double CancelAt;
+static int CancelFd = -1; // Wakes the player from its frame wait
+
+struct Job
+{
+ char **Paths;     // Frame files, or
+ struct Anim *A;   // a packed animation
+ int N;
+ double Period;    // Frame time when the frames are files
+ struct Display *D;
+};
+
+// The play running on the player thread
+static struct
+{
+ pthread_t Thread;
+ int Busy;
+ int Fd;           // eventfd written when it ends
+ char **Paths;     // Its own copies
+ int N, Fps;
+ char *Folder;
+ struct Display *D;
+ struct PlayerStats S;
+} Bg = { .Fd = -1 };
+
+static double Ms()
+{
+ struct timespec t;
+
+ clock_gettime(CLOCK_MONOTONIC, &t);
+ return t.tv_sec * 1000.0 + t.tv_nsec / 1e6;
+}
+
+// Decoder thread: stay up to PLAYER_AHEAD frames ahead of the player
+static void *Decoder(void *Arg)
+{
+ struct Job *J = Arg;
+ unsigned char *Data;
+ size_t Len;
+ int k, Slot;
+
+ for(k=0; k<J->N; k++)
+ {
+  pthread_mutex_lock(&Lock);
+  while(k - Played >= PLAYER_AHEAD && !Cancelled) pthread_cond_wait(&Changed, &Lock);
+  pthread_mutex_unlock(&Lock);
+  if(Cancelled) break;
+
+  Slot = k % PLAYER_AHEAD;
+  if(J->A)
+  {
+   Data = AnimFrame(J->A, k, &Len);
+   RingOk[Slot] = DecodeJpegMem(Data, Len, &Ring[Slot], J->D->Wide, J->D->High) == 0;
+  }
+  else RingOk[Slot] = DecodeJpegFile(J->Paths[k], &Ring[Slot], J->D->Wide, J->D->High) == 0;
+
+  pthread_mutex_lock(&Lock);
+  Decoded = k + 1;
+  pthread_cond_broadcast(&Changed);
+  pthread_mutex_unlock(&Lock);
+ }
+ return NULL;
+}
+
+// How long frame k is shown
+static double FrameMs(struct Job *J, int k)
+{
+ return J->A ? AnimDuration(J->A, k) : J->Period;
+}
+
+static int Play(struct Job *J, struct PlayerStats *S)
+{
+ struct itimerspec Tick;
+ struct pollfd Wait[2];
+ struct Display *D = J->D;
+ pthread_t Thread;
+ size_t Bytes = (size_t)D->Wide * D->High * 4;
+ double Start = Ms(), Now, Prev = 0, Due = 0, Gap, Total = 0, Err = 0;
+ uint64_t Ticks;
+ int Timer, k, Slot, N = J->N;
+
+ memset(S, 0, sizeof(*S));
+ S->Frames = N;
+ for(k=0; k<N; k++) Total += FrameMs(J, k);
+ S->TargetFps = Total > 0 ? N * 1000.0 / Total : 0;
+ if(N == 0) return 0;
+
+ // The ring is kept from one play to the next
+ if(RingBytes != Bytes)
+ {
+  for(k=0; k<PLAYER_AHEAD; k++)
+  {
+   free(Ring[k].Pixels);
+   if((Ring[k].Pixels = malloc(Bytes)) == NULL)
+   {
+    RingBytes = 0;
+    return -1;
+   }
+  }
+  RingBytes = Bytes;
+ }
+ if((Timer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)) < 0)
+ {
+  perror("timerfd_create");
+  return -1;
+ }
+
+ Decoded = Played = 0;
+ if(pthread_create(&Thread, NULL, Decoder, J) != 0)
+ {
+  close(Timer);
+  return -1;
+ }
+
+ memset(&Tick, 0, sizeof(Tick));
+ Wait[0].fd = Timer;
+ Wait[1].fd = CancelFd;
+ Wait[0].events = Wait[1].events = POLLIN;
+ for(k=0; k<N && !Cancelled; k++)
+ {
+  // Wait for the frame to be decoded. Normally it already is.
+  pthread_mutex_lock(&Lock);
+  if(Decoded <= k && k > 0) S->Late++;
+  while(Decoded <= k && !Cancelled) pthread_cond_wait(&Changed, &Lock);
+  pthread_mutex_unlock(&Lock);
+  if(Cancelled) break;
+
+  Slot = k % PLAYER_AHEAD;
+  if(RingOk[Slot] && D->Show(D, &Ring[Slot]) == 0)
+  {
+   Now = Ms();
+   if(S->Shown == 0)
+   {
+    S->StartMs = Now - Start;
+    // Start the frame clock from the first frame shown
+    Start = Due = Now;
+   }
+   else
+   {
+    Gap = FrameMs(J, k - 1);
+    Err += (Now - Prev - Gap) * (Now - Prev - Gap);
+   }
+   Prev = Now;
+   S->Shown++;
+  }
+
+  pthread_mutex_lock(&Lock);
+  Played = k + 1;
+  pthread_cond_broadcast(&Changed);
+  pthread_mutex_unlock(&Lock);
+
+  // Sleep until the next frame is due. The times are absolute so a
+  // late frame does not push back the ones after it.
+  if(S->Shown && k < N-1)
+  {
+   Due += FrameMs(J, k);
+   Tick.it_value.tv_sec = (time_t)(Due / 1000);
+   Tick.it_value.tv_nsec = (long)((Due - Tick.it_value.tv_sec * 1000.0) * 1e6);
+   if(timerfd_settime(Timer, TFD_TIMER_ABSTIME, &Tick, NULL) == 0 &&
+      poll(Wait, 2, -1) > 0 && (Wait[0].revents & POLLIN)) read(Timer, &Ticks, sizeof(Ticks));
+  }
+ }
+ pthread_join(Thread, NULL);
+ close(Timer);
+ if((S->Stopped = Cancelled)) S->StopMs = Ms() - CancelAt;
+
+ if(S->Shown > 1)
+ {
+  S->Fps = (S->Shown - 1) * 1000.0 / (Prev - Start);
+  S->JitterMs = sqrt(Err / (S->Shown - 1));
+ }
+ return 0;
+}
+
+// Get ready for a new play, forgetting any earlier cancel
+static int Rearm()
+{
+ uint64_t n;
+
+ if(CancelFd < 0 && (CancelFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+ {
+  perror("eventfd");
+  return -1;
+ }
+ read(CancelFd, &n, sizeof(n));
+ pthread_mutex_lock(&Lock);
+ Cancelled = 0;
+ pthread_mutex_unlock(&Lock);
+ return 0;
+}
+
+static int PlayFiles(char **Paths, int N, int Fps, struct Display *D, struct PlayerStats *S)
+{
+ struct Job J = { Paths, NULL, N, 1000.0 / Fps, D };
+
+ return Play(&J, S);
+}
+
+static int PlayAnim(struct Anim *A, struct Display *D, struct PlayerStats *S)
+{
+ struct Job J = { NULL, A, A->Frames, 0, D };
+
+ return Play(&J, S);
+}
+
+int PlayerPlay(char **Paths, int N, int Fps, struct Display *D, struct PlayerStats *S)
+{
+ return Rearm() < 0 ? -1 : PlayFiles(Paths, N, Fps, D, S);
+}
+
+int PlayerPlayAnim(struct Anim *A, struct Display *D, struct PlayerStats *S)
+{
+ return Rearm() < 0 ? -1 : PlayAnim(A, D, S);
+}
+
+// Frame*.jpg, but not a Frame*.jpg.tmp still being written
+static int IsFrame(const struct dirent *e)
+{
+ size_t n = strlen(e->d_name);
+
+ return strncmp(e->d_name, "Frame", 5) == 0 && n > 4 && strcmp(e->d_name + n - 4, ".jpg") == 0;
+}
+
+static int PlayDir(char *Folder, int Fps, struct Display *D, struct PlayerStats *S)
+{
+ struct dirent **List;
+ struct Anim A;
+ char **Paths, s[280];
+ int N, i, r = -1;
+
+ // A packed video needs no listing at all
+ snprintf(s, sizeof(s), "%s/%s", Folder, ANIM_FILE);
+ if(AnimOpen(s, &A) == 0)
+ {
+  r = PlayAnim(&A, D, S);
+  AnimClose(&A);
+  return r;
+ }
+ if((N = scandir(Folder, &List, IsFrame, alphasort)) < 0)
+ {
+  perror(Folder);
+  return -1;
+ }
+ if((Paths = malloc(sizeof(char *) * (N + 1))) != NULL)
+ {
+  for(i=0; i<N; i++)
+  {
+   Paths[i] = malloc(strlen(Folder) + strlen(List[i]->d_name) + 2);
+   sprintf(Paths[i], "%s/%s", Folder, List[i]->d_name);
+  }
+  r = PlayFiles(Paths, N, Fps, D, S);
+  for(i=0; i<N; i++) free(Paths[i]);
+  free(Paths);
+ }
+ for(i=0; i<N; i++) free(List[i]);
+ free(List);
+ return r;
+}
+
+int PlayerPlayDir(char *Folder, int Fps, struct Display *D, struct PlayerStats *S)
+{
+ return Rearm() < 0 ? -1 : PlayDir(Folder, Fps, D, S);
+}
+
+////////////////////////////////////////////////////////////////////////
+//
+// Background play
+//
+////////////////////////////////////////////////////////////////////////
+
+static void *Background(void *Arg)
+{
+ uint64_t One = 1;
+
+ (void)Arg;
+ if(Bg.Folder) PlayDir(Bg.Folder, Bg.Fps, Bg.D, &Bg.S);
+ else PlayFiles(Bg.Paths, Bg.N, Bg.Fps, Bg.D, &Bg.S);
+ write(Bg.Fd, &One, sizeof(One));
+ return NULL;
+}
+
+static void FreeBg()
+{
+ int i;
+
+ for(i=0; Bg.Paths && i<Bg.N; i++) free(Bg.Paths[i]);
+ free(Bg.Paths);
+ free(Bg.Folder);
+ Bg.Paths = NULL;
+ Bg.Folder = NULL;
+ Bg.N = 0;
+}
+
+// Start the thread on what Bg holds
+static int Launch(int Fps, struct Display *D)
+{
+ if(Bg.Fd < 0 && (Bg.Fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) perror("eventfd");
+ Bg.Fps = Fps;
+ Bg.D = D;
+ memset(&Bg.S, 0, sizeof(Bg.S));
+ if(Bg.Fd < 0 || Rearm() < 0 || pthread_create(&Bg.Thread, NULL, Background, NULL) != 0)
+ {
+  FreeBg();
+  return -1;
+ }
+ Bg.Busy = 1;
+ return 0;
+}
+
+int PlayerStart(char **Paths, int N, int Fps, struct Display *D)
+{
+ int i;
+
+ if(Bg.Busy || (Bg.Paths = calloc(N + 1, sizeof(char *))) == NULL) return -1;
+ for(Bg.N=0; Bg.N<N; Bg.N++)
+  if((Bg.Paths[Bg.N] = strdup(Paths[Bg.N])) == NULL)
+  {
+   for(i=0; i<Bg.N; i++) free(Bg.Paths[i]);
+   free(Bg.Paths);
+   Bg.Paths = NULL;
+   return -1;
+  }
+ return Launch(Fps, D);
+}
+
+int PlayerStartDir(char *Folder, int Fps, struct Display *D)
+{
+ if(Bg.Busy || (Bg.Folder = strdup(Folder)) == NULL) return -1;
+ return Launch(Fps, D);
+}
+
+int PlayerBusy() { return Bg.Busy; }
+
+int PlayerFd()
+{
+ if(Bg.Fd < 0 && (Bg.Fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) perror("eventfd");
+ return Bg.Fd;
+}
+
+void PlayerCancel()
+{
+ uint64_t One = 1;
+
+ pthread_mutex_lock(&Lock);
+ if(!Cancelled) CancelAt = Ms();
+ Cancelled = 1;
+ pthread_cond_broadcast(&Changed);
+ pthread_mutex_unlock(&Lock);
+ if(CancelFd >= 0) write(CancelFd, &One, sizeof(One));
+}
+
+int PlayerFinish(struct PlayerStats *S)
+{
+ uint64_t n;
+
+ if(Bg.Busy) pthread_join(Bg.Thread, NULL);
+ // Read once the thread has written, so the end of a play collected
+ // early (a cancel) is not left on PlayerFd() for the next play
+ if(Bg.Fd >= 0) read(Bg.Fd, &n, sizeof(n));
+ if(!Bg.Busy) return -1;
+ Bg.Busy = 0;
+ FreeBg();
+ if(S) *S = Bg.S;
+ return 0;
+}
@@ -0,0 +1,62 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Frame player
+//
+// Plays a list of JPEG frames at a fixed frame rate on a struct
+// Display. A decoder thread keeps up to PLAYER_AHEAD frames decoded
+// ahead of the one on screen, and the frames are paced by a timerfd,
+// so the rate does not depend on how long any one frame took to
+// decode. The first frame goes up as soon as it is decoded; there is
+// no pass over all the files first.
+//
+// A packed animation (anim.h) is decoded straight from its mapping
+// and each frame is shown for the time its index gives.
+//
+// Playing can also be left to a thread of its own, so the caller can
+// go back to reading buttons. PlayerCancel() stops a play at the next
+// frame: the player waits for its frame time on the cancel eventfd as
+// well as the timerfd, so it wakes at once. The end of a background
+// play is signalled on PlayerFd(), which can go in the input epoll set,
+// and PlayerFinish() then collects it.
+//
+///////////////////////////////////////////////////////////////////////
+
+#ifndef PLAYER_H
+#define PLAYER_H
+
+#include "display.h"
+#include "anim.h"
+
+#define PLAYER_AHEAD 4 // Frames decoded ahead of the one shown
+
+struct PlayerStats
+{
+ int Frames;       // Frames in the animation
+ int Shown;        // Frames put on the display
+ int Late;         // Frames not decoded by the time they were due
+ double TargetFps;
+ double Fps;       // Frame rate achieved
+ double JitterMs;  // RMS difference between frame times and the target
+ double StartMs;   // Time from the call to the first frame shown
+ int Stopped;      // Cut short by PlayerCancel()
+ double StopMs;    // Time from PlayerCancel() to the player stopping
+};
+
+int PlayerPlay(char **Paths, int N, int Fps, struct Display *D, struct PlayerStats *S);
+int PlayerPlayAnim(struct Anim *A, struct Display *D, struct PlayerStats *S);
+// Play the folder's ANIM_FILE if it has one, otherwise the Frame*.jpg
+// files in it in name order
+int PlayerPlayDir(char *Folder, int Fps, struct Display *D, struct PlayerStats *S);
+
+// The same on the player thread, returning at once. The paths are
+// copied. D must be left alone until PlayerFinish().
+int PlayerStart(char **Paths, int N, int Fps, struct Display *D);
+int PlayerStartDir(char *Folder, int Fps, struct Display *D);
+int PlayerBusy();      // A background play has not been finished yet
+void PlayerCancel();   // Stop whatever is playing, from any thread
+int PlayerFd();        // Readable once a background play has ended
+// Wait for the background play to end and give its stats. Returns -1
+// if there was none.
+int PlayerFinish(struct PlayerStats *S);
+
+#endif
@@ -0,0 +1,235 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Raw frame journal. See rawJournal.h
+//
+// The file is allocated in full when it is opened so a RECORD never
+// has to wait for the file system to find space. The slot map lives
+// only in memory: the journal is emptied along with the session's
+// frames when the program starts, so nothing in it has to survive.
+//
+///////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "rawJournal.h"
+#include "encode.h"
+#include "decode.h"
+
+#define MAX_WORKERS 8
+
+static unsigned char *Map = NULL;
+static size_t MapLen = 0, SlotBytes = 0;
+static int NumSlots = 0;
+static int *Ids = NULL;             // Frame ID in each slot, -1 if free
+static struct Frame *Frames = NULL; // Size and format of each slot's frame
+static struct RawStats Stats;
+static pthread_mutex_t Lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Work shared by the RawEncodeAll() threads
+static char *(*EncodeName)(int Id, char *Buf);
+static int EncodeNext;
+
+static double Ms()
+{
+ struct timespec t;
+
+ clock_gettime(CLOCK_MONOTONIC, &t);
+ return t.tv_sec * 1000.0 + t.tv_nsec / 1e6;
+}
+
+int RawOpen(char *Path, size_t MaxBytes, int Wide, int High)
+{
+ int Fd, i;
+
+ SlotBytes = (size_t)Wide * High * FrameBytesPerPixel(FRAME_YUYV);
+ NumSlots = MaxBytes / SlotBytes;
+ if(NumSlots == 0)
+ {
+  printf("A %zu byte journal holds no %dx%d frames\n", MaxBytes, Wide, High);
+  return -1;
+ }
+ MapLen = SlotBytes * NumSlots;
+ if((Fd = open(Path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0)
+ {
+  perror(Path);
+  return -1;
+ }
+ if((errno = posix_fallocate(Fd, 0, MapLen)) != 0 ||
+    (Map = mmap(NULL, MapLen, PROT_READ | PROT_WRITE, MAP_SHARED, Fd, 0)) == MAP_FAILED)
+ {
+  perror(Path);
+  close(Fd);
+  Map = NULL;
+  return -1;
+ }
+ close(Fd);
+ Ids = malloc(NumSlots * sizeof(*Ids));
+ Frames = calloc(NumSlots, sizeof(*Frames));
+ if(Ids == NULL || Frames == NULL)
+ {
+  RawClose();
+  return -1;
+ }
+ for(i=0; i<NumSlots; i++)
+ {
+  Ids[i] = -1;
+  Frames[i].Pixels = Map + SlotBytes * i;
+ }
+ memset(&Stats, 0, sizeof(Stats));
+ Stats.Slots = NumSlots;
+ return 0;
+}
+
+static int Find(int Id)
+{
+ int i;
+
+ for(i=0; i<NumSlots; i++) if(Ids[i] == Id) return i;
+ return -1;
+}
+
+struct Frame *RawSlot(int Id)
+{
+ int i;
+
+ if(NumSlots == 0) return NULL;
+ pthread_mutex_lock(&Lock);
+ if((i = Find(-1)) < 0) Stats.Full++;
+ else
+ {
+  Ids[i] = Id;
+  Stats.Stored++;
+  if(++Stats.Used > Stats.MaxUsed) Stats.MaxUsed = Stats.Used;
+ }
+ pthread_mutex_unlock(&Lock);
+ return i < 0 ? NULL : &Frames[i];
+}
+
+int RawHas(int Id)
+{
+ int r;
+
+ if(NumSlots == 0 || Id < 0) return 0;
+ pthread_mutex_lock(&Lock);
+ r = Find(Id) >= 0;
+ pthread_mutex_unlock(&Lock);
+ return r;
+}
+
+void RawDiscard(int Id)
+{
+ int i;
+
+ if(NumSlots == 0 || Id < 0) return;
+ pthread_mutex_lock(&Lock);
+ if((i = Find(Id)) >= 0)
+ {
+  Ids[i] = -1;
+  Stats.Used--;
+ }
+ pthread_mutex_unlock(&Lock);
+}
+
+void RawClear()
+{
+ int i;
+
+ pthread_mutex_lock(&Lock);
+ for(i=0; i<NumSlots; i++) Ids[i] = -1;
+ Stats.Used = 0;
+ pthread_mutex_unlock(&Lock);
+}
+
+int RawLoad(int Id, struct Frame *Out, int Wide, int High)
+{
+ int i;
+
+ if(NumSlots == 0 || Id < 0) return -1;
+ // Held while converting so the slot cannot be encoded and reused
+ // underneath
+ pthread_mutex_lock(&Lock);
+ if((i = Find(Id)) >= 0) DecodeYuyv(&Frames[i], Out, Wide, High);
+ pthread_mutex_unlock(&Lock);
+ return i < 0 ? -1 : 0;
+}
+
+// Encoder thread: take the next full slot until there are none
+static void *Encoder(void *Arg)
+{
+ char Path[256];
+ int i, r;
+
+ (void)Arg;
+ for(;;)
+ {
+  pthread_mutex_lock(&Lock);
+  while(EncodeNext < NumSlots && Ids[EncodeNext] < 0) EncodeNext++;
+  i = EncodeNext++;
+  if(i < NumSlots) EncodeName(Ids[i], Path);
+  pthread_mutex_unlock(&Lock);
+  if(i >= NumSlots) break;
+
+  r = EncodeNow(&Frames[i], Path);
+
+  pthread_mutex_lock(&Lock);
+  if(r == 0)
+  {
+   Ids[i] = -1;
+   Stats.Used--;
+   Stats.Encoded++;
+  }
+  else Stats.Failed++;
+  pthread_mutex_unlock(&Lock);
+ }
+ return NULL;
+}
+
+int RawEncodeAll(char *(*Name)(int Id, char *Buf), int Workers)
+{
+ pthread_t Threads[MAX_WORKERS];
+ double t = Ms();
+ long Before = Stats.Encoded;
+ int i, n = 0;
+
+ if(NumSlots == 0 || Stats.Used == 0) return 0;
+ if(Workers > MAX_WORKERS) Workers = MAX_WORKERS;
+ EncodeName = Name;
+ EncodeNext = 0;
+ for(i=0; i<Workers; i++) if(pthread_create(&Threads[n], NULL, Encoder, NULL) == 0) n++;
+ // Do the work here if no thread could be started
+ if(n == 0) Encoder(NULL);
+ for(i=0; i<n; i++) pthread_join(Threads[i], NULL);
+
+ pthread_mutex_lock(&Lock);
+ n = Stats.Encoded - Before;
+ Stats.EncodeMs = Ms() - t;
+ Stats.EncodeFps = Stats.EncodeMs > 0 ? n * 1000.0 / Stats.EncodeMs : 0;
+ pthread_mutex_unlock(&Lock);
+ return n;
+}
+
+void RawGetStats(struct RawStats *S)
+{
+ pthread_mutex_lock(&Lock);
+ *S = Stats;
+ pthread_mutex_unlock(&Lock);
+}
+
+void RawClose()
+{
+ if(Map) munmap(Map, MapLen);
+ free(Ids);
+ free(Frames);
+ Map = NULL;
+ Ids = NULL;
+ Frames = NULL;
+ NumSlots = 0;
+}
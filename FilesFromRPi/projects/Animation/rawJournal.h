@@ -0,0 +1,53 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Raw frame journal
+//
+// With the journal in use, RECORD copies the camera frame into a slot
+// of a preallocated, memory mapped file and nothing more; no JPEG is
+// made. Frames are only encoded when the animation is saved, played
+// or exported, and then on several threads at once, so a frame that
+// is erased straight after it was taken is never encoded at all.
+// Until then the viewer shows frames straight from the journal.
+//
+// The journal holds as many frames as fit in the size it was opened
+// with. When it is full RawSlot() returns NULL and the caller falls
+// back to encoding the frame as it is taken.
+//
+///////////////////////////////////////////////////////////////////////
+
+#ifndef RAWJOURNAL_H
+#define RAWJOURNAL_H
+
+#include <stddef.h>
+#include "frame.h"
+
+struct RawStats
+{
+ int Slots;          // Frames the journal can hold
+ int Used;           // Frames in it now
+ int MaxUsed;        // Highest Used seen
+ long Stored;        // Frames put in it
+ long Full;          // Times a frame found it full
+ long Encoded;       // Frames encoded out of it
+ long Failed;        // Frames that could not be encoded
+ double EncodeMs;    // Time taken by the last RawEncodeAll()
+ double EncodeFps;   // Its frames encoded per second
+};
+
+int  RawOpen(char *Path, size_t MaxBytes, int Wide, int High);
+// A free slot to capture frame Id into, NULL if the journal is full
+struct Frame *RawSlot(int Id);
+int  RawHas(int Id);
+// Drop frame Id, or every frame
+void RawDiscard(int Id);
+void RawClear();
+// Convert frame Id to BGRX for display, no larger than Wide x High
+int  RawLoad(int Id, struct Frame *Out, int Wide, int High);
+// Encode every frame in the journal to the file Name() gives for its
+// ID, using Workers threads, and drop it from the journal. Returns
+// the number of frames encoded.
+int  RawEncodeAll(char *(*Name)(int Id, char *Buf), int Workers);
+void RawGetStats(struct RawStats *S);
+void RawClose();
+
+#endif
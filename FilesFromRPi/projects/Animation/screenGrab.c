@@ -0,0 +1,134 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Screen grab. See screenGrab.h
+//
+///////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+
+#include "screenGrab.h"
+
+static Display *Dpy = NULL;
+static XImage *Img = NULL;
+static XShmSegmentInfo Shm;
+static int Left, Top;
+static int Failed;   // Set by the error handler while attaching
+static double LastMs = 0;
+
+static double Ms()
+{
+ struct timespec t;
+
+ clock_gettime(CLOCK_MONOTONIC, &t);
+ return t.tv_sec * 1000.0 + t.tv_nsec / 1e6;
+}
+
+// A server on another machine cannot attach the segment, which X
+// reports as an error that would normally end the program
+static int AttachError(Display *d, XErrorEvent *e)
+{
+ (void)d; (void)e;
+ Failed = 1;
+ return 0;
+}
+
+int ScreenGrabOpen(int X, int Y, int Wide, int High)
+{
+ int (*Old)(Display *, XErrorEvent *);
+ int Scr;
+
+ ScreenGrabClose();
+ if((Dpy = XOpenDisplay(NULL)) == NULL) return -1;
+ Scr = DefaultScreen(Dpy);
+ if(!XShmQueryExtension(Dpy) || DefaultDepth(Dpy, Scr) != 24)
+ {
+  printf("X display has no shared memory images\n");
+  ScreenGrabClose();
+  return -1;
+ }
+ // Keep to the screen
+ if(X < 0) X = 0;
+ if(Y < 0) Y = 0;
+ if(X + Wide > DisplayWidth(Dpy, Scr)) Wide = DisplayWidth(Dpy, Scr) - X;
+ if(Y + High > DisplayHeight(Dpy, Scr)) High = DisplayHeight(Dpy, Scr) - Y;
+ if(Wide <= 0 || High <= 0)
+ {
+  ScreenGrabClose();
+  return -1;
+ }
+ Left = X;
+ Top = Y;
+
+ memset(&Shm, 0, sizeof(Shm));
+ Shm.shmid = -1;
+ Img = XShmCreateImage(Dpy, DefaultVisual(Dpy, Scr), 24, ZPixmap, NULL, &Shm, Wide, High);
+ if(Img == NULL || Img->bits_per_pixel != 32 ||
+    (Shm.shmid = shmget(IPC_PRIVATE, (size_t)Img->bytes_per_line * Img->height, IPC_CREAT | 0600)) < 0 ||
+    (Shm.shmaddr = Img->data = shmat(Shm.shmid, NULL, 0)) == (char *)-1)
+ {
+  perror("Screen grab memory");
+  if(Shm.shmid >= 0) shmctl(Shm.shmid, IPC_RMID, NULL);
+  Shm.shmid = -1;
+  if(Img) Img->data = NULL;
+  ScreenGrabClose();
+  return -1;
+ }
+ Shm.readOnly = False;
+ Failed = 0;
+ Old = XSetErrorHandler(AttachError);
+ XShmAttach(Dpy, &Shm);
+ XSync(Dpy, False);
+ XSetErrorHandler(Old);
+ // Both sides have it now, it goes when both let go
+ shmctl(Shm.shmid, IPC_RMID, NULL);
+ if(Failed)
+ {
+  printf("X server cannot share memory with this program\n");
+  Shm.shmid = -1;
+  ScreenGrabClose();
+  return -1;
+ }
+ return 0;
+}
+
+int ScreenGrab(struct Frame *Out)
+{
+ double t = Ms();
+ int r;
+
+ if(Img == NULL) return -1;
+ // The server writes straight into the segment, only the rectangle
+ if(!XShmGetImage(Dpy, DefaultRootWindow(Dpy), Img, Left, Top, AllPlanes)) return -1;
+ Out->Wide = Img->width;
+ Out->High = Img->height;
+ Out->Stride = Out->Wide * 4;
+ Out->Format = FRAME_BGRX;
+ for(r=0; r<Out->High; r++)
+  memcpy(Out->Pixels + (size_t)r * Out->Stride, Img->data + (size_t)r * Img->bytes_per_line, Out->Stride);
+ LastMs = Ms() - t;
+ return 0;
+}
+
+double ScreenGrabMs() { return LastMs; }
+
+void ScreenGrabClose()
+{
+ if(Dpy && Img && Shm.shmid >= 0 && Shm.shmaddr) XShmDetach(Dpy, &Shm);
+ if(Img)
+ {
+  if(Shm.shmaddr && Shm.shmaddr != (char *)-1) shmdt(Shm.shmaddr);
+  Img->data = NULL;
+  XDestroyImage(Img);
+ }
+ if(Dpy) XCloseDisplay(Dpy);
+ Dpy = NULL;
+ Img = NULL;
+ memset(&Shm, 0, sizeof(Shm));
+}
@@ -0,0 +1,30 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Screen grab
+//
+// Without a V4L2 camera the frame is taken from the screen, where
+// libcamera-vid shows the live picture. Running scrot for the whole
+// screen and convert to crop it costs two processes and two JPEG round
+// trips a frame. Instead, only the rectangle the picture is in is read
+// from the X server with MIT-SHM, into one shared memory segment made
+// once and reused for every grab, and copied out as a BGRX frame.
+// Nothing goes through a file.
+//
+///////////////////////////////////////////////////////////////////////
+
+#ifndef SCREENGRAB_H
+#define SCREENGRAB_H
+
+#include "frame.h"
+
+// Get ready to grab the X, Y, Wide, High rectangle of the screen,
+// clipped to the screen. Returns -1 if there is no X display or it
+// cannot share memory with this program.
+int  ScreenGrabOpen(int X, int Y, int Wide, int High);
+// Copy the rectangle into Out->Pixels, which must hold Wide*High*4
+// bytes
+int  ScreenGrab(struct Frame *Out);
+double ScreenGrabMs(); // Time the last grab took
+void ScreenGrabClose();
+
+#endif
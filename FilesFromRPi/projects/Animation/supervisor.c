@@ -0,0 +1,198 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Helper process supervisor. See supervisor.h
+//
+///////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/pidfd.h>
+
+#include "supervisor.h"
+
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
+
+extern char **environ;
+
+struct Helper
+{
+ int Live;      // Slot in use
+ int Done;      // Reaped, Status is valid
+ int Status;
+ int Fd;        // pidfd
+ pid_t Pid;
+ char Name[32];
+};
+
+static struct Helper Helpers[SUPER_MAX];
+static int Epoll = -1; // The pidfds of the helpers not reaped yet
+
+// Reap one helper if it has finished
+static void Reap(struct Helper *h)
+{
+ siginfo_t si;
+
+ si.si_pid = 0;
+ if(h->Live && !h->Done && waitid(P_PIDFD, h->Fd, &si, WEXITED | WNOHANG) == 0 && si.si_pid != 0)
+ {
+  h->Status = si.si_code == CLD_EXITED ? si.si_status : 128 + si.si_status;
+  h->Done = 1;
+  // Its pidfd stays readable, stop watching it
+  epoll_ctl(Epoll, EPOLL_CTL_DEL, h->Fd, NULL);
+ }
+}
+
+int SuperFd()
+{
+ if(Epoll < 0 && (Epoll = epoll_create1(EPOLL_CLOEXEC)) < 0) perror("epoll_create1");
+ return Epoll;
+}
+
+void SuperReap()
+{
+ struct epoll_event ev[SUPER_MAX];
+ int i, n;
+
+ if(Epoll < 0) return;
+ n = epoll_wait(Epoll, ev, SUPER_MAX, 0);
+ for(i=0; i<n; i++) Reap(&Helpers[ev[i].data.u32]);
+}
+
+static int Valid(int H)
+{
+ return H >= 0 && H < SUPER_MAX && Helpers[H].Live;
+}
+
+int SuperStart(char *const Argv[])
+{
+ posix_spawnattr_t a;
+ struct epoll_event ev;
+ sigset_t Def;
+ struct Helper *h = NULL;
+ pid_t Pid;
+ int i, r;
+
+ if(SuperFd() < 0) return -1;
+ for(i=0; i<SUPER_MAX; i++) if(!Helpers[i].Live)
+ {
+  h = &Helpers[i];
+  break;
+ }
+ if(h == NULL)
+ {
+  printf("Too many helpers running to start %s\n", Argv[0]);
+  return -1;
+ }
+
+ // The helper gets the default signal handling and mask back, and a
+ // process group of its own so a terminal ^C does not reach it.
+ posix_spawnattr_init(&a);
+ sigemptyset(&Def);
+ sigaddset(&Def, SIGCHLD);
+ sigaddset(&Def, SIGPIPE);
+ posix_spawnattr_setsigdefault(&a, &Def);
+ sigemptyset(&Def);
+ posix_spawnattr_setsigmask(&a, &Def);
+ posix_spawnattr_setpgroup(&a, 0);
+ posix_spawnattr_setflags(&a, POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETPGROUP);
+
+ // Nothing reaps the child before its pidfd is open, so the pid cannot
+ // have been reused
+ r = posix_spawnp(&Pid, Argv[0], NULL, &a, Argv, environ);
+ posix_spawnattr_destroy(&a);
+ if(r != 0)
+ {
+  printf("Could not start %s: %s\n", Argv[0], strerror(r));
+  return -1;
+ }
+ if((h->Fd = pidfd_open(Pid, 0)) < 0)
+ {
+  perror("pidfd_open");
+  kill(Pid, SIGKILL);
+  waitpid(Pid, NULL, 0);
+  return -1;
+ }
+ h->Pid = Pid;
+ h->Done = 0;
+ h->Status = 0;
+ snprintf(h->Name, sizeof(h->Name), "%s", Argv[0]);
+ h->Live = 1;
+ memset(&ev, 0, sizeof(ev));
+ ev.events = EPOLLIN;
+ ev.data.u32 = h - Helpers;
+ epoll_ctl(Epoll, EPOLL_CTL_ADD, h->Fd, &ev);
+ Reap(h); // In case a posix_spawnp exec failure already exited it
+ return h - Helpers;
+}
+
+// Hand back a reaped slot and its exit status
+static int Release(struct Helper *h)
+{
+ close(h->Fd);
+ h->Live = 0;
+ return h->Status;
+}
+
+int SuperRunning(int H)
+{
+ if(!Valid(H)) return 0;
+ Reap(&Helpers[H]);
+ return !Helpers[H].Done;
+}
+
+int SuperWait(int H, int TimeoutMs)
+{
+ struct Helper *h;
+ struct pollfd p;
+ int r;
+
+ if(!Valid(H)) return -1;
+ h = &Helpers[H];
+ // A pidfd polls readable once the process has exited
+ p.fd = h->Fd;
+ p.events = POLLIN;
+ while(!h->Done)
+ {
+  r = poll(&p, 1, TimeoutMs);
+  if(r == 0 || (r < 0 && errno != EINTR)) return -1;
+  Reap(h);
+ }
+ return Release(h);
+}
+
+int SuperStop(int H)
+{
+ struct Helper *h;
+ int r;
+
+ if(!Valid(H)) return -1;
+ h = &Helpers[H];
+ if(!h->Done) pidfd_send_signal(h->Fd, SIGTERM, NULL, 0);
+ if((r = SuperWait(H, SUPER_WAIT)) >= 0) return r;
+ printf("%s (pid %d) ignored SIGTERM, killing it\n", h->Name, h->Pid);
+ pidfd_send_signal(h->Fd, SIGKILL, NULL, 0);
+ return SuperWait(H, -1);
+}
+
+int SuperRun(char *const Argv[])
+{
+ int H = SuperStart(Argv);
+
+ return H < 0 ? -1 : SuperWait(H, -1);
+}
+
+void SuperStopAll()
+{
+ int i;
+
+ for(i=0; i<SUPER_MAX; i++) SuperStop(i);
+}
@@ -0,0 +1,47 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Helper process supervisor
+//
+// The live video (libcamera-vid) and feh run as separate programs.
+// They are started here with posix_spawn(), so the pid is the helper
+// itself and not a shell or a fork of this program, and each one is
+// held by a pidfd. Stopping a helper signals that pidfd and waits on
+// it, so there is no scan of the process table, no temporary file
+// and no chance of signalling a reused pid.
+//
+// Finished helpers are reaped with waitid() on their own pidfds, so
+// nothing else the program waits for (system() for example) has its
+// child taken away. There is no SIGCHLD handler, which could run on
+// any of the program's threads: the pidfds of running helpers are
+// kept in an epoll set, SuperFd(), and the main loop calls
+// SuperReap() when it is readable. All calls are made from that one
+// thread.
+//
+///////////////////////////////////////////////////////////////////////
+
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+
+#define SUPER_MAX  8    // Helpers that can run at once
+#define SUPER_WAIT 500  // ms to wait for SIGTERM before using SIGKILL
+
+// Start a helper. Argv[0] is looked up on the PATH. Returns a handle
+// for the other calls, or -1.
+int  SuperStart(char *const Argv[]);
+// 1 if the helper is still running
+int  SuperRunning(int H);
+// Stop a helper and wait for it to go. Returns its exit status, or -1
+// if the handle was not running.
+int  SuperStop(int H);
+// Wait up to TimeoutMs (-1 for ever) for a helper to finish on its
+// own. Returns its exit status, or -1 on timeout.
+int  SuperWait(int H, int TimeoutMs);
+// Run a helper to the end, in place of system(). Returns its exit
+// status or -1 if it could not be started.
+int  SuperRun(char *const Argv[]);
+// Readable when a helper has exited, then call SuperReap()
+int  SuperFd();
+void SuperReap();
+void SuperStopAll();
+
+#endif
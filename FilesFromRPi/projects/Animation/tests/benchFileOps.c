@@ -0,0 +1,202 @@
+///////////////////////////////////////////////////////////////////////
+//
+// File operations benchmark
+//
+// Times each fileOps.h call against the shell command it replaced,
+// run through system() the way the station used to: rm, mv, cp, the
+// ls | wc -l count read back from Count.txt, and rm on every file in
+// a folder. The copied file is a 40 KB frame and is checked against
+// the original, so a short copy fails the run.
+//
+// Run from the Animation folder: tests/benchFileOps [folder]
+// The folder (default /tmp) should be on the disk being measured.
+//
+///////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../fileOps.h"
+
+#define RUNS        200    // Of each operation, each way
+#define FRAME_BYTES 40000  // About one 640x480 JPEG
+#define EMPTY_FILES 100    // In the folder emptied
+
+static char Dir[256];
+
+static double Us()
+{
+ struct timespec t;
+
+ clock_gettime(CLOCK_MONOTONIC, &t);
+ return t.tv_sec * 1e6 + t.tv_nsec / 1e3;
+}
+
+static void Make(char *Path, int Bytes)
+{
+ char Buf[FRAME_BYTES];
+ int Fd, i;
+
+ for(i=0; i<Bytes; i++) Buf[i] = i * 7;
+ if((Fd = open(Path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) return;
+ if(write(Fd, Buf, Bytes) != Bytes) perror(Path);
+ close(Fd);
+}
+
+static int Same(char *a, char *b)
+{
+ char x[FRAME_BYTES + 1], y[FRAME_BYTES + 1];
+ int Fa, Fb, na = -1, nb = -2;
+
+ if((Fa = open(a, O_RDONLY)) >= 0 && (Fb = open(b, O_RDONLY)) >= 0)
+ {
+  na = read(Fa, x, sizeof(x));
+  nb = read(Fb, y, sizeof(y));
+  close(Fb);
+ }
+ if(Fa >= 0) close(Fa);
+ return na == nb && memcmp(x, y, na) == 0;
+}
+
+// What the old CountFiles() did
+static int ShellCount(char *Path)
+{
+ char Cmd[600];
+ FILE *f;
+ int n = -1;
+
+ snprintf(Cmd, sizeof(Cmd), "ls %s | wc -l > %s/Count.txt", Path, Dir);
+ if(system(Cmd) != 0) return -1;
+ snprintf(Cmd, sizeof(Cmd), "%s/Count.txt", Dir);
+ if((f = fopen(Cmd, "r")) != NULL)
+ {
+  if(fscanf(f, "%d", &n) != 1) n = -1;
+  fclose(f);
+ }
+ return n;
+}
+
+static void Fill(char *Path)
+{
+ char Name[600];
+ int i;
+
+ for(i=0; i<EMPTY_FILES; i++)
+ {
+  snprintf(Name, sizeof(Name), "%s/Frame%05d.jpg", Path, i);
+  Make(Name, 16);
+ }
+}
+
+static void Report(char *Op, double Native, double Shell)
+{
+ printf("%-8s %12.1f %12.1f %8.0fx\n", Op, Native / RUNS, Shell / RUNS, Shell / Native);
+}
+
+int main(int argc, char **argv)
+{
+ char a[300], b[300], Sub[300], Cmd[1000];
+ double t, Native, Shell;
+ int i, Bad = 0;
+
+ snprintf(Dir, sizeof(Dir), "%s/benchFileOpsXXXXXX", argc > 1 ? argv[1] : "/tmp");
+ if(mkdtemp(Dir) == NULL)
+ {
+  perror(Dir);
+  return 1;
+ }
+ snprintf(a, sizeof(a), "%s/a.jpg", Dir);
+ snprintf(b, sizeof(b), "%s/b.jpg", Dir);
+ snprintf(Sub, sizeof(Sub), "%s/Frames", Dir);
+ mkdir(Sub, 0755);
+ printf("Each operation %d times in %s\n", RUNS, Dir);
+ printf("%-8s %12s %12s %9s\n", "op", "native us", "system() us", "speedup");
+
+ // Remove. Making the file is left out of the time.
+ for(i=0, Native=0; i<RUNS; i++)
+ {
+  Make(a, 16);
+  t = Us();
+  FileRemove(a);
+  Native += Us() - t;
+ }
+ snprintf(Cmd, sizeof(Cmd), "rm %s", a);
+ for(i=0, Shell=0; i<RUNS; i++)
+ {
+  Make(a, 16);
+  t = Us();
+  if(system(Cmd) != 0) Bad++;
+  Shell += Us() - t;
+ }
+ Report("remove", Native, Shell);
+
+ // Rename back and forth
+ Make(a, 16);
+ t = Us();
+ for(i=0; i<RUNS; i++) if((i & 1 ? FileRename(b, a, 0) : FileRename(a, b, 0)) < 0) Bad++;
+ Native = Us() - t;
+ t = Us();
+ for(i=0; i<RUNS; i++)
+ {
+  snprintf(Cmd, sizeof(Cmd), i & 1 ? "mv %2$s %1$s" : "mv %1$s %2$s", a, b);
+  if(system(Cmd) != 0) Bad++;
+ }
+ Shell = Us() - t;
+ Report("rename", Native, Shell);
+
+ // Copy a frame
+ Make(a, FRAME_BYTES);
+ t = Us();
+ for(i=0; i<RUNS; i++) if(FileCopy(a, b) < 0) Bad++;
+ Native = Us() - t;
+ if(!Same(a, b))
+ {
+  printf("FileCopy: %s differs from %s\n", b, a);
+  Bad++;
+ }
+ snprintf(Cmd, sizeof(Cmd), "cp %s %s", a, b);
+ t = Us();
+ for(i=0; i<RUNS; i++) if(system(Cmd) != 0) Bad++;
+ Shell = Us() - t;
+ Report("copy", Native, Shell);
+ FileRemove(a);
+ FileRemove(b);
+
+ // Count a folder of frames
+ Fill(Sub);
+ t = Us();
+ for(i=0; i<RUNS; i++) if(FileCount(Sub) != EMPTY_FILES) Bad++;
+ Native = Us() - t;
+ t = Us();
+ for(i=0; i<RUNS; i++) if(ShellCount(Sub) != EMPTY_FILES) Bad++;
+ Shell = Us() - t;
+ Report("count", Native, Shell);
+
+ // Empty it, as Restart() does
+ for(i=0, Native=0; i<RUNS; i++)
+ {
+  Fill(Sub);
+  t = Us();
+  if(FileEmpty(Sub) < 0) Bad++;
+  Native += Us() - t;
+ }
+ snprintf(Cmd, sizeof(Cmd), "rm %s/*", Sub);
+ for(i=0, Shell=0; i<RUNS; i++)
+ {
+  Fill(Sub);
+  t = Us();
+  if(system(Cmd) != 0) Bad++;
+  Shell += Us() - t;
+ }
+ Report("empty", Native, Shell);
+ if(FileCount(Sub) != 0) Bad++;
+
+ FileRemoveTree(Dir);
+ if(Bad) printf("%d operations failed\n", Bad);
+ return Bad != 0;
+}
@@ -0,0 +1,129 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Press-to-stop benchmark
+//
+// Starts a background play of a 12 fps animation the way PlayVideo()
+// does, presses "stop" with PlayerCancel() at a random point in it,
+// and times how long the player takes to notice (its StopMs) and how
+// long until PlayerFd() says it has ended and PlayerFinish() has
+// collected it, which is when PlayDone() gives the screen back. The
+// presses land anywhere in the frame wait, so a player that only
+// looked at the cancel between frames would show up to 83 ms here.
+//
+// Run from the Animation folder: tests/benchPlayer [screen]
+// Frames go to a memory display unless "screen" is given, when
+// DisplayOpen() picks X11, DRM or the frame buffer as the station does.
+//
+///////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "../player.h"
+#include "../encode.h"
+#include "../fileOps.h"
+
+#define WIDE   640
+#define HIGH   480
+#define FRAMES 48
+#define FPS    12   // PLAY_FPS in mainDualMode.c
+#define PRESSES 40
+
+static double Ms()
+{
+ struct timespec t;
+
+ clock_gettime(CLOCK_MONOTONIC, &t);
+ return t.tv_sec * 1000.0 + t.tv_nsec / 1e6;
+}
+
+static int Cmp(const void *a, const void *b)
+{
+ double x = *(double *)a, y = *(double *)b;
+
+ return x < y ? -1 : x > y;
+}
+
+// Write FRAMES test frames into Dir
+static int MakeFrames(char *Dir, char **Paths)
+{
+ static unsigned char Pixels[WIDE * HIGH * 4];
+ struct Frame F = { WIDE, HIGH, WIDE * 4, FRAME_BGRX, Pixels };
+ int i, k;
+
+ for(i=0; i<FRAMES; i++)
+ {
+  for(k=0; k<WIDE * HIGH * 4; k++) Pixels[k] = (k / 4 % WIDE + i * 8) ^ (k / 4 / WIDE);
+  Paths[i] = malloc(300);
+  snprintf(Paths[i], 300, "%s/Frame%05d.jpg", Dir, i);
+  if(EncodeJpeg(&F, Paths[i], 85) < 0) return -1;
+ }
+ return 0;
+}
+
+static void Report(char *What, double *t, int N)
+{
+ qsort(t, N, sizeof(t[0]), Cmp);
+ printf("%-22s %8.2f %8.2f %8.2f\n", What, t[N/2], t[N*99/100], t[N-1]);
+}
+
+int main(int argc, char **argv)
+{
+ struct PlayerStats S;
+ struct Display *D;
+ struct pollfd p;
+ char Dir[] = "/tmp/benchPlayerXXXXXX", *Paths[FRAMES];
+ double Stop[PRESSES], Back[PRESSES], Press;
+ int i, n = 0, Bad = 0;
+
+ if(mkdtemp(Dir) == NULL)
+ {
+  perror(Dir);
+  return 1;
+ }
+ D = argc > 1 && strcmp(argv[1], "screen") == 0 ? DisplayOpen(WIDE, HIGH) : DisplayOpenMemory(WIDE, HIGH);
+ if(D == NULL || MakeFrames(Dir, Paths) < 0)
+ {
+  printf("Could not set up the play\n");
+  FileRemoveTree(Dir);
+  return 1;
+ }
+ srand(1);
+ p.fd = PlayerFd();
+ p.events = POLLIN;
+ for(i=0; i<PRESSES; i++)
+ {
+  if(PlayerStart(Paths, FRAMES, FPS, D) < 0)
+  {
+   Bad++;
+   continue;
+  }
+  // Somewhere in the first second and a half of the four second play
+  usleep(100000 + rand() % 1400000);
+  Press = Ms();
+  PlayerCancel();
+  if(poll(&p, 1, 2000) <= 0 || PlayerFinish(&S) < 0 || !S.Stopped)
+  {
+   printf("Press %d did not stop the play\n", i);
+   Bad++;
+   continue;
+  }
+  Back[n] = Ms() - Press;
+  Stop[n++] = S.StopMs;
+ }
+ printf("%d presses, %d frames at %d fps, %s display\n", n, FRAMES, FPS, argc > 1 ? argv[1] : "memory");
+ printf("%-22s %8s %8s %8s\n", "", "p50 ms", "p99 ms", "max ms");
+ if(n > 0)
+ {
+  Report("press to stopped", Stop, n);
+  Report("press to finished", Back, n);
+ }
+ DisplayClose(D);
+ for(i=0; i<FRAMES; i++) free(Paths[i]);
+ FileRemoveTree(Dir);
+ return Bad != 0;
+}
@@ -0,0 +1,141 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Saved video snapshot benchmark
+//
+// Times saving a 300 frame session the way SaveVideo() does now,
+// TimelineExport() linking (or reflinking) each frame into the saved
+// folder, against copying every frame's bytes with FileCopy() and
+// against the rsync -a the station used before. The frames are 40 KB,
+// about one 640x480 JPEG each.
+//
+// Run from the Animation folder: tests/benchSnapshot [folder ...]
+// Each folder (default /tmp) is measured in turn, so give one on each
+// file system of interest: the SD card's ext4, a tmpfs such as
+// /dev/shm, or a loop mounted XFS image where reflinks are possible.
+//
+///////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../timeline.h"
+#include "../fileOps.h"
+
+#define FRAMES      300
+#define FRAME_BYTES 40000
+#define RUNS        5     // Of each way, the best is kept
+
+static double Ms()
+{
+ struct timespec t;
+
+ clock_gettime(CLOCK_MONOTONIC, &t);
+ return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+// Record a session of FRAMES frames in Dir
+static int Record(char *Dir)
+{
+ char Buf[FRAME_BYTES], Path[256];
+ int i, j, Fd, r = 0;
+
+ if(TimelineLoad(Dir) < 0) return -1;
+ TimelineClear();
+ for(i=0; i<FRAMES; i++)
+ {
+  for(j=0; j<FRAME_BYTES; j++) Buf[j] = i + j * 7;
+  TimelinePath(TimelineAppend(), Path);
+  if((Fd = open(Path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0 ||
+     write(Fd, Buf, FRAME_BYTES) != FRAME_BYTES) r = -1;
+  if(Fd >= 0) close(Fd);
+ }
+ return r;
+}
+
+// Copy every byte, as the fallback would on a file system that can
+// neither link nor clone
+static int CopyAll(char *Out)
+{
+ char From[256], To[256];
+ int i;
+
+ mkdir(Out, 0755);
+ for(i=0; i<FRAMES; i++)
+ {
+  TimelinePath(TimelineId(i), From);
+  snprintf(To, sizeof(To), "%s/Frame%05d.jpg", Out, i);
+  if(FileCopy(From, To) < 0) return -1;
+ }
+ return 0;
+}
+
+static int Bench(char *Where)
+{
+ char Dir[256], Frames[300], Saved[300], Cmd[700];
+ double Best[3] = { 1e9, 1e9, 1e9 }, t;
+ int i, Copied = 0, Rsync;
+
+ snprintf(Dir, sizeof(Dir), "%s/benchSnapshotXXXXXX", Where);
+ if(mkdtemp(Dir) == NULL)
+ {
+  perror(Dir);
+  return -1;
+ }
+ snprintf(Frames, sizeof(Frames), "%s/Frames", Dir);
+ snprintf(Saved, sizeof(Saved), "%s/Video00", Dir);
+ mkdir(Frames, 0755);
+ if(Record(Frames) < 0)
+ {
+  printf("Could not record the frames in %s\n", Frames);
+  FileRemoveTree(Dir);
+  return -1;
+ }
+ Rsync = system("rsync --version > /dev/null 2>&1") == 0;
+ snprintf(Cmd, sizeof(Cmd), "rsync -a %s/ %s/", Frames, Saved);
+ for(i=0; i<RUNS; i++)
+ {
+  FileRemoveTree(Saved);
+  sync();
+  t = Ms();
+  Copied = TimelineExport(Saved);
+  t = Ms() - t;
+  if(t < Best[0]) Best[0] = t;
+  FileRemoveTree(Saved);
+  sync();
+  t = Ms();
+  if(CopyAll(Saved) < 0) printf("Copy failed\n");
+  t = Ms() - t;
+  if(t < Best[1]) Best[1] = t;
+  if(!Rsync) continue;
+  FileRemoveTree(Saved);
+  sync();
+  t = Ms();
+  if(system(Cmd) != 0) printf("rsync failed\n");
+  t = Ms() - t;
+  if(t < Best[2]) Best[2] = t;
+ }
+ printf("%-24s %10.2f %10.2f ", Where, Best[0], Best[1]);
+ if(Rsync) printf("%10.2f", Best[2]);
+ else printf("%10s", "-");
+ printf(" %8d\n", Copied);
+ TimelineClear();
+ FileRemoveTree(Dir);
+ return Copied < 0 ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+ char *Default[] = { "/tmp" };
+ char **Where = argc > 1 ? argv + 1 : Default;
+ int i, n = argc > 1 ? argc - 1 : 1, Bad = 0;
+
+ printf("Saving %d frames of %d bytes, best of %d\n", FRAMES, FRAME_BYTES, RUNS);
+ printf("%-24s %10s %10s %10s %8s\n", "folder", "export ms", "copy ms", "rsync ms", "copied");
+ for(i=0; i<n; i++) if(Bench(Where[i]) < 0) Bad++;
+ return Bad != 0;
+}
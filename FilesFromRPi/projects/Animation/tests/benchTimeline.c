@@ -0,0 +1,107 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Timeline insert benchmark
+//
+// Times recording a frame at the cursor (TimelineInsert() in the
+// middle of the animation, journal write included) with 10, 100, 1000
+// and 10000 frames already recorded. For comparison it also times the
+// old way of making room, renaming every later Frame%05d.jpg up one
+// place, once for each size.
+//
+// Run from the Animation folder: tests/benchTimeline [folder]
+// The folder (default /tmp) should be on the disk being measured.
+//
+///////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../timeline.h"
+#include "../fileOps.h"
+
+#define INSERTS 1000  // Timed at each size
+
+static double Us()
+{
+ struct timespec t;
+
+ clock_gettime(CLOCK_MONOTONIC, &t);
+ return t.tv_sec * 1e6 + t.tv_nsec / 1e3;
+}
+
+static int Cmp(const void *a, const void *b)
+{
+ double x = *(double *)a, y = *(double *)b;
+
+ return x < y ? -1 : x > y;
+}
+
+// Make room for frame At among N by renaming the later frames, as
+// Erase() and GrabFrame() once did with mv
+static double Renumber(char *Dir, int N, int At)
+{
+ char From[300], To[300];
+ double t;
+ int i, Fd;
+
+ for(i=0; i<N; i++)
+ {
+  snprintf(From, sizeof(From), "%s/Frame%05d.jpg", Dir, i);
+  if((Fd = open(From, O_WRONLY | O_CREAT, 0644)) >= 0) close(Fd);
+ }
+ t = Us();
+ for(i=N-1; i>=At; i--)
+ {
+  snprintf(From, sizeof(From), "%s/Frame%05d.jpg", Dir, i);
+  snprintf(To, sizeof(To), "%s/Frame%05d.jpg", Dir, i + 1);
+  rename(From, To);
+ }
+ t = Us() - t;
+ FileEmpty(Dir);
+ return t;
+}
+
+int main(int argc, char **argv)
+{
+ int Sizes[] = { 10, 100, 1000, 10000 };
+ double Ms[INSERTS], Mean[4], Sum;
+ char Dir[256];
+ int s, i, N;
+
+ snprintf(Dir, sizeof(Dir), "%s/benchTimelineXXXXXX", argc > 1 ? argv[1] : "/tmp");
+ if(mkdtemp(Dir) == NULL)
+ {
+  perror(Dir);
+  return 1;
+ }
+ printf("Insert at the cursor, %d times at each size, in %s\n", INSERTS, Dir);
+ printf("%8s %10s %10s %10s %14s\n", "frames", "mean us", "p50 us", "p99 us", "renumber us");
+ for(s=0; s<4; s++)
+ {
+  N = Sizes[s];
+  TimelineLoad(Dir);
+  TimelineClear();
+  for(i=0; i<N; i++) TimelineAppend();
+  // Insert in the middle and erase again, so the size stays put
+  for(i=0, Sum=0; i<INSERTS; i++)
+  {
+   Ms[i] = Us();
+   TimelineInsert(N / 2);
+   Ms[i] = Us() - Ms[i];
+   Sum += Ms[i];
+   TimelineErase(N / 2);
+  }
+  qsort(Ms, INSERTS, sizeof(Ms[0]), Cmp);
+  Mean[s] = Sum / INSERTS;
+  printf("%8d %10.2f %10.2f %10.2f %14.0f\n", N, Mean[s], Ms[INSERTS/2], Ms[INSERTS*99/100], Renumber(Dir, N, N / 2));
+  TimelineClear();
+  FileEmpty(Dir);
+ }
+ printf("Mean insert at 10000 frames is %.1fx the mean at 10\n", Mean[3] / Mean[0]);
+ FileRemoveTree(Dir);
+ return 0;
+}
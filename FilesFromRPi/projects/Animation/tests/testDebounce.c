@@ -0,0 +1,146 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Debounce trace test
+//
+// Replays a recorded trace of button edges (bouncy.trace) through a
+// fake line source and InputWait(), the same path the GPIO chip's
+// events take, into DebounceFeed(). The events that come out must be
+// exactly the ones the trace lists, in order and at the times given,
+// every press must be reported on its first edge, and no edge may
+// take 10 ms or more from being written to its events being queued.
+//
+// Run from the Animation folder: tests/testDebounce tests/bouncy.trace
+//
+///////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/gpio.h>
+
+#include "../input.h"
+#include "../debounce.h"
+
+#define MAX_LINES 256
+#define LATE_US   10000 // Most time an edge may take to be handled
+
+// The timing of FRAME_FWD and RECORD in mainDualMode.c
+struct ButtonConfig Timing[] = {
+ { 23, 20000, 500000, 150000 },
+ { 25, 20000, 0, 0 } };
+
+struct Line
+{
+ int Edge;      // Else an event wanted
+ int Pin, Level;
+ char Name[16];
+ uint64_t Us;
+};
+
+static struct Line Lines[MAX_LINES];
+static int NumLines = 0;
+
+static int Load(char *Path)
+{
+ char s[256], What[16];
+ unsigned long long Us;
+ struct Line *L;
+ FILE *F;
+
+ if((F = fopen(Path, "r")) == NULL)
+ {
+  perror(Path);
+  return -1;
+ }
+ while(fgets(s, sizeof(s), F) && NumLines < MAX_LINES)
+ {
+  L = &Lines[NumLines];
+  if(s[0] == '#' || sscanf(s, "%15s", What) != 1) continue;
+  if(strcmp(What, "edge") == 0 && sscanf(s, "%*s %d %d %llu", &L->Pin, &L->Level, &Us) == 3) L->Edge = 1;
+  else if(strcmp(What, "want") == 0 && sscanf(s, "%*s %d %15s %llu", &L->Pin, L->Name, &Us) == 3) L->Edge = 0;
+  else
+  {
+   printf("Bad line in %s: %s", Path, s);
+   fclose(F);
+   return -1;
+  }
+  L->Us = Us;
+  NumLines++;
+ }
+ fclose(F);
+ return 0;
+}
+
+int main(int argc, char **argv)
+{
+ struct gpio_v2_line_event ev;
+ struct InputEvent In;
+ struct ButtonEvent E;
+ struct Line *L;
+ uint64_t t, Late = 0, End = 0;
+ int Pipe[2], i, Want = 0, Got = 0, Bad = 0;
+
+ if(Load(argc > 1 ? argv[1] : "tests/bouncy.trace") < 0) return 1;
+ if(pipe(Pipe) < 0 || InputAddFake(Pipe[0]) < 0)
+ {
+  perror("pipe");
+  return 1;
+ }
+ DebounceInit(Timing, sizeof(Timing)/sizeof(Timing[0]));
+ for(i=0; i<=NumLines; i++)
+ {
+  if(i < NumLines && !Lines[i].Edge) continue;
+  if(i < NumLines)
+  {
+   L = &Lines[i];
+   memset(&ev, 0, sizeof(ev));
+   ev.timestamp_ns = L->Us * 1000;
+   ev.id = L->Level ? GPIO_V2_LINE_EVENT_RISING_EDGE : GPIO_V2_LINE_EVENT_FALLING_EDGE;
+   ev.offset = L->Pin;
+   t = InputNow();
+   if(write(Pipe[1], &ev, sizeof(ev)) != sizeof(ev) || InputWait(&In, 1000) != 1)
+   {
+    printf("Edge at %llu us did not come through\n", (unsigned long long)L->Us);
+    return 1;
+   }
+   DebounceFeed(In.Pin, In.Level, In.TimeNs / 1000);
+   if((t = InputNow() - t) / 1000 > Late) Late = t / 1000;
+   End = L->Us;
+  }
+  // After the last edge, run the clock on until nothing is due
+  else DebounceTick(End + 1000000);
+  while(DebounceGet(&E))
+  {
+   while(Want < NumLines && Lines[Want].Edge) Want++;
+   Got++;
+   if(Want == NumLines)
+   {
+    printf("Unexpected %s %d at %llu us\n", DebounceName(E.Type), E.Pin, (unsigned long long)E.TimeUs);
+    Bad++;
+    continue;
+   }
+   L = &Lines[Want++];
+   if(E.Pin != L->Pin || strcmp(DebounceName(E.Type), L->Name) != 0 || E.TimeUs != L->Us)
+   {
+    printf("Got %s %d at %llu us, wanted %s %d at %llu us\n", DebounceName(E.Type), E.Pin,
+           (unsigned long long)E.TimeUs, L->Name, L->Pin, (unsigned long long)L->Us);
+    Bad++;
+   }
+  }
+ }
+ while(Want < NumLines && Lines[Want].Edge) Want++;
+ for(; Want < NumLines; Want++)
+  if(!Lines[Want].Edge)
+  {
+   printf("Missing %s %d at %llu us\n", Lines[Want].Name, Lines[Want].Pin, (unsigned long long)Lines[Want].Us);
+   Bad++;
+  }
+ if(Late >= LATE_US)
+ {
+  printf("An edge took %llu us to handle\n", (unsigned long long)Late);
+  Bad++;
+ }
+ printf("Debounce trace: %d events, slowest edge %llu us: %s\n", Got, (unsigned long long)Late, Bad ? "FAILED" : "passed");
+ InputClose();
+ return Bad ? 1 : 0;
+}
@@ -0,0 +1,233 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Frame pool test
+//
+// First the lock free stack on its own: STRESS_THREADS threads take
+// and give back frames of a pool smaller than their number as fast as
+// they can, each marking a frame as its own while it holds it. A frame
+// handed to two threads at once, or one that never comes back, fails
+// the test, and the change count on the top of the stack must equal
+// the number of takes and gives.
+//
+// Then a soak of the encoder's slots, the way the station uses them:
+// SOAK_CYCLES RECORDs (EncodeSlot(), fill, EncodeQueue()), with the
+// recorded frames ERASEd (their files removed) every SOAK_BATCH. A
+// slot issued again before its frame was encoded, a frame missing
+// from disk, heap growth over the run, or a slot still taken at the
+// end fails it.
+//
+// Run from the Animation folder: tests/testFramePool [folder]
+// The frames of the soak are written in the folder (default /tmp).
+//
+///////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "../framePool.h"
+#include "../encode.h"
+#include "../fileOps.h"
+
+#define STRESS_THREADS 8
+#define STRESS_FRAMES  4
+#define STRESS_LOOPS   200000 // Takes by each thread
+
+#define SOAK_CYCLES 10000
+#define SOAK_BATCH  8
+#define SOAK_SLOTS  4
+#define SOAK_WIDE   160
+#define SOAK_HIGH   120
+#define HEAP_SLACK  65536 // Heap growth allowed over the soak
+
+static struct FramePool Pool;
+static int Owner[STRESS_FRAMES];   // Thread holding each frame, 0 if none
+static long Gives[STRESS_THREADS];
+static int Failed = 0;
+
+static void *Stress(void *Arg)
+{
+ int Me = (int)(long)Arg + 1, i, k, Was;
+ struct Frame *F;
+
+ for(i=0; i<STRESS_LOOPS; i++)
+ {
+  if((F = FramePoolGet(&Pool)) == NULL) continue;
+  k = FramePoolIndex(&Pool, F);
+  Was = 0;
+  if(k < 0 || !__atomic_compare_exchange_n(&Owner[k], &Was, Me, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+  {
+   printf("Frame %d given to thread %d while thread %d has it\n", k, Me, Was);
+   __atomic_add_fetch(&Failed, 1, __ATOMIC_RELAXED);
+   continue;
+  }
+  // Scribble on it while it is ours
+  F->Pixels[0] = Me;
+  if(i % 64 == 0) sched_yield();
+  if(F->Pixels[0] != Me || __atomic_load_n(&Owner[k], __ATOMIC_SEQ_CST) != Me)
+  {
+   printf("Frame %d changed under thread %d\n", k, Me);
+   __atomic_add_fetch(&Failed, 1, __ATOMIC_RELAXED);
+  }
+  __atomic_store_n(&Owner[k], 0, __ATOMIC_SEQ_CST);
+  FramePoolPut(&Pool, F);
+  Gives[Me - 1]++;
+ }
+ return NULL;
+}
+
+static void Check(int Ok, char *What)
+{
+ if(Ok) return;
+ printf("%s\n", What);
+ Failed++;
+}
+
+static void StressPool()
+{
+ pthread_t Threads[STRESS_THREADS];
+ struct FramePoolStats S;
+ struct Frame *Got[STRESS_FRAMES + 1];
+ long Total = 0;
+ int i, j;
+
+ if(FramePoolOpen(&Pool, STRESS_FRAMES, 64, 64, FRAME_BGRX) < 0)
+ {
+  Check(0, "Could not open the pool");
+  return;
+ }
+ for(i=0; i<STRESS_THREADS; i++) pthread_create(&Threads[i], NULL, Stress, (void *)(long)i);
+ for(i=0; i<STRESS_THREADS; i++)
+ {
+  pthread_join(Threads[i], NULL);
+  Total += Gives[i];
+ }
+ FramePoolGetStats(&Pool, &S);
+ printf("Pool stress: %d threads on %d frames, %ld takes, %ld misses, most in use %d\n",
+        STRESS_THREADS, STRESS_FRAMES, S.Gets, S.Misses, S.MaxInUse);
+ Check(S.InUse == 0, "Frames still in use after the stress");
+ Check(S.Gets == Total, "Takes and gives do not match");
+ Check(S.MaxInUse <= STRESS_FRAMES, "More frames in use than the pool has");
+ Check((long)(Pool.Top >> 32) == 2 * Total, "The change count missed a take or give");
+ // Every frame must be there once, and no more
+ for(i=0; i<=STRESS_FRAMES; i++) Got[i] = FramePoolGet(&Pool);
+ Check(Got[STRESS_FRAMES] == NULL, "The pool gave out more frames than it has");
+ for(i=0; i<STRESS_FRAMES; i++)
+ {
+  Check(Got[i] != NULL, "A frame was lost");
+  for(j=0; j<i; j++) Check(Got[i] != Got[j] || Got[i] == NULL, "A frame is on the free stack twice");
+ }
+ FramePoolClose(&Pool);
+}
+
+// The soak's view of the encoder's slots
+static struct Frame *Slot[SOAK_SLOTS];
+static volatile int Held[SOAK_SLOTS]; // Cycle + 1 a slot was filled for, 0 once encoded
+static char Dir[256];
+
+static int SlotIndex(struct Frame *F)
+{
+ int i;
+
+ for(i=0; i<SOAK_SLOTS && Slot[i] && Slot[i] != F; i++);
+ if(i == SOAK_SLOTS) return -1;
+ Slot[i] = F;
+ return i;
+}
+
+// Called by a worker when a frame is on disk, before its slot is
+// given back. The slot must still hold the frame of its cycle.
+static int Encoded(char *Path)
+{
+ int Cycle, k;
+
+ if(sscanf(strrchr(Path, '/'), "/Take%d_%d.jpg", &Cycle, &k) != 2 || k < 0 || k >= SOAK_SLOTS ||
+    Held[k] != Cycle + 1 || *(int *)Slot[k]->Pixels != Cycle)
+ {
+  printf("%s: its slot was reused before it was encoded\n", Path);
+  __atomic_add_fetch(&Failed, 1, __ATOMIC_RELAXED);
+ }
+ else Held[k] = 0;
+ return 0;
+}
+
+static void Soak()
+{
+ struct EncodeStats S;
+ struct Frame *F;
+ char Path[300];
+ size_t Heap = 0;
+ int i, j, k;
+
+ EncodeOnDone(Encoded);
+ if(EncodeStart(SOAK_SLOTS, 2, SOAK_WIDE, SOAK_HIGH, FRAME_YUYV) < 0)
+ {
+  Check(0, "Could not start the encoder");
+  return;
+ }
+ for(i=0; i<SOAK_CYCLES; i++)
+ {
+  // RECORD
+  F = EncodeSlot();
+  if((k = SlotIndex(F)) < 0 || Held[k])
+  {
+   printf("Cycle %d: slot %d issued while its frame waits to be encoded\n", i, k);
+   Failed++;
+   break;
+  }
+  memset(F->Pixels, 128, (size_t)F->Stride * F->High);
+  *(int *)F->Pixels = i;
+  Held[k] = i + 1;
+  snprintf(Path, sizeof(Path), "%s/Take%d_%d.jpg", Dir, i, k);
+  EncodeQueue(F, Path);
+  if((i + 1) % SOAK_BATCH) continue;
+  // ERASE the batch
+  EncodeDrain();
+  for(j=i+1-SOAK_BATCH; j<=i; j++)
+  {
+   for(k=0; k<SOAK_SLOTS; k++)
+   {
+    snprintf(Path, sizeof(Path), "%s/Take%d_%d.jpg", Dir, j, k);
+    if(unlink(Path) == 0) break;
+   }
+   if(k == SOAK_SLOTS)
+   {
+    printf("Cycle %d: frame not on disk\n", j);
+    Failed++;
+   }
+  }
+  // The heap is measured once everything the encoder and libjpeg
+  // keep has been allocated
+  if(i + 1 == 100 * SOAK_BATCH) Heap = mallinfo2().uordblks;
+ }
+ EncodeDrain();
+ EncodeGetStats(&S);
+ printf("Encoder soak: %d cycles, %ld encoded, %ld failed, %ld stalls, most slots in use %d of %d, heap grew %ld bytes\n",
+        SOAK_CYCLES, S.Encoded, S.Failed, S.Stalls, S.MaxInUse, S.Slots,
+        (long)mallinfo2().uordblks - (long)Heap);
+ Check(S.InUse == 0, "Slots still taken after the soak");
+ Check(S.Encoded == SOAK_CYCLES && S.Failed == 0, "Not every frame was encoded");
+ Check(S.MaxInUse <= SOAK_SLOTS, "More slots in use than there are");
+ Check(mallinfo2().uordblks <= Heap + HEAP_SLACK, "The heap grew during the soak");
+ for(k=0; k<SOAK_SLOTS; k++) Check(Held[k] == 0, "A queued frame was never encoded");
+ EncodeStop();
+}
+
+int main(int argc, char **argv)
+{
+ StressPool();
+ snprintf(Dir, sizeof(Dir), "%s/testFramePoolXXXXXX", argc > 1 ? argv[1] : "/tmp");
+ if(mkdtemp(Dir) == NULL)
+ {
+  perror(Dir);
+  return 1;
+ }
+ Soak();
+ Check(FileCount(Dir) == 0, "Frames left behind after the soak");
+ FileRemoveTree(Dir);
+ printf("Frame pool: %s\n", Failed ? "FAILED" : "passed");
+ return Failed != 0;
+}
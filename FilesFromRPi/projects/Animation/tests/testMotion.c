@@ -0,0 +1,197 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Stillness detector test
+//
+// Feeds MotionFeed() synthetic 1920x1080 YUYV camera frames at the
+// camera's 30 a second: a textured scene with sensor noise added to
+// every sample, and a dark "hand" that moves in over it, rests, and
+// moves out again. The detector must fire on a still scene with up to
+// +-12 of noise on every sample, never while the hand is moving, and
+// only once the scene has been still for the whole STILL_MS after the
+// hand has gone.
+// MotionSad() is also checked against a plain loop, since it has NEON
+// and SSE2 versions.
+//
+// Run from the Animation folder: tests/testMotion
+//
+///////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../motion.h"
+
+#define WIDE 1920
+#define HIGH 1080
+#define FPS  30
+// As mainDualMode.c arms it
+#define STILL_MS    600
+#define STILL_LEVEL 3
+
+#define LATE_MS 250 // Slack for drawing the frames on a busy machine
+
+#define HAND_WIDE 320
+#define HAND_HIGH 480
+#define HAND_STEP 40  // Pixels the hand moves each frame
+
+static unsigned char Pixels[WIDE * HIGH * 2];
+static struct Frame F = { WIDE, HIGH, WIDE * 2, FRAME_YUYV, Pixels };
+static unsigned int Seed = 1;
+static int Failed = 0;
+
+static double Ms()
+{
+ struct timespec t;
+
+ clock_gettime(CLOCK_MONOTONIC, &t);
+ return t.tv_sec * 1000.0 + t.tv_nsec / 1e6;
+}
+
+static unsigned int Random()
+{
+ Seed ^= Seed << 13;
+ Seed ^= Seed >> 17;
+ Seed ^= Seed << 5;
+ return Seed;
+}
+
+// Draw the scene with each luma sample off by up to +-Noise, and the
+// hand's top left corner at HandX (off the picture if outside it)
+static void Draw(int Noise, int HandX)
+{
+ unsigned char *p = Pixels;
+ int x, y, v;
+
+ for(y=0; y<HIGH; y++)
+  for(x=0; x<WIDE; x++, p+=2)
+  {
+   v = 60 + ((x / 64 + y / 64) & 1) * 100 + (x * 40) / WIDE; // Checks over a ramp
+   if(x >= HandX && x < HandX + HAND_WIDE && y >= 300 && y < 300 + HAND_HIGH) v = 30;
+   if(Noise) v += (int)(Random() % (2 * Noise + 1)) - Noise;
+   p[0] = v < 0 ? 0 : v > 255 ? 255 : v;
+   p[1] = 128;
+  }
+}
+
+// Wait for the next camera frame time, then feed it
+static int Feed(double *Next)
+{
+ double Now = Ms();
+
+ if(*Next > Now) usleep((*Next - Now) * 1000);
+ *Next += 1000.0 / FPS;
+ return MotionFeed(&F);
+}
+
+static void Check(int Ok, char *Name, char *What)
+{
+ if(Ok) return;
+ printf("%s: %s\n", Name, What);
+ Failed++;
+}
+
+// The scene alone: must fire STILL_MS after arming, or up to LATE_MS
+// later
+static void Still(char *Name, int Noise)
+{
+ struct MotionStats S;
+ double Next = Ms(), Start = Next;
+ int i, Fired = 0;
+
+ MotionArm(STILL_MS, STILL_LEVEL);
+ for(i=0; i<3 * FPS && !Fired; i++)
+ {
+  Draw(Noise, -HAND_WIDE);
+  Fired = Feed(&Next);
+ }
+ MotionGetStats(&S);
+ printf("%-12s noise %2d: fired %d after %4.0f ms, most change %.2f\n", Name, Noise, Fired, Ms() - Start, S.MaxLevel);
+ Check(Fired, Name, "never fired on a still scene");
+ Check(!Fired || (Ms() - Start >= STILL_MS && Ms() - Start < STILL_MS + LATE_MS), Name, "fired at the wrong time");
+ Check(!MotionArmed(), Name, "still armed after firing");
+}
+
+// The hand moves in from the left, rests for less than STILL_MS, and
+// moves out to the right
+static void Hand(int Noise)
+{
+ struct MotionStats S;
+ double Next = Ms(), Gone = 0;
+ int x, i, Fired = 0;
+
+ MotionArm(STILL_MS, STILL_LEVEL);
+ for(x=-HAND_WIDE; x<WIDE/2 && !Fired; x+=HAND_STEP)
+ {
+  Draw(Noise, x);
+  Fired = Feed(&Next);
+ }
+ Check(!Fired, "hand", "fired while the hand moved in");
+ for(i=0; i<(STILL_MS / 2) * FPS / 1000 && !Fired; i++)
+ {
+  Draw(Noise, x);
+  Fired = Feed(&Next);
+ }
+ Check(!Fired, "hand", "fired while the hand rested for less than STILL_MS");
+ for(; x<WIDE && !Fired; x+=HAND_STEP)
+ {
+  Draw(Noise, x);
+  Fired = Feed(&Next);
+ }
+ Check(!Fired, "hand", "fired while the hand moved out");
+ Gone = Ms();
+ for(i=0; i<3 * FPS && !Fired; i++)
+ {
+  Draw(Noise, WIDE);
+  Fired = Feed(&Next);
+ }
+ MotionGetStats(&S);
+ printf("%-12s noise %2d: fired %d %4.0f ms after the hand left, most change %.2f, %.2f ms a frame\n",
+        "hand", Noise, Fired, Ms() - Gone, S.MaxLevel, S.LastMs);
+ Check(Fired, "hand", "never fired once the hand had gone");
+ Check(!Fired || Ms() - Gone >= STILL_MS - 1000.0 / FPS, "hand", "fired too soon after the hand left");
+ Check(S.MaxLevel > 4 * STILL_LEVEL, "hand", "the hand barely registered as motion");
+}
+
+static void Sad()
+{
+ unsigned char a[1000], b[1000];
+ unsigned long r;
+ size_t n, i;
+
+ for(n=0; n<sizeof(a); n+=37)
+ {
+  for(i=0; i<n; i++)
+  {
+   a[i] = Random();
+   b[i] = Random();
+  }
+  for(r=0, i=0; i<n; i++) r += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+  if(MotionSad(a, b, n) != r)
+  {
+   printf("MotionSad of %zu bytes gave %lu, not %lu\n", n, MotionSad(a, b, n), r);
+   Failed++;
+  }
+ }
+}
+
+int main()
+{
+ Sad();
+ if(MotionInit(WIDE, HIGH) < 0) return 1;
+ Still("still", 0);
+ Still("sensor noise", 4);
+ Still("sensor noise", 12);
+ Hand(12);
+ // A frame it cannot use, and a disarmed detector, are ignored
+ F.Format = FRAME_BGRX;
+ MotionArm(0, STILL_LEVEL);
+ Check(MotionFeed(&F) == 0, "format", "fired on a BGRX frame");
+ F.Format = FRAME_YUYV;
+ MotionDisarm();
+ Check(MotionFeed(&F) == 0 && !MotionArmed(), "disarm", "fired when disarmed");
+ printf("Motion: %s\n", Failed ? "FAILED" : "passed");
+ return Failed != 0;
+}
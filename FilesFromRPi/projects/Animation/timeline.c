@@ -0,0 +1,319 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Frame timeline. See timeline.h
+//
+// The IDs are held in a list of chunks of at most CHUNK_MAX IDs each.
+// Finding a position walks the chunk lengths, and inserting or
+// erasing only shifts IDs within one chunk, so the cost of an edit
+// stays small however long the animation gets. A full chunk is split
+// in two and neighbours that get small are merged back together.
+//
+// Edits are appended to a journal as they are made, one short line
+// each, so recording a frame does not rewrite the whole list. The
+// manifest names the journal that goes with it. TimelineSave() writes
+// a new manifest naming a new, empty journal, renames it into place
+// and only then removes the old journal, so a crash at any point
+// leaves a manifest and journal that agree.
+//
+///////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "timeline.h"
+#include "fileOps.h"
+
+#define CHUNK_MAX 256
+
+struct Chunk
+{
+ int N;
+ int Ids[CHUNK_MAX];
+};
+
+static char Folder[200];
+static struct Chunk **Chunks = NULL; // Chunks in display order
+static int NumChunks = 0, Size = 0;
+static int Count = 0;
+static int NextId = 0;
+static int Log = -1, LogGen = 0;     // Open journal and its number
+
+int TimelineCount() { return Count; }
+
+char *TimelinePath(int Id, char *Buf)
+{
+ sprintf(Buf, "%s/Take%06d.jpg", Folder, Id);
+ return Buf;
+}
+
+static void LogName(char *Buf, int Gen)
+{
+ sprintf(Buf, "%s/%s.%d", Folder, TIMELINE_JOURNAL, Gen);
+}
+
+// Append one edit to the journal
+static void Journal(char *Format, int a, int b)
+{
+ char s[64];
+ int n;
+
+ if(Log < 0) return;
+ n = snprintf(s, sizeof(s), Format, a, b);
+ if(write(Log, s, n) != n) perror(TIMELINE_JOURNAL);
+}
+
+// Find the chunk holding position Index. For Index == Count this is
+// the last chunk, with *Off one past its end.
+static int Find(int Index, int *Off)
+{
+ int c;
+
+ for(c=0; c<NumChunks-1 && Index >= Chunks[c]->N; c++) Index -= Chunks[c]->N;
+ *Off = Index;
+ return c;
+}
+
+// Make room for a new chunk at position c
+static struct Chunk *AddChunk(int c)
+{
+ struct Chunk **p, *New;
+
+ if(NumChunks == Size)
+ {
+  if((p = realloc(Chunks, (Size ? Size * 2 : 16) * sizeof(*p))) == NULL) return NULL;
+  Chunks = p;
+  Size = Size ? Size * 2 : 16;
+ }
+ if((New = malloc(sizeof(*New))) == NULL) return NULL;
+ New->N = 0;
+ memmove(Chunks + c + 1, Chunks + c, (NumChunks - c) * sizeof(*Chunks));
+ Chunks[c] = New;
+ NumChunks++;
+ return New;
+}
+
+static void DropChunk(int c)
+{
+ free(Chunks[c]);
+ memmove(Chunks + c, Chunks + c + 1, (NumChunks - c - 1) * sizeof(*Chunks));
+ NumChunks--;
+}
+
+int TimelineId(int Index)
+{
+ int c, Off;
+
+ if(Index < 0 || Index >= Count) return -1;
+ c = Find(Index, &Off);
+ return Chunks[c]->Ids[Off];
+}
+
+static int Insert(int Index, int Id)
+{
+ struct Chunk *C;
+ int c, Off;
+
+ if(NumChunks == 0 && AddChunk(0) == NULL) return -1;
+ c = Find(Index, &Off);
+ C = Chunks[c];
+ if(C->N == CHUNK_MAX)
+ {
+  // Split the full chunk, moving its top half into a new one
+  if(AddChunk(c + 1) == NULL) return -1;
+  Chunks[c + 1]->N = CHUNK_MAX / 2;
+  memcpy(Chunks[c + 1]->Ids, C->Ids + CHUNK_MAX / 2, CHUNK_MAX / 2 * sizeof(int));
+  C->N = CHUNK_MAX / 2;
+  if(Off > C->N)
+  {
+   Off -= C->N;
+   C = Chunks[c + 1];
+  }
+ }
+ memmove(C->Ids + Off + 1, C->Ids + Off, (C->N - Off) * sizeof(int));
+ C->Ids[Off] = Id;
+ C->N++;
+ Count++;
+ return 0;
+}
+
+static int Remove(int Index)
+{
+ struct Chunk *C;
+ int c, Off, Id;
+
+ if(Index < 0 || Index >= Count) return -1;
+ c = Find(Index, &Off);
+ C = Chunks[c];
+ Id = C->Ids[Off];
+ memmove(C->Ids + Off, C->Ids + Off + 1, (C->N - Off - 1) * sizeof(int));
+ C->N--;
+ Count--;
+ // Fold the next chunk in if both together fill no more than half a
+ // chunk, so erasing does not leave a long list of tiny chunks.
+ if(c + 1 < NumChunks && C->N + Chunks[c + 1]->N <= CHUNK_MAX / 2)
+ {
+  memcpy(C->Ids + C->N, Chunks[c + 1]->Ids, Chunks[c + 1]->N * sizeof(int));
+  C->N += Chunks[c + 1]->N;
+  DropChunk(c + 1);
+ }
+ if(C->N == 0) DropChunk(c);
+ return Id;
+}
+
+void TimelineClear()
+{
+ while(NumChunks) DropChunk(NumChunks - 1);
+ Count = 0;
+ // NextId is kept, the frame cache and the frame store know frames by
+ // ID and file name
+ Journal("c\n", 0, 0);
+}
+
+// Replay a journal onto the list just loaded
+static void Replay(int Gen)
+{
+ char s[256], Op;
+ FILE *F;
+ int a, b;
+
+ LogName(s, Gen);
+ if((F = fopen(s, "r")) == NULL) return;
+ // Replaying stops at a torn last line from a crash, and at an edit
+ // that does not fit the list, which means the journal does not go
+ // with this manifest. The list is kept as it was up to there.
+ while(fscanf(F, " %c", &Op) == 1)
+ {
+  if(Op == 'c') TimelineClear();
+  else if(Op == 'i' && fscanf(F, "%d %d", &a, &b) == 2 && a >= 0 && a <= Count && b >= 0)
+  {
+   if(Insert(a, b) < 0) break;
+   if(b >= NextId) NextId = b + 1;
+  }
+  else if(Op == 'e' && fscanf(F, "%d", &a) == 1 && a >= 0 && a < Count) Remove(a);
+  else if(Op == 'm' && fscanf(F, "%d %d", &a, &b) == 2 && a >= 0 && a < Count && b >= 0 && b < Count)
+   Insert(b, Remove(a));
+  else break;
+ }
+ fclose(F);
+}
+
+int TimelineLoad(char *Dir)
+{
+ char s[256];
+ FILE *F;
+ int Id, Gen = 0;
+
+ if(Log >= 0) close(Log);
+ Log = -1;
+ snprintf(Folder, sizeof(Folder), "%s", Dir);
+ TimelineClear();
+ NextId = 0;
+ sprintf(s, "%s/%s", Folder, TIMELINE_MANIFEST);
+ if((F = fopen(s, "r")) != NULL)
+ {
+  if(fscanf(F, " next %d", &NextId) != 1) NextId = 0;
+  if(fscanf(F, " journal %d", &Gen) != 1) Gen = 0;
+  while(fscanf(F, "%d", &Id) == 1 && Insert(Count, Id) == 0)
+   if(Id >= NextId) NextId = Id + 1;
+  fclose(F);
+  Replay(Gen);
+ }
+ // Start from a clean manifest with an empty journal
+ LogGen = Gen;
+ return TimelineSave();
+}
+
+// Write the list to a temporary file, rename it over the old one and
+// start a new journal
+int TimelineSave()
+{
+ char s[256], t[264], Old[256];
+ FILE *F;
+ int c, i;
+
+ sprintf(s, "%s/%s", Folder, TIMELINE_MANIFEST);
+ sprintf(t, "%s.tmp", s);
+ if((F = fopen(t, "w")) == NULL)
+ {
+  perror(t);
+  return -1;
+ }
+ fprintf(F, "next %d\njournal %d\n", NextId, LogGen + 1);
+ for(c=0; c<NumChunks; c++)
+  for(i=0; i<Chunks[c]->N; i++) fprintf(F, "%d\n", Chunks[c]->Ids[i]);
+ if(fclose(F) != 0 || rename(t, s) != 0)
+ {
+  perror(s);
+  return -1;
+ }
+ if(Log >= 0) close(Log);
+ LogName(Old, LogGen++);
+ unlink(Old);
+ LogName(s, LogGen);
+ if((Log = open(s, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644)) < 0) perror(s);
+ return 0;
+}
+
+int TimelineInsert(int Index)
+{
+ if(Index < 0) Index = 0;
+ if(Index > Count) Index = Count;
+ if(Insert(Index, NextId) < 0) return -1;
+ Journal("i %d %d\n", Index, NextId);
+ return NextId++;
+}
+
+int TimelineAppend()
+{
+ return TimelineInsert(Count);
+}
+
+int TimelineErase(int Index)
+{
+ int Id = Remove(Index);
+
+ if(Id >= 0) Journal("e %d\n", Index, 0);
+ return Id;
+}
+
+int TimelineMove(int From, int To)
+{
+ int Id;
+
+ if(From < 0 || From >= Count || To < 0 || To >= Count) return -1;
+ Id = Remove(From);
+ Insert(To, Id);
+ Journal("m %d %d\n", From, To);
+ return 0;
+}
+
+int TimelineExport(char *Dir)
+{
+ char From[256], To[256];
+ int c, i, r, n = 0, Copied = 0;
+
+ if(mkdir(Dir, 0755) < 0 && errno != EEXIST)
+ {
+  perror(Dir);
+  return -1;
+ }
+ for(c=0; c<NumChunks; c++)
+  for(i=0; i<Chunks[c]->N; i++, n++)
+  {
+   TimelinePath(Chunks[c]->Ids[i], From);
+   sprintf(To, "%s/Frame%05d.jpg", Dir, n);
+   // The frames never change once written, so a link is as good as a
+   // copy and costs no frame data.
+   if((r = FileSnapshot(From, To)) < 0) return -1;
+   if(r == FILE_COPIED) Copied++;
+  }
+ // Drop any frames left over from a longer export
+ do sprintf(To, "%s/Frame%05d.jpg", Dir, n++);
+ while(unlink(To) == 0);
+ return Copied;
+}
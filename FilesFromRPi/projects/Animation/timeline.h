@@ -0,0 +1,56 @@
+///////////////////////////////////////////////////////////////////////
+//
+// Frame timeline
+//
+// The order of the frames in the animation is kept in a list of frame
+// IDs, separate from the frame files. Each frame is saved once as
+// Take<ID>.jpg and keeps that name for good, so erasing, inserting or
+// moving a frame only changes the list; no files are renamed. IDs are
+// never reused, not even after TimelineClear(), since the next ID is
+// kept in the manifest with the list.
+//
+// The list is saved in the frame folder as Manifest.txt, written under
+// a temporary name and renamed into place so it is never seen half
+// written. Edits made since then are appended to a small journal as
+// they happen and replayed on load, so each edit is saved at once
+// without rewriting the list. TimelineSave() folds the journal back
+// into the manifest. The Frame%05d.jpg naming feh expects is only
+// produced when the animation is exported.
+//
+///////////////////////////////////////////////////////////////////////
+
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#define TIMELINE_MANIFEST "Manifest.txt"
+#define TIMELINE_JOURNAL  "Journal"
+
+// Load the timeline kept in Folder, or start an empty one
+int  TimelineLoad(char *Folder);
+// Rewrite the manifest and start a new journal
+int  TimelineSave();
+// Empty the timeline. The frame files are left for the caller. New
+// frames go on from the next unused ID.
+void TimelineClear();
+
+int  TimelineCount();
+// ID of the frame at a position, -1 if out of range
+int  TimelineId(int Index);
+// Add a new frame at position Index, the frames from there on move
+// up one. Returns its ID.
+int  TimelineInsert(int Index);
+// Add a new frame at the end, returns its ID
+int  TimelineAppend();
+// Remove the frame at a position, returns its ID or -1
+int  TimelineErase(int Index);
+// Move the frame at From so it ends up at position To
+int  TimelineMove(int From, int To);
+
+// File name of a frame, in Buf (at least 256 bytes)
+char *TimelinePath(int Id, char *Buf);
+// Put the frames in Dir as Frame00000.jpg, Frame00001.jpg ... in
+// timeline order. The frames are linked rather than copied where
+// possible; returns the number that had to be copied, or -1.
+int  TimelineExport(char *Dir);
+
+#endif